@@ -1,19 +1,180 @@
-#include <algorithm>
+#include <string.h>
+#include <epicsGuard.h>
 
 #include "errorFilter.h"
+#include "restHash.h"
 
 
-bool ErrorFilter::newError(std::string error)
+ErrorFilter::ErrorFilter(double interval, size_t slots)
+  : mSlots(), mMask(0), mUsed(0), mInterval((epicsUInt64) (interval * 1e9)), mSuppressed(0),
+    mDisplaced(0), mLock()
 {
-  if (std::find(mErrors.begin(), mErrors.end(), error) == mErrors.end()) {
-    // If this is a new error message we add it and return true
-    mErrors.push_back(error);
+  size_t size = 1;
+  while (size < slots) {
+    size <<= 1;
+  }
+  error_filter_slot_t unused = {false, 0, NULL, 0, 0};
+  mSlots.assign(size, unused);
+  mMask = size - 1;
+}
+
+// Linear probing from the key's home slot: the key's slot if found,
+// otherwise the first free one, or the home slot itself (which a new key
+// takes over) once every slot is used
+ErrorFilter::error_filter_slot_t *ErrorFilter::find(epicsUInt32 key, const void *owner,
+                                                    bool & found)
+{
+  size_t home = key & mMask;
+  for (size_t probe = 0; probe <= mMask; ++probe) {
+    error_filter_slot_t *slot = &mSlots[(home + probe) & mMask];
+    if (!slot->used || (slot->key == key && slot->owner == owner)) {
+      found = slot->used;
+      return slot;
+    }
+  }
+  found = false;
+  return &mSlots[home];
+}
+
+bool ErrorFilter::newError(epicsUInt32 key, unsigned long & suppressed, const void *owner)
+{
+  epicsGuard<epicsMutex> guard(mLock);
+  epicsUInt64 now = epicsMonotonicGet();
+  suppressed = 0;
+
+  // Owners raising the same error probe from different home slots
+  if (owner) {
+    key = restHash((const char *) &owner, sizeof(owner), key);
+  }
+  bool found;
+  error_filter_slot_t *slot = find(key, owner, found);
+  if (found) {
+    // A repeat: only reported once the interval has passed
+    if (now - slot->printed < mInterval) {
+      ++slot->suppressed;
+      ++mSuppressed;
+      return false;
+    }
+    suppressed = slot->suppressed;
+    slot->suppressed = 0;
+    slot->printed = now;
     return true;
   }
-  return false;
+
+  if (slot->used) {
+    // The repeats of the error displaced are left for flush to report
+    mDisplaced += slot->suppressed;
+  } else {
+    slot->used = true;
+    ++mUsed;
+  }
+  slot->key = key;
+  slot->owner = owner;
+  slot->suppressed = 0;
+  slot->printed = now;
+  return true;
+}
+
+bool ErrorFilter::newError(std::string const & error)
+{
+  unsigned long suppressed;
+  return newError(restHash(error.data(), error.size()), suppressed);
+}
+
+unsigned long ErrorFilter::clearErrors()
+{
+  epicsGuard<epicsMutex> guard(mLock);
+  // Called after every successful request, usually with nothing to clear
+  if (!mUsed && !mDisplaced) {
+    return 0;
+  }
+  unsigned long suppressed = mDisplaced;
+  for (size_t i = 0; i <= mMask; ++i) {
+    if (mSlots[i].used) {
+      suppressed += mSlots[i].suppressed;
+    }
+    mSlots[i].used = false;
+  }
+  mUsed = 0;
+  mDisplaced = 0;
+  return suppressed;
+}
+
+unsigned long ErrorFilter::clearErrors(const void *owner)
+{
+  epicsGuard<epicsMutex> guard(mLock);
+  size_t i;
+  for (i = 0; mUsed && i <= mMask; ++i) {
+    if (mSlots[i].used && mSlots[i].owner == owner) {
+      break;
+    }
+  }
+  // Called after every successful fetch, usually with nothing to clear
+  if (!mUsed || i > mMask) {
+    return 0;
+  }
+
+  // The errors of other owners are inserted again, so that none is left
+  // behind a slot freed on its probe path
+  std::vector<error_filter_slot_t> kept;
+  unsigned long suppressed = 0;
+  for (i = 0; i <= mMask; ++i) {
+    if (!mSlots[i].used) {
+      continue;
+    }
+    if (mSlots[i].owner == owner) {
+      suppressed += mSlots[i].suppressed;
+    } else {
+      kept.push_back(mSlots[i]);
+    }
+    mSlots[i].used = false;
+  }
+  mUsed = kept.size();
+  for (std::vector<error_filter_slot_t>::iterator it = kept.begin(); it != kept.end(); ++it) {
+    bool found;
+    *find(it->key, it->owner, found) = *it;
+  }
+  return suppressed;
+}
+
+unsigned long ErrorFilter::flush()
+{
+  epicsGuard<epicsMutex> guard(mLock);
+  epicsUInt64 now = epicsMonotonicGet();
+  unsigned long suppressed = mDisplaced;
+  mDisplaced = 0;
+  for (size_t i = 0; mUsed && i <= mMask; ++i) {
+    error_filter_slot_t & slot = mSlots[i];
+    if (slot.used && slot.suppressed && now - slot.printed >= mInterval) {
+      suppressed += slot.suppressed;
+      slot.suppressed = 0;
+    }
+  }
+  return suppressed;
+}
+
+unsigned long ErrorFilter::getSuppressed()
+{
+  epicsGuard<epicsMutex> guard(mLock);
+  return mSuppressed;
+}
+
+epicsUInt32 ErrorFilter::key(const char *functionName, int line, int index)
+{
+  epicsUInt32 hash = restHash(functionName, strlen(functionName));
+  hash = restHash((const char *) &line, sizeof(line), hash);
+  return restHash((const char *) &index, sizeof(index), hash);
+}
+
+epicsUInt32 ErrorFilter::key(const char *functionName, int line, int index, size_t discriminator)
+{
+  epicsUInt32 hash = key(functionName, line, index);
+  return restHash((const char *) &discriminator, sizeof(discriminator), hash);
 }
 
-void ErrorFilter::clearErrors()
+epicsUInt32 ErrorFilter::key(const char *functionName, std::string const & error, int index)
 {
-  mErrors.clear();
+  epicsUInt32 hash = restHash(functionName, strlen(functionName));
+  hash = restHash(error.data(), error.size(), hash);
+  return restHash((const char *) &index, sizeof(index), hash);
 }
@@ -3,16 +3,71 @@
 
 #include <string>
 #include <vector>
+#include <stddef.h>
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
 
+// Keys remembered at once by default (rounded up to a power of 2)
+#define ERROR_FILTER_SLOTS 64
+// Seconds between reports of an error that keeps repeating
+#define ERROR_FILTER_INTERVAL 60.0
 
+// Decides which errors get printed. An error that keeps happening (on every
+// poll during a server outage, say) is printed the first time, then at most
+// once per interval along with the number of repeats suppressed meanwhile.
+// Errors are told apart by a key, kept in a fixed table: when it is full a
+// new key takes the place of an old one, whose next repeat is then new.
+// Several owners (the parameters of a set, say) can share a filter: their
+// errors are told apart and cleared separately.
 class ErrorFilter
 {
  public:
-  bool newError(std::string error);
-  void clearErrors();
+  ErrorFilter(double interval = ERROR_FILTER_INTERVAL, size_t slots = ERROR_FILTER_SLOTS);
+
+  // True if the error should be printed. suppressed is set to the number of
+  // repeats not printed since it last was
+  bool newError(epicsUInt32 key, unsigned long & suppressed, const void *owner = NULL);
+  // Keyed by the whole message
+  bool newError(std::string const & error);
+  // Forget every error, or every error of owner, e.g. once the connection
+  // works again. Returns the repeats suppressed since they were last
+  // reported, which would otherwise never be
+  unsigned long clearErrors();
+  unsigned long clearErrors(const void *owner);
+  // Take the repeats that would otherwise not be reported until the next
+  // clear: those of errors that stopped repeating within an interval of
+  // their last print, and of errors whose slot a new one took. Call
+  // periodically
+  unsigned long flush();
+  // Repeats suppressed since construction
+  unsigned long getSuppressed();
+
+  // Keys for the error raised at a line of a function (which can be
+  // checked before the message is formatted), optionally told apart from
+  // others raised there by a discriminator such as the length of a bad
+  // value, or for a message
+  static epicsUInt32 key(const char *functionName, int line, int index = -1);
+  static epicsUInt32 key(const char *functionName, int line, int index, size_t discriminator);
+  static epicsUInt32 key(const char *functionName, std::string const & error, int index = -1);
 
  private:
-  std::vector<std::string> mErrors;
+  typedef struct
+  {
+    bool used;
+    epicsUInt32 key;
+    const void *owner;
+    unsigned long suppressed;
+    epicsUInt64 printed;
+  } error_filter_slot_t;
+
+  std::vector<error_filter_slot_t> mSlots;
+  size_t mMask, mUsed;
+  epicsUInt64 mInterval;
+  unsigned long mSuppressed, mDisplaced;
+  epicsMutex mLock;
+
+  error_filter_slot_t *find(epicsUInt32 key, const void *owner, bool & found);
 };
 
 #endif
@@ -4,80 +4,63 @@
 
 // Simple key-value pairs
 JsonDict::JsonDict(const std::string& key, const char * value)
-    : mKey(toJson(key)), mValue(toJson(std::string(value))) {}
+    : mJson()
+{
+  write(key, value);
+}
 
 JsonDict::JsonDict(const std::string& key, bool value)
-    : mKey(toJson(key)), mValue(toJson(value)) {}
+    : mJson()
+{
+  write(key, value);
+}
 
 JsonDict::JsonDict(const std::string& key, int value)
-    : mKey(toJson(key)), mValue(toJson(value)) {}
+    : mJson()
+{
+  write(key, value);
+}
 
 JsonDict::JsonDict(const std::string& key, double value)
-    : mKey(toJson(key)), mValue(toJson(value)) {}
+    : mJson()
+{
+  write(key, value);
+}
 
 // Nest dictionary
 JsonDict::JsonDict(const std::string& key, JsonDict& dictValue)
-    : mKey(toJson(key)), mValue(dictValue.str()) {}
+    : mJson()
+{
+  JsonWriter writer(mJson);
+  writer.beginObject();
+  writer.key(key);
+  writer.rawValue(dictValue.mJson);
+  writer.endObject();
+}
 
-// Multiple key-value pairs
+// Multiple key-value pairs, merging the members of each dictionary
 JsonDict::JsonDict(std::vector<JsonDict>& values)
-    : mKey(), mValue()
+    : mJson()
 {
   if (values.empty()) {
     throw std::invalid_argument("Cannot create a JsonDict from an empty vector");
   }
-  std::stringstream dict;
+  size_t size = 0;
   std::vector<JsonDict>::iterator it;
   for (it = values.begin(); it != values.end(); it++) {
-    if (it->mKey.empty()) {
-      dict << it->mValue;
-    }
-    else {
-      dict << it->mKey << ": " << it->mValue;
-    }
-    if (it < values.end() - 1) {
-      dict << ", ";
-    }
+    size += it->mJson.size();
   }
+  mJson.reserve(size);
 
-  mValue = dict.str();
-}
-
-std::string JsonDict::str()
-{
-  std::stringstream dict;
-  if (mKey.empty()) {
-    dict << "{" << mValue << "}";
-  }
-  else {
-    dict << "{" << mKey << ": " << mValue << "}";
+  JsonWriter writer(mJson);
+  writer.beginObject();
+  for (it = values.begin(); it != values.end(); it++) {
+    writer.members(it->mJson);
   }
-
-  return dict.str();
+  writer.endObject();
 }
 
-std::string JsonDict::toJson(const std::string& value)
-{
-  std::stringstream v;
-  v << "\"" << value << "\"";
-  return v.str();
-}
-
-std::string JsonDict::toJson(bool value)
-{
-  return value ? "true" : "false";
-}
-
-std::string JsonDict::toJson(int value)
-{
-  std::stringstream v;
-  v << value;
-  return v.str();
-}
-
-std::string JsonDict::toJson(double value)
+std::string JsonDict::str()
 {
-  std::stringstream v;
-  v << value;
-  return v.str();
+  return mJson;
 }
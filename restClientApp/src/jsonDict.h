@@ -2,9 +2,12 @@
 #define RESTCLIENT_JSONDICT_H
 
 #include <string>
-#include <sstream>
 #include <vector>
 
+#include "jsonWriter.h"
+
+// A JSON object built up from key-value pairs. The text is written once,
+// through a JsonWriter, as the dictionary is constructed
 class JsonDict
 {
  public:
@@ -15,21 +18,19 @@ class JsonDict
   JsonDict(const std::string& key, int value);
   JsonDict(const std::string& key, double value);
   template <typename T> JsonDict(const std::string& key, std::vector<T> values)
-      : mKey(toJson(key)), mValue()
+      : mJson()
   {
-    std::stringstream list;
+    JsonWriter writer(mJson);
     typename std::vector<T>::iterator it;
 
-    list << "[";
+    writer.beginObject();
+    writer.key(key);
+    writer.beginArray();
     for (it = values.begin(); it != values.end(); it++) {
-      list << toJson(*it);
-      if (it < values.end() - 1) {
-        list << ", ";
-      }
+      writer.value(*it);
     }
-    list << "]";
-
-    mValue = list.str();
+    writer.endArray();
+    writer.endObject();
   }
   // A single key with an arbitrary dictionary for the value
   // {"key": {"subKey": "value"}}
@@ -41,13 +42,16 @@ class JsonDict
   std::string str();
 
  private:
-  std::string mKey;
-  std::string mValue;
+  std::string mJson;
 
-  std::string toJson(const std::string& value);
-  std::string toJson(bool value);
-  std::string toJson(int value);
-  std::string toJson(double value);
+  template <typename T> void write(const std::string& key, T value)
+  {
+    JsonWriter writer(mJson);
+    writer.beginObject();
+    writer.key(key);
+    writer.value(value);
+    writer.endObject();
+  }
 };
 
 #endif //RESTCLIENT_JSONDICT_H
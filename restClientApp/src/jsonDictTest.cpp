@@ -4,6 +4,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "jsonDict.h"
+#include "jsonWriter.h"
 
 
 BOOST_AUTO_TEST_SUITE(JsonDictUnitTests);
@@ -214,4 +215,91 @@ BOOST_AUTO_TEST_CASE(EmptyRaisesTest)
   BOOST_REQUIRE_THROW(JsonDict test = JsonDict(emptyVector), std::invalid_argument);
 }
 
+BOOST_AUTO_TEST_CASE(EscapeTest)
+{
+  JsonDict testDict = JsonDict("say \"hi\"", "C:\\dir\n\ttab\r\b\f");
+
+  BOOST_TEST_MESSAGE(testDict.str());
+  BOOST_CHECK_EQUAL(testDict.str(), "{\"say \\\"hi\\\"\": \"C:\\\\dir\\n\\ttab\\r\\b\\f\"}");
+
+  std::string control("\x01\x1f\x7f", 3);
+  std::vector<std::string> stringVector(1, control);
+  BOOST_CHECK_EQUAL(JsonDict("key", stringVector).str(), "{\"key\": [\"\\u0001\\u001f\x7f\"]}");
+
+  // Only the escaped characters change, UTF-8 passes straight through
+  BOOST_CHECK_EQUAL(JsonDict("key", "caf\xc3\xa9").str(), "{\"key\": \"caf\xc3\xa9\"}");
+}
+
+BOOST_AUTO_TEST_CASE(EscapeLongTest)
+{
+  // Escapes at every offset into, and across, 16 byte blocks
+  for (size_t length = 1; length < 40; ++length) {
+    for (size_t at = 0; at < length; ++at) {
+      std::string value(length, 'a');
+      value[at] = '"';
+      std::string expected(value.substr(0, at) + "\\\"" + value.substr(at + 1));
+      std::string json;
+      JsonWriter::escape(json, value.data(), value.size());
+      BOOST_REQUIRE_EQUAL(json, expected);
+    }
+  }
+
+  std::string json;
+  std::string value(33, '\\');
+  JsonWriter::escape(json, value.data(), value.size());
+  BOOST_CHECK_EQUAL(json, std::string(66, '\\'));
+}
+
+BOOST_AUTO_TEST_CASE(WriterTest)
+{
+  std::string json;
+  JsonWriter writer(json);
+  writer.beginObject();
+  writer.key("list");
+  writer.beginArray();
+  writer.value(1);
+  writer.beginArray();
+  writer.endArray();
+  writer.beginObject();
+  writer.key("a");
+  writer.value(false);
+  writer.endObject();
+  writer.endArray();
+  writer.key("empty");
+  writer.beginObject();
+  writer.endObject();
+  writer.key("raw");
+  writer.rawValue("null");
+  writer.key("escaped");
+  writer.beginArray();
+  writer.rawString("a\\\"b");
+  writer.rawString("", 0);
+  writer.endArray();
+  writer.members("{\"x\": 0.5, \"y\": \"z\"}");
+  writer.members("{}");
+  writer.endObject();
+
+  BOOST_CHECK_EQUAL(json, "{\"list\": [1, [], {\"a\": false}], \"empty\": {}, "
+                          "\"raw\": null, \"escaped\": [\"a\\\"b\", \"\"], "
+                          "\"x\": 0.5, \"y\": \"z\"}");
+
+  // Writing into a cleared buffer reuses its storage
+  const char *data = json.data();
+  json.clear();
+  JsonWriter again(json);
+  again.value("short");
+  BOOST_CHECK_EQUAL(json, "\"short\"");
+  BOOST_CHECK(json.data() == data);
+}
+
+BOOST_AUTO_TEST_CASE(WriterDepthTest)
+{
+  std::string json;
+  JsonWriter writer(json);
+  for (int i = 0; i < JSON_WRITER_MAX_DEPTH; ++i) {
+    writer.beginArray();
+  }
+  BOOST_CHECK_THROW(writer.beginArray(), std::length_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
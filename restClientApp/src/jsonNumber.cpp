@@ -0,0 +1,478 @@
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <limits.h>
+#include <math.h>
+#include <string>
+#include <epicsTypes.h>
+
+#include "jsonNumber.h"
+
+#define MAX_NUMBER_LENGTH 64
+
+// Digits of a double that can be multiplied or divided by a power of ten
+// exactly, and the largest such power (Clinger's fast path)
+#define EXACT_MANTISSA ((epicsUInt64) 1 << 53)
+#define MAX_EXACT_POWER 22
+
+static const double exactPowers[MAX_EXACT_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isSpace (char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool isDigit (char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+int parseNumber (const char *text, size_t len, int & value)
+{
+    const char *p = text, *end = text + len;
+    while(p != end && isSpace(*p))
+        ++p;
+
+    bool negative = false;
+    if(p != end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    const char *digits = p;
+    epicsInt64 result = 0;
+    for(; p != end && isDigit(*p); ++p)
+    {
+        if(result <= INT_MAX)
+            result = result * 10 + (*p - '0');
+    }
+    if(p == digits)
+        return EXIT_FAILURE;
+
+    if(negative)
+        result = -result;
+    value = result > INT_MAX ? INT_MAX : result < INT_MIN ? INT_MIN : (int) result;
+    return EXIT_SUCCESS;
+}
+
+// Anything the fast path doesn't take (long mantissas, large exponents, hex,
+// infinities...) goes to strtod, with '.' swapped for the decimal point of
+// the current locale
+static int parseDouble (const char *text, size_t len, double & value)
+{
+    char buffer[MAX_NUMBER_LENGTH];
+    std::string longText;
+    char *copy = buffer;
+    if(len >= MAX_NUMBER_LENGTH)
+    {
+        longText.assign(text, len);
+        copy = &longText[0];
+    }
+    else
+    {
+        memcpy(buffer, text, len);
+        buffer[len] = '\0';
+    }
+
+    char point = localeconv()->decimal_point[0];
+    if(point != '.')
+    {
+        char *dot = strchr(copy, '.');
+        if(dot)
+            *dot = point;
+    }
+
+    char *parsed;
+    double number = strtod(copy, &parsed);
+    if(parsed == copy)
+        return EXIT_FAILURE;
+
+    value = number;
+    return EXIT_SUCCESS;
+}
+
+int parseNumber (const char *text, size_t len, double & value)
+{
+    const char *p = text, *end = text + len;
+    while(p != end && isSpace(*p))
+        ++p;
+
+    bool negative = false;
+    if(p != end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // Up to 19 significant digits, leading zeros aside
+    epicsUInt64 mantissa = 0;
+    int significant = 0, exponent = 0, digits = 0;
+    for(; p != end && isDigit(*p); ++p, ++digits)
+    {
+        if(mantissa || *p != '0')
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            ++significant;
+        }
+    }
+    if(p != end && (*p == 'x' || *p == 'X'))
+        return parseDouble(text, len, value);
+
+    if(p != end && *p == '.')
+    {
+        for(++p; p != end && isDigit(*p); ++p, ++digits)
+        {
+            if(mantissa || *p != '0')
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                ++significant;
+            }
+            --exponent;
+        }
+    }
+    if(!digits || significant > 19)
+        return parseDouble(text, len, value);
+
+    // The exponent only counts if it has digits
+    if(p != end && (*p == 'e' || *p == 'E'))
+    {
+        const char *e = p + 1;
+        bool negativeExponent = false;
+        if(e != end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if(e != end && isDigit(*e))
+        {
+            int explicitExponent = 0;
+            for(; e != end && isDigit(*e); ++e)
+            {
+                if(explicitExponent < 100000)
+                    explicitExponent = explicitExponent * 10 + (*e - '0');
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+    }
+
+    double result;
+    if(mantissa == 0)
+        result = 0.0;
+    else if(mantissa <= EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER)
+        result = exponent < 0 ? (double) mantissa / exactPowers[-exponent]
+                              : (double) mantissa * exactPowers[exponent];
+    else
+        return parseDouble(text, len, value);
+
+    value = negative ? -result : result;
+    return EXIT_SUCCESS;
+}
+
+int parseNumber (std::string const & text, int & value)
+{
+    return parseNumber(text.c_str(), text.size(), value);
+}
+
+int parseNumber (std::string const & text, double & value)
+{
+    return parseNumber(text.c_str(), text.size(), value);
+}
+
+int parseJsonNumber (struct json_token const *token, int & value)
+{
+    return parseNumber(token->ptr, token->len, value);
+}
+
+int parseJsonNumber (struct json_token const *token, double & value)
+{
+    return parseNumber(token->ptr, token->len, value);
+}
+
+size_t formatNumber (int value, char *buffer)
+{
+    // Digits are written backwards from the end of a scratch buffer
+    char digits[16];
+    char *p = digits + sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+    do
+    {
+        *--p = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude);
+
+    size_t len = 0;
+    if(value < 0)
+        buffer[len++] = '-';
+    size_t count = digits + sizeof(digits) - p;
+    memcpy(buffer + len, p, count);
+    len += count;
+    buffer[len] = '\0';
+    return len;
+}
+
+// Grisu2 (Loitsch, "Printing floating-point numbers quickly and accurately
+// with integers"): the shortest digits, in almost every case, that read
+// back as the same double. A diy_fp_t is f * 2^e.
+typedef struct
+{
+    epicsUInt64 f;
+    int e;
+} diy_fp_t;
+
+#define DOUBLE_HIDDEN_BIT ((epicsUInt64) 1 << 52)
+#define DOUBLE_FRACTION_MASK (DOUBLE_HIDDEN_BIT - 1)
+
+// Normalized 10^k for k = -348, -340, ..., 340
+static const diy_fp_t cachedPowers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+    {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+    {0x8dd01fad907ffc3cULL, -980}, {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874}, {0x823c12795db6ce57ULL, -847},
+    {0xc21094364dfb5637ULL, -821}, {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715}, {0xb23867fb2a35b28eULL, -688},
+    {0x84c8d4dfd2c63f3bULL, -661}, {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555}, {0xf3e2f893dec3f126ULL, -529},
+    {0xb5b5ada8aaff80b8ULL, -502}, {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396}, {0xa6dfbd9fb8e5b88fULL, -369},
+    {0xf8a95fcf88747d94ULL, -343}, {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236}, {0xe45c10c42a2b3b06ULL, -210},
+    {0xaa242499697392d3ULL, -183}, {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77}, {0x9c40000000000000ULL, -50},
+    {0xe8d4a51000000000ULL, -24}, {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83}, {0xd5d238a4abe98068ULL, 109},
+    {0x9f4f2726179a2245ULL, 136}, {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242}, {0x924d692ca61be758ULL, 269},
+    {0xda01ee641a708deaULL, 295}, {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402}, {0xc83553c5c8965d3dULL, 428},
+    {0x952ab45cfa97a0b3ULL, 455}, {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561}, {0x88fcf317f22241e2ULL, 588},
+    {0xcc20ce9bd35c78a5ULL, 614}, {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720}, {0xbb764c4ca7a44410ULL, 747},
+    {0x8bab8eefb6409c1aULL, 774}, {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880}, {0x80444b5e7aa7cf85ULL, 907},
+    {0xbf21e44003acdd2dULL, 933}, {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039}, {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static diy_fp_t makeFp (epicsUInt64 f, int e)
+{
+    diy_fp_t fp;
+    fp.f = f;
+    fp.e = e;
+    return fp;
+}
+
+static diy_fp_t multiply (diy_fp_t x, diy_fp_t y)
+{
+    const epicsUInt64 mask = 0xffffffffu;
+    epicsUInt64 a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    epicsUInt64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    epicsUInt64 middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1u << 31);
+    return makeFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64);
+}
+
+static diy_fp_t normalize (diy_fp_t x)
+{
+    while(!(x.f & ((epicsUInt64) 1 << 63)))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// 10^-k such that a value of binary exponent e lands in [2^-60, 2^-32]
+static diy_fp_t cachedPower (int e, int & k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int) dk;
+    if(dk - ik > 0.0)
+        ik++;
+    unsigned int index = (unsigned int) ((ik >> 3) + 1);
+    k = -(-348 + (int) (index << 3));
+    return cachedPowers[index];
+}
+
+static void roundDigit (char *buffer, int len, epicsUInt64 delta, epicsUInt64 rest,
+                        epicsUInt64 tenKappa, epicsUInt64 distance)
+{
+    while(rest < distance && delta - rest >= tenKappa &&
+          (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+    {
+        buffer[len - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static void generateDigits (diy_fp_t w, diy_fp_t upper, epicsUInt64 delta,
+                            char *buffer, int & len, int & k)
+{
+    static const epicsUInt32 pow10[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    diy_fp_t one = makeFp((epicsUInt64) 1 << -upper.e, upper.e);
+    epicsUInt64 distance = upper.f - w.f;
+    epicsUInt32 integral = (epicsUInt32) (upper.f >> -one.e);
+    epicsUInt64 fraction = upper.f & (one.f - 1);
+
+    int kappa = 1;
+    while(kappa < 10 && integral >= pow10[kappa])
+        kappa++;
+
+    len = 0;
+    while(kappa > 0)
+    {
+        epicsUInt32 digit = integral / pow10[kappa - 1];
+        integral %= pow10[kappa - 1];
+        if(digit || len)
+            buffer[len++] = (char) ('0' + digit);
+        kappa--;
+        epicsUInt64 rest = ((epicsUInt64) integral << -one.e) + fraction;
+        if(rest <= delta)
+        {
+            k += kappa;
+            roundDigit(buffer, len, delta, rest, (epicsUInt64) pow10[kappa] << -one.e, distance);
+            return;
+        }
+    }
+
+    for(;;)
+    {
+        fraction *= 10;
+        delta *= 10;
+        char digit = (char) (fraction >> -one.e);
+        if(digit || len)
+            buffer[len++] = (char) ('0' + digit);
+        fraction &= one.f - 1;
+        kappa--;
+        if(fraction < delta)
+        {
+            k += kappa;
+            roundDigit(buffer, len, delta, fraction, one.f,
+                       -kappa < 10 ? distance * pow10[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+// Digits of a positive, finite, non-zero double: value = digits * 10^k
+static void grisu2 (double value, char *buffer, int & len, int & k)
+{
+    epicsUInt64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased = (int) ((bits >> 52) & 0x7ff);
+    diy_fp_t v = biased ? makeFp((bits & DOUBLE_FRACTION_MASK) | DOUBLE_HIDDEN_BIT, biased - 1075)
+                        : makeFp(bits & DOUBLE_FRACTION_MASK, -1074);
+
+    // Boundaries halfway to the neighbouring doubles, sharing an exponent
+    diy_fp_t plus = makeFp((v.f << 1) + 1, v.e - 1);
+    while(!(plus.f & (DOUBLE_HIDDEN_BIT << 1)))
+    {
+        plus.f <<= 1;
+        plus.e--;
+    }
+    plus.f <<= 64 - 52 - 2;
+    plus.e -= 64 - 52 - 2;
+    diy_fp_t minus = v.f == DOUBLE_HIDDEN_BIT ? makeFp((v.f << 2) - 1, v.e - 2)
+                                              : makeFp((v.f << 1) - 1, v.e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    diy_fp_t power = cachedPower(plus.e, k);
+    diy_fp_t w = multiply(normalize(v), power);
+    diy_fp_t upper = multiply(plus, power);
+    diy_fp_t lower = multiply(minus, power);
+    upper.f--;
+    lower.f++;
+    generateDigits(w, upper, upper.f - lower.f, buffer, len, k);
+}
+
+size_t formatNumber (double value, char *buffer)
+{
+    char *p = buffer;
+    if(signbit(value))
+    {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if(isnan(value) || isinf(value))
+    {
+        strcpy(p, isnan(value) ? "nan" : "inf");
+        return p + 3 - buffer;
+    }
+    if(value == 0.0)
+    {
+        strcpy(p, "0");
+        return p + 1 - buffer;
+    }
+
+    char digits[24];
+    int len, k;
+    grisu2(value, digits, len, k);
+
+    // Laid out as "%.20g" would, which is how doubles used to be formatted,
+    // so that large integers stay in full
+    int exponent = len + k - 1;
+    if(exponent < -4 || exponent >= 20)
+    {
+        *p++ = digits[0];
+        if(len > 1)
+        {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        *p++ = exponent < 0 ? '-' : '+';
+        int magnitude = exponent < 0 ? -exponent : exponent;
+        if(magnitude >= 100)
+            *p++ = (char) ('0' + magnitude / 100);
+        *p++ = (char) ('0' + magnitude / 10 % 10);
+        *p++ = (char) ('0' + magnitude % 10);
+    }
+    else if(k >= 0)
+    {
+        memcpy(p, digits, len);
+        p += len;
+        memset(p, '0', k);
+        p += k;
+    }
+    else if(len + k > 0)
+    {
+        memcpy(p, digits, len + k);
+        p += len + k;
+        *p++ = '.';
+        memcpy(p, digits + len + k, -k);
+        p += -k;
+    }
+    else
+    {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -(len + k));
+        p += -(len + k);
+        memcpy(p, digits, len);
+        p += len;
+    }
+    *p = '\0';
+    return p - buffer;
+}
+
+std::string formatNumber (int value)
+{
+    char buffer[JSON_NUMBER_SIZE];
+    return std::string(buffer, formatNumber(value, buffer));
+}
+
+std::string formatNumber (double value)
+{
+    char buffer[JSON_NUMBER_SIZE];
+    return std::string(buffer, formatNumber(value, buffer));
+}
+
+size_t jsonArraySize (struct json_token const *array)
+{
+    return array->type == JSON_TYPE_ARRAY ? (size_t) array->num_desc : 1;
+}
+
+struct json_token *jsonArrayElement (struct json_token *array, size_t index)
+{
+    return array->type == JSON_TYPE_ARRAY ? array + 1 + index : array;
+}
@@ -0,0 +1,42 @@
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+#include <stddef.h>
+#include <string>
+#include <frozen.h>
+
+// Enough for any int or double formatted by formatNumber, NUL included
+#define JSON_NUMBER_SIZE 32
+
+// Parse the number text starts with, as sscanf's "%d" or "%lf" would in the
+// "C" locale whatever the current one: leading whitespace is skipped,
+// trailing characters are ignored and out of range integers are clamped.
+// Plain decimal doubles are converted without strtod when that is exact.
+// Returns EXIT_SUCCESS or EXIT_FAILURE if text does not start with a number.
+int parseNumber (const char *text, size_t len, int & value);
+int parseNumber (const char *text, size_t len, double & value);
+int parseNumber (std::string const & text, int & value);
+int parseNumber (std::string const & text, double & value);
+
+// The same, straight from a token of the document
+int parseJsonNumber (struct json_token const *token, int & value);
+int parseJsonNumber (struct json_token const *token, double & value);
+
+// Format a number independently of the locale. Doubles get the fewest
+// digits that read back as the same value (Grisu2, shortest in all but a
+// few cases), laid out like "%.20g"; NaN and infinities as "nan" and "inf".
+// The buffer versions write a NUL terminated string of at most
+// JSON_NUMBER_SIZE characters and return its length.
+size_t formatNumber (int value, char *buffer);
+size_t formatNumber (double value, char *buffer);
+std::string formatNumber (int value);
+std::string formatNumber (double value);
+
+// Number of values in an array token, as flattened by frozen (every
+// descendant token). Any other token is a single value
+size_t jsonArraySize (struct json_token const *array);
+
+// Value at index in an array token. Any other token is its own element 0
+struct json_token *jsonArrayElement (struct json_token *array, size_t index);
+
+#endif
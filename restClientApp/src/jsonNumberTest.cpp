@@ -0,0 +1,175 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <clocale>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+
+#include "jsonTokenArena.h"
+#include "jsonNumber.h"
+
+
+// Deterministic pseudo random doubles, any bit pattern but NaN
+static double randomDouble (unsigned long long & seed)
+{
+  double value;
+  do {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    memcpy(&value, &seed, sizeof(value));
+  } while (value != value);
+  return value;
+}
+
+// How RestParam::toString formatted doubles before formatNumber
+static std::string streamFormat (double value)
+{
+  std::ostringstream os;
+  os << std::setprecision(std::numeric_limits<long double>::digits10 + 2) << value;
+  return os.str();
+}
+
+BOOST_AUTO_TEST_SUITE(JsonNumberUnitTests);
+
+// Every element decodes as sscanf decodes its text
+BOOST_AUTO_TEST_CASE(SameAsSscanfTest)
+{
+  std::string document =
+      "[0, -0, 7, -42, 123456789, -123456789, 1234567890, 2147483647, -2147483648,"
+      " 1.5, -2.75, 1e3, 1E-3, -0.5e10, 6.02214076e23, 4.9e-324, 0.1, 0.30000000000000004,"
+      " 12345678901234567890, 1.00000000000000000000000000000000000000000000000000000000000000001,"
+      " \"12\", \"x\", true, false, \"\", \" 3\", \"+4\", \"-\"]";
+
+  JsonTokenArena arena;
+  BOOST_REQUIRE(arena.parse(document) > 0);
+  struct json_token *array = arena.getTokens();
+  BOOST_REQUIRE_EQUAL(jsonArraySize(array), 28u);
+
+  for (size_t i = 0; i < jsonArraySize(array); ++i) {
+    struct json_token *token = jsonArrayElement(array, i);
+    std::string text(token->ptr, token->len);
+    BOOST_TEST_MESSAGE(text);
+
+    double expectedDouble = 0.0, actualDouble = 0.0;
+    bool doubleParsed = sscanf(text.c_str(), "%lf", &expectedDouble) == 1;
+    BOOST_CHECK_EQUAL(parseJsonNumber(token, actualDouble), doubleParsed ? EXIT_SUCCESS : EXIT_FAILURE);
+    if (doubleParsed) {
+      BOOST_CHECK_EQUAL(actualDouble, expectedDouble);
+    }
+
+    long expectedLong = 0;
+    int actualInt = 0;
+    bool intParsed = sscanf(text.c_str(), "%ld", &expectedLong) == 1;
+    BOOST_CHECK_EQUAL(parseJsonNumber(token, actualInt), intParsed ? EXIT_SUCCESS : EXIT_FAILURE);
+    if (intParsed && expectedLong >= INT_MIN && expectedLong <= INT_MAX) {
+      BOOST_CHECK_EQUAL(actualInt, (int) expectedLong);
+    }
+  }
+};
+
+BOOST_AUTO_TEST_CASE(OutOfRangeTest)
+{
+  JsonTokenArena arena;
+  BOOST_REQUIRE(arena.parse("[99999999999, -99999999999, 5]", 30) > 0);
+
+  int value;
+  BOOST_CHECK_EQUAL(parseJsonNumber(jsonArrayElement(arena.getTokens(), 0), value), EXIT_SUCCESS);
+  BOOST_CHECK_EQUAL(value, INT_MAX);
+  BOOST_CHECK_EQUAL(parseJsonNumber(jsonArrayElement(arena.getTokens(), 1), value), EXIT_SUCCESS);
+  BOOST_CHECK_EQUAL(value, INT_MIN);
+
+  // A scalar is its own only element
+  struct json_token *scalar = jsonArrayElement(arena.getTokens(), 2);
+  BOOST_CHECK_EQUAL(jsonArraySize(scalar), 1u);
+  BOOST_CHECK_EQUAL(jsonArrayElement(scalar, 0), scalar);
+};
+
+BOOST_AUTO_TEST_CASE(FormatTest)
+{
+  const int ints[] = {0, 1, -1, 9, 10, 42, -500, 123456789, INT_MAX, INT_MIN};
+  for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+    std::ostringstream os;
+    os << ints[i];
+    BOOST_CHECK_EQUAL(formatNumber(ints[i]), os.str());
+  }
+
+  BOOST_CHECK_EQUAL(formatNumber(0.0), "0");
+  BOOST_CHECK_EQUAL(formatNumber(-0.0), "-0");
+  BOOST_CHECK_EQUAL(formatNumber(0.1), "0.1");
+  BOOST_CHECK_EQUAL(formatNumber(-2.5), "-2.5");
+  BOOST_CHECK_EQUAL(formatNumber(100.0), "100");
+  BOOST_CHECK_EQUAL(formatNumber(1e16), "10000000000000000");
+  BOOST_CHECK_EQUAL(formatNumber(1e17), "100000000000000000");
+  BOOST_CHECK_EQUAL(formatNumber(1e20), "1e+20");
+  BOOST_CHECK_EQUAL(formatNumber(1e-4), "0.0001");
+  BOOST_CHECK_EQUAL(formatNumber(1.5e-5), "1.5e-05");
+  BOOST_CHECK_EQUAL(formatNumber(5e-324), "5e-324");
+  BOOST_CHECK_EQUAL(formatNumber(1.7976931348623157e308), "1.7976931348623157e+308");
+  BOOST_CHECK_EQUAL(formatNumber(std::numeric_limits<double>::infinity()), "inf");
+  BOOST_CHECK_EQUAL(formatNumber(-std::numeric_limits<double>::infinity()), "-inf");
+  BOOST_CHECK_EQUAL(formatNumber(std::numeric_limits<double>::quiet_NaN()), "nan");
+};
+
+// Against the previous formatting: the same value, never longer, and the
+// same text whenever that was already the shortest
+BOOST_AUTO_TEST_CASE(FormatDifferentialTest)
+{
+  unsigned long long seed = 88172645463325252ULL;
+  int longer = 0;
+  for (int i = 0; i < 200000; ++i) {
+    double value = i % 2 ? randomDouble(seed) : (double) (seed % 2000001) / 1000.0 - 1000.0;
+    std::string formatted = formatNumber(value), previous = streamFormat(value);
+
+    double readBack = strtod(formatted.c_str(), NULL);
+    BOOST_REQUIRE_MESSAGE(!memcmp(&readBack, &value, sizeof(value)), formatted << " != " << previous);
+    longer += formatted.size() > previous.size();
+
+    if (previous.size() <= 15 && strtod(previous.c_str(), NULL) == value &&
+        previous.find('e') == std::string::npos) {
+      BOOST_CHECK_EQUAL(formatted, previous);
+    }
+  }
+  BOOST_CHECK_EQUAL(longer, 0);
+};
+
+// Against sscanf on the output of printf at every precision
+BOOST_AUTO_TEST_CASE(ParseDifferentialTest)
+{
+  unsigned long long seed = 1;
+  char text[64];
+  for (int i = 0; i < 200000; ++i) {
+    double value = randomDouble(seed);
+    sprintf(text, i % 3 ? "%.*g" : "%.*e", (int) (seed % 20) + 1, value);
+
+    double expected, actual;
+    BOOST_REQUIRE_EQUAL(sscanf(text, "%lf", &expected), 1);
+    BOOST_REQUIRE_EQUAL(parseNumber(text, strlen(text), actual), EXIT_SUCCESS);
+    BOOST_REQUIRE_MESSAGE(!memcmp(&actual, &expected, sizeof(actual)), text);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(LocaleTest)
+{
+  // Only where a locale with a decimal comma is installed
+  if (!setlocale(LC_NUMERIC, "de_DE.UTF-8") && !setlocale(LC_NUMERIC, "fr_FR.UTF-8")) {
+    return;
+  }
+
+  double value = 0.0;
+  BOOST_CHECK_EQUAL(parseNumber(std::string("2.5"), value), EXIT_SUCCESS);
+  BOOST_CHECK_EQUAL(value, 2.5);
+  // Too many digits for the fast path
+  BOOST_CHECK_EQUAL(parseNumber(std::string("1.23456789012345678901"), value), EXIT_SUCCESS);
+  BOOST_CHECK_EQUAL(value, 1.23456789012345678901);
+  BOOST_CHECK_EQUAL(formatNumber(2.5), "2.5");
+  setlocale(LC_NUMERIC, "C");
+};
+
+BOOST_AUTO_TEST_SUITE_END();
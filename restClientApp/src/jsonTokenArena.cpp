@@ -0,0 +1,240 @@
+#include "jsonTokenArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "restHash.h"
+
+#define MIN_INDEXED_TOKENS 64
+
+JsonTokenArena::JsonTokenArena (size_t capacity)
+    : mTokens(NULL), mCapacity(0), mAllocations(0), mTokenizer(), mStream(NULL), mParsed(false), mIndexed(false),
+      mKeys(), mSlots(), mObjects()
+{
+    reserve(capacity);
+}
+
+JsonTokenArena::~JsonTokenArena ()
+{
+    delete[] mTokens;
+}
+
+int JsonTokenArena::parse (std::string const & json)
+{
+    return parse(json.c_str(), json.size());
+}
+
+int JsonTokenArena::parse (const char *json, size_t len)
+{
+    int needed;
+    int err = mTokenizer.parse(json, (int) len, mTokens, (int) mCapacity, needed);
+
+    // The tokenizer reports how many tokens a valid document needs. Otherwise
+    // double: every token but the terminating one takes at least a character,
+    // so len + 1 tokens always suffice and the loop ends
+    while(err == JSON_TOKEN_ARRAY_TOO_SMALL && mCapacity <= len)
+    {
+        if(needed)
+            reserve(needed);
+        else
+            reserve(std::min(std::max(2 * mCapacity, (size_t) DEFAULT_JSON_TOKENS), len + 1));
+        err = mTokenizer.parse(json, (int) len, mTokens, (int) mCapacity, needed);
+    }
+
+    mParsed = err >= 0;
+    mIndexed = false;
+    return err;
+}
+
+void JsonTokenArena::begin (const char *json)
+{
+    mStream = json;
+    mParsed = false;
+    mIndexed = false;
+    mTokenizer.begin(json, mTokens, (int) mCapacity);
+}
+
+void JsonTokenArena::feed (size_t available)
+{
+    mTokenizer.feed((int) available);
+}
+
+int JsonTokenArena::end (size_t len)
+{
+    int needed;
+    int err = mTokenizer.finish((int) len, needed);
+
+    // Too many tokens: grow and start over with the whole document
+    if(err == JSON_TOKEN_ARRAY_TOO_SMALL && mCapacity <= len)
+    {
+        if(needed)
+            reserve(needed);
+        return parse(mStream, len);
+    }
+
+    mParsed = err >= 0;
+    mIndexed = false;
+    return err;
+}
+
+struct json_token *JsonTokenArena::getTokens (void)
+{
+    return mTokens;
+}
+
+size_t JsonTokenArena::getCapacity (void)
+{
+    return mCapacity;
+}
+
+void JsonTokenArena::reserve (size_t capacity)
+{
+    if(capacity <= mCapacity)
+        return;
+
+    delete[] mTokens;
+    mTokens = new struct json_token[capacity];
+    mCapacity = capacity;
+    ++mAllocations;
+}
+
+struct json_token *JsonTokenArena::find (std::string const & path)
+{
+    return find(path.c_str());
+}
+
+struct json_token *JsonTokenArena::find (const char *path)
+{
+    // Small documents are quicker to search than to index
+    size_t len = strlen(path);
+    if(!len || !mParsed || mTokens[0].num_desc < MIN_INDEXED_TOKENS || strchr(path, '[') ||
+       path[0] == '.' || path[len - 1] == '.' || strstr(path, ".."))
+        return find_json_token(mTokens, path);
+
+    if(!mIndexed)
+        buildIndex();
+    if(mSlots.empty())
+        return NULL;
+
+    size_t mask = mSlots.size() - 1;
+    for(size_t slot = restHash(path, len) & mask; mSlots[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        if(keyMatches(mSlots[slot], path, len))
+            return &mTokens[mKeys[mSlots[slot]].token + 1];
+    }
+    return NULL;
+}
+
+// Index every path find_json_token can reach without array subscripts, i.e.
+// the keys of the root object and of the objects nested in it. Keys with a
+// '.' or '[' in them can't be named by a path and are left out
+void JsonTokenArena::buildIndex (void)
+{
+    mIndexed = true;
+    mKeys.clear();
+    mSlots.clear();
+    if(mTokens[0].type != JSON_TYPE_OBJECT)
+        return;
+
+    // Pairs of (object token, key of the object)
+    mObjects.clear();
+    mObjects.push_back(0);
+    mObjects.push_back(-1);
+    while(!mObjects.empty())
+    {
+        int parent = mObjects.back();
+        mObjects.pop_back();
+        int object = mObjects.back();
+        mObjects.pop_back();
+        epicsUInt32 hash = REST_HASH_SEED;
+        if(parent >= 0)
+            hash = restHash(".", 1, mKeys[parent].hash);
+
+        int end = object + mTokens[object].num_desc;
+        for(int token = object + 1; token < end; token += 2 + mTokens[token + 1].num_desc)
+        {
+            struct json_token *key = &mTokens[token];
+            if(memchr(key->ptr, '.', key->len) || memchr(key->ptr, '[', key->len))
+                continue;
+
+            json_key_t entry = {token, parent, restHash(key->ptr, key->len, hash)};
+            mKeys.push_back(entry);
+            if(mTokens[token + 1].type == JSON_TYPE_OBJECT)
+            {
+                mObjects.push_back(token + 1);
+                mObjects.push_back((int) mKeys.size() - 1);
+            }
+        }
+    }
+
+    size_t slots = 16;
+    while(slots < 2 * mKeys.size())
+        slots *= 2;
+    mSlots.assign(slots, -1);
+    for(size_t key = 0; key < mKeys.size(); ++key)
+        insertKey((int) key);
+}
+
+void JsonTokenArena::insertKey (int key)
+{
+    size_t mask = mSlots.size() - 1;
+    size_t slot = mKeys[key].hash & mask;
+    for(; mSlots[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        // Duplicate keys: find_json_token returns the first in the document
+        if(sameKey(mSlots[slot], key))
+        {
+            if(mKeys[key].token < mKeys[mSlots[slot]].token)
+                mSlots[slot] = key;
+            return;
+        }
+    }
+    mSlots[slot] = key;
+}
+
+// Whether the key's full path, walking up through its parents, is path
+bool JsonTokenArena::keyMatches (int key, const char *path, size_t len)
+{
+    for(;;)
+    {
+        struct json_token *token = &mTokens[mKeys[key].token];
+        size_t keyLen = token->len;
+        int parent = mKeys[key].parent;
+
+        if(parent < 0)
+            return len == keyLen && !memcmp(path, token->ptr, keyLen);
+
+        if(len <= keyLen + 1 || path[len - keyLen - 1] != '.' ||
+           memcmp(path + len - keyLen, token->ptr, keyLen))
+            return false;
+
+        len -= keyLen + 1;
+        key = parent;
+    }
+}
+
+bool JsonTokenArena::sameKey (int key, int other)
+{
+    for(;;)
+    {
+        if(key == other)
+            return true;
+        if(mKeys[key].hash != mKeys[other].hash)
+            return false;
+
+        struct json_token *a = &mTokens[mKeys[key].token];
+        struct json_token *b = &mTokens[mKeys[other].token];
+        if(a->len != b->len || memcmp(a->ptr, b->ptr, a->len))
+            return false;
+
+        key = mKeys[key].parent;
+        other = mKeys[other].parent;
+        if(key < 0 || other < 0)
+            return key == other;
+    }
+}
+
+unsigned long JsonTokenArena::getAllocations (void)
+{
+    return mAllocations;
+}
@@ -0,0 +1,78 @@
+#ifndef JSON_TOKEN_ARENA_H
+#define JSON_TOKEN_ARENA_H
+
+#include <string>
+#include <vector>
+#include <epicsTypes.h>
+#include <frozen.h>
+
+#include "jsonTokenizer.h"
+
+#define DEFAULT_JSON_TOKENS 200
+
+// A key of an object in the parsed document, found at mTokens[token] with
+// its value right after. parent is the key of the enclosing object, if any
+typedef struct
+{
+    int token;
+    int parent;
+    epicsUInt32 hash;
+} json_key_t;
+
+// Token storage for JsonTokenizer (frozen's token layout), kept and reused
+// from one document to the next instead of being allocated for each. It only ever grows, on
+// demand when a document has more tokens than the current capacity.
+// Not thread safe: each RestParamSet owns one, used under the port lock.
+class JsonTokenArena
+{
+public:
+    JsonTokenArena (size_t capacity = DEFAULT_JSON_TOKENS);
+    ~JsonTokenArena ();
+
+    // Tokenize a document, growing the arena as needed. Returns the number of
+    // characters parsed or one of frozen's (negative) error codes, as
+    // parse_json does. Tokens are valid until the next parse.
+    int parse (std::string const & json);
+    int parse (const char *json, size_t len);
+
+    // Tokenize a document while it is received into a buffer that does not
+    // move (see JsonTokenizer::begin): end returns what parse would
+    void begin (const char *json);
+    void feed (size_t available);
+    int end (size_t len);
+
+    struct json_token *getTokens (void);
+    size_t getCapacity (void);
+    void reserve (size_t capacity);
+
+    // Same result as find_json_token on the parsed document. In documents
+    // of more than a few tokens, dotted paths of object keys are looked up in
+    // a hash index of every such path, built the first time it is needed for
+    // each document; paths with array subscripts use find_json_token.
+    struct json_token *find (std::string const & path);
+    struct json_token *find (const char *path);
+
+    // Number of times the token storage has been allocated
+    unsigned long getAllocations (void);
+
+private:
+    struct json_token *mTokens;
+    size_t mCapacity;
+    unsigned long mAllocations;
+    JsonTokenizer mTokenizer;
+    const char *mStream;
+
+    bool mParsed, mIndexed;
+    std::vector<json_key_t> mKeys;
+    std::vector<int> mSlots, mObjects;
+
+    void buildIndex (void);
+    void insertKey (int key);
+    bool keyMatches (int key, const char *path, size_t len);
+    bool sameKey (int key, int other);
+
+    JsonTokenArena (JsonTokenArena const &);
+    JsonTokenArena & operator= (JsonTokenArena const &);
+};
+
+#endif
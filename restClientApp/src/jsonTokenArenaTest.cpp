@@ -0,0 +1,58 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "jsonTokenArena.h"
+
+
+BOOST_AUTO_TEST_SUITE(JsonTokenArenaUnitTests);
+
+BOOST_AUTO_TEST_CASE(GrowTest)
+{
+  std::string document = "[0";
+  for (int i = 1; i < 5000; ++i) {
+    document += ", 1";
+  }
+  document += "]";
+
+  JsonTokenArena arena(16);
+  BOOST_CHECK(arena.parse(document) > 0);
+  BOOST_CHECK_EQUAL(arena.getTokens()[0].num_desc, 5000);
+
+  unsigned long allocations = arena.getAllocations();
+  BOOST_CHECK(arena.parse(document) > 0);
+  BOOST_CHECK_EQUAL(arena.getAllocations(), allocations);
+};
+
+BOOST_AUTO_TEST_CASE(FindTest)
+{
+  // Padded to be large enough to be indexed
+  std::string document =
+      "{\"value\": 3, \"type\": \"int\", \"allowed_values\": [1, {\"a\": 2}],"
+      " \"detector\": {\"config\": {\"value\": 4, \"x.y\": 5}, \"status\": {}},"
+      " \"value\": 6, \"x.y\": 7, \"x\": {\"y\": 8}, \"empty\": \"\", \"padding\": [";
+  for (int i = 0; i < 100; ++i) {
+    document += i ? ", 0" : "0";
+  }
+  document += "]}";
+  const char *paths[] = {
+      "", "value", "type", "allowed_values", "allowed_values[1]", "allowed_values[1].a",
+      "detector", "detector.config", "detector.config.value", "detector.config.x.y",
+      "detector.status", "detector.status.value", "x.y", "x", "empty", "missing",
+      "value.missing", "detector.", ".value", "detector..config", "detecto", "config", "padding"
+  };
+
+  JsonTokenArena arena;
+  BOOST_REQUIRE(arena.parse(document) > 0);
+
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    BOOST_TEST_MESSAGE(paths[i]);
+    BOOST_CHECK_EQUAL(arena.find(paths[i]), find_json_token(arena.getTokens(), paths[i]));
+  }
+
+  // The index is rebuilt for each document
+  BOOST_REQUIRE(arena.parse("[1, 2]", 6) > 0);
+  BOOST_CHECK(arena.find("value") == NULL);
+  BOOST_CHECK_EQUAL(arena.find("[1]"), arena.getTokens() + 2);
+};
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,525 @@
+#include "jsonTokenizer.h"
+
+#include <cstring>
+#include <epicsTypes.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define JSON_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define BLOCK_SIZE      64
+#define JSON_FALLBACK   (-100)  // Not a frozen error code: hand over to parse_json
+
+// One bit per byte of a 64 byte block
+typedef struct
+{
+    epicsUInt64 quote, backslash, op, space, control, high;
+} json_block_t;
+
+typedef void (*classify_fn)(const char *block, json_block_t *masks);
+
+typedef enum
+{
+    S_ROOT,
+    S_VALUE,
+    S_VALUE_OR_CLOSE,
+    S_KEY,
+    S_KEY_OR_CLOSE,
+    S_COLON,
+    S_COMMA_OR_CLOSE,
+    S_STRING,
+    S_KEY_STRING
+} json_state_t;
+
+#ifndef JSON_SSE2
+static void classifyScalar (const char *block, json_block_t *masks)
+{
+    memset(masks, 0, sizeof(*masks));
+    for(int i = 0; i < BLOCK_SIZE; ++i)
+    {
+        unsigned char c = block[i];
+        epicsUInt64 bit = (epicsUInt64) 1 << i;
+        switch(c)
+        {
+        case '"':  masks->quote |= bit;     break;
+        case '\\': masks->backslash |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',':
+            masks->op |= bit;
+            break;
+        case ' ': case '\t': case '\n': case '\r':
+            masks->space |= bit;
+            break;
+        }
+        if(c < 0x20)
+            masks->control |= bit;
+        else if(c >= 0x80)
+            masks->high |= bit;
+    }
+}
+#endif
+
+#ifdef JSON_SSE2
+static void classifySse2 (const char *block, json_block_t *masks)
+{
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20), open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}'), colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(','), tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+
+    memset(masks, 0, sizeof(*masks));
+    for(int i = 0; i < BLOCK_SIZE; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (block + i));
+        // '[' and ']' are '{' and '}' without the 0x20 bit
+        __m128i folded = _mm_or_si128(v, lower);
+        __m128i op = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        __m128i space = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, lower), _mm_cmpeq_epi8(v, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr)));
+        // Signed compare: below 0x20 or at least 0x80
+        epicsUInt64 high = (unsigned) _mm_movemask_epi8(v);
+        epicsUInt64 low = (unsigned) _mm_movemask_epi8(_mm_cmplt_epi8(v, lower));
+
+        masks->quote |= (epicsUInt64) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+        masks->backslash |= (epicsUInt64) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << i;
+        masks->op |= (epicsUInt64) (unsigned) _mm_movemask_epi8(op) << i;
+        masks->space |= (epicsUInt64) (unsigned) _mm_movemask_epi8(space) << i;
+        masks->control |= (low & ~high) << i;
+        masks->high |= high << i;
+    }
+}
+#endif
+
+#ifdef JSON_AVX2
+__attribute__((target("avx2")))
+static void classifyAvx2 (const char *block, json_block_t *masks)
+{
+    const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20), open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}'), colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(','), tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+
+    memset(masks, 0, sizeof(*masks));
+    for(int i = 0; i < BLOCK_SIZE; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (block + i));
+        __m256i folded = _mm256_or_si256(v, lower);
+        __m256i op = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        __m256i space = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, lower), _mm256_cmpeq_epi8(v, tab)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, cr)));
+        epicsUInt64 high = (unsigned) _mm256_movemask_epi8(v);
+        epicsUInt64 low = (unsigned) _mm256_movemask_epi8(_mm256_cmpgt_epi8(lower, v));
+
+        masks->quote |= (epicsUInt64) (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << i;
+        masks->backslash |= (epicsUInt64) (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << i;
+        masks->op |= (epicsUInt64) (unsigned) _mm256_movemask_epi8(op) << i;
+        masks->space |= (epicsUInt64) (unsigned) _mm256_movemask_epi8(space) << i;
+        masks->control |= (low & ~high) << i;
+        masks->high |= high << i;
+    }
+}
+#endif
+
+static classify_fn selectClassifier (void)
+{
+#ifdef JSON_AVX2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return classifyAvx2;
+#endif
+#ifdef JSON_SSE2
+    return classifySse2;
+#else
+    return classifyScalar;
+#endif
+}
+
+static const classify_fn classifyBlock = selectClassifier();
+
+static inline int trailingZeros (epicsUInt64 x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int) index;
+#else
+    int n = 0;
+    while(!(x & 1))
+    {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Bit i set when an odd number of bits at or below i are set
+static inline epicsUInt64 prefixXor (epicsUInt64 x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static inline bool isDigit (char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Length of the number or literal starting at json[pos], the way frozen
+// reads it, or -1 if it isn't followed by whitespace or a delimiter
+static int scanScalar (const char *json, int pos, int len, enum json_type & type)
+{
+    static const char *literals[] = {"true", "false", "null"};
+    static const enum json_type literalTypes[] = {JSON_TYPE_TRUE, JSON_TYPE_FALSE, JSON_TYPE_NULL};
+    int end = pos;
+
+    if(json[pos] == '-' || isDigit(json[pos]))
+    {
+        type = JSON_TYPE_NUMBER;
+        if(json[end] == '-')
+            ++end;
+        if(end >= len || !isDigit(json[end]))
+            return -1;
+        while(end < len && isDigit(json[end]))
+            ++end;
+        if(end < len && json[end] == '.')
+        {
+            if(++end >= len || !isDigit(json[end]))
+                return -1;
+            while(end < len && isDigit(json[end]))
+                ++end;
+        }
+        if(end < len && (json[end] == 'e' || json[end] == 'E'))
+        {
+            if(++end < len && (json[end] == '+' || json[end] == '-'))
+                ++end;
+            if(end >= len || !isDigit(json[end]))
+                return -1;
+            while(end < len && isDigit(json[end]))
+                ++end;
+        }
+    }
+    else
+    {
+        int i;
+        for(i = 0; i < 3; ++i)
+        {
+            int n = (int) strlen(literals[i]);
+            if(len - pos >= n && !memcmp(json + pos, literals[i], n))
+                break;
+        }
+        if(i == 3)
+            return -1;
+        type = literalTypes[i];
+        end += (int) strlen(literals[i]);
+    }
+
+    if(end >= len)
+        return -1;
+    switch(json[end])
+    {
+    case ' ': case '\t': case '\n': case '\r': case ',': case ']': case '}':
+        return end - pos;
+    default:
+        return -1;
+    }
+}
+
+// Whether every escape sequence in a string is one frozen accepts
+static bool validEscapes (const char *str, int len)
+{
+    for(int i = 0; i < len; ++i)
+    {
+        if(str[i] != '\\')
+            continue;
+        if(++i >= len)
+            return false;
+        switch(str[i])
+        {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            break;
+        case 'u':
+            for(int digit = 0; digit < 4; ++digit)
+            {
+                char c = ++i < len ? str[i] : 0;
+                if(!isDigit(c) && !(c >= 'a' && c <= 'f') && !(c >= 'A' && c <= 'F'))
+                    return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline void emit (struct json_token *tokens, int capacity, int & count,
+                         const char *ptr, enum json_type type)
+{
+    if(count < capacity)
+    {
+        tokens[count].ptr = ptr;
+        tokens[count].len = 0;
+        tokens[count].num_desc = 0;
+        tokens[count].type = type;
+    }
+    ++count;
+}
+
+JsonTokenizer::JsonTokenizer ()
+    : mStack(), mFallbacks(0), mJson(NULL), mTokens(NULL), mCapacity(0), mBase(0),
+      mResult(0), mNeeded(0), mState(S_ROOT), mCount(0), mStringToken(0),
+      mStringStart(0), mEscapes(false), mEscapeCarry(false), mInStringCarry(0),
+      mScalarCarry(0)
+{}
+
+int JsonTokenizer::parse (const char *json, int len, struct json_token *tokens,
+                          int capacity, int & needed)
+{
+    begin(json, tokens, capacity);
+    return finish(len, needed);
+}
+
+void JsonTokenizer::begin (const char *json, struct json_token *tokens, int capacity)
+{
+    mJson = json;
+    mTokens = tokens;
+    mCapacity = capacity;
+    mBase = 0;
+    mResult = 0;
+    mNeeded = 0;
+    mState = S_ROOT;
+    mCount = 0;
+    mStringToken = 0;
+    mStringStart = 0;
+    mEscapes = false;
+    mEscapeCarry = false;
+    mInStringCarry = 0;
+    mScalarCarry = 0;
+    mStack.clear();
+}
+
+void JsonTokenizer::feed (int available)
+{
+    if(!mResult && mJson && mTokens && mCapacity > 0)
+        mResult = tokenize(available, false);
+}
+
+int JsonTokenizer::finish (int len, int & needed)
+{
+    needed = 0;
+
+    // frozen only validates when it has nowhere to store tokens
+    if(!mJson || len <= 0 || !mTokens || mCapacity <= 0)
+        return parse_json(mJson, len, mTokens, mCapacity);
+
+    if(!mResult)
+        mResult = tokenize(len, true);
+    // Incomplete document
+    if(!mResult)
+        mResult = JSON_FALLBACK;
+
+    int result = mResult;
+    if(result == JSON_FALLBACK)
+    {
+        ++mFallbacks;
+        result = parse_json(mJson, len, mTokens, mCapacity);
+    }
+    else
+        needed = mNeeded;
+    return result;
+}
+
+unsigned long JsonTokenizer::getFallbacks (void)
+{
+    return mFallbacks;
+}
+
+// Tokenize the blocks of json[0, len). Unless the document is complete, a
+// block is only tokenized once the next one is available too, so that the
+// numbers and literals it starts end before len. Returns what parse returns
+// once the root value is closed or the document is found to need parse_json,
+// 0 while it needs more data.
+int JsonTokenizer::tokenize (int len, bool complete)
+{
+    const char *json = mJson;
+    struct json_token *tokens = mTokens;
+    int capacity = mCapacity;
+    char tail[BLOCK_SIZE];
+
+    for(; mBase < len && (complete || mBase + 2 * BLOCK_SIZE <= len); mBase += BLOCK_SIZE)
+    {
+        int base = mBase;
+        const char *block = json + base;
+        if(len - base < BLOCK_SIZE)
+        {
+            memset(tail, ' ', BLOCK_SIZE);
+            memcpy(tail, block, len - base);
+            block = tail;
+        }
+
+        json_block_t masks;
+        classifyBlock(block, &masks);
+
+        // Characters escaped by a backslash, carried across blocks
+        epicsUInt64 escaped = 0;
+        if(masks.backslash || mEscapeCarry)
+        {
+            mEscapes = true;
+            for(int i = 0; i < BLOCK_SIZE; ++i)
+            {
+                if(mEscapeCarry)
+                {
+                    escaped |= (epicsUInt64) 1 << i;
+                    mEscapeCarry = false;
+                }
+                else if(masks.backslash & ((epicsUInt64) 1 << i))
+                    mEscapeCarry = true;
+            }
+        }
+
+        // Bits from an opening quote up to (not including) its closing quote
+        epicsUInt64 quote = masks.quote & ~escaped;
+        epicsUInt64 inString = prefixXor(quote) ^ mInStringCarry;
+        mInStringCarry = (epicsUInt64) 0 - (inString >> 63);
+
+        if((masks.control | masks.high) & inString)
+            return JSON_FALLBACK;
+
+        // Anything else outside strings starts or continues a number/literal
+        epicsUInt64 scalar = ~(masks.op | masks.space | masks.quote | inString);
+        epicsUInt64 scalarStart = scalar & ~((scalar << 1) | mScalarCarry);
+        mScalarCarry = scalar >> 63;
+
+        epicsUInt64 events = (masks.op & ~inString) | quote | scalarStart;
+        while(events)
+        {
+            int pos = base + trailingZeros(events);
+            events &= events - 1;
+            if(pos >= len)
+                return JSON_FALLBACK;
+            char c = json[pos];
+
+            if(mState == S_STRING || mState == S_KEY_STRING)
+            {
+                // Closing quote, nothing else is reported inside a string
+                if(mEscapes && !validEscapes(json + mStringStart, pos - mStringStart))
+                    return JSON_FALLBACK;
+                if(mStringToken < capacity)
+                    tokens[mStringToken].len = pos - mStringStart;
+                mState = mState == S_KEY_STRING ? S_COLON : S_COMMA_OR_CLOSE;
+                continue;
+            }
+
+            switch(c)
+            {
+            case '{':
+            case '[':
+                if(mState != S_ROOT && mState != S_VALUE && mState != S_VALUE_OR_CLOSE)
+                    return JSON_FALLBACK;
+                mStack.push_back(mCount << 1 | (c == '['));
+                emit(tokens, capacity, mCount, json + pos,
+                     c == '[' ? JSON_TYPE_ARRAY : JSON_TYPE_OBJECT);
+                mState = c == '[' ? S_VALUE_OR_CLOSE : S_KEY_OR_CLOSE;
+                break;
+
+            case '}':
+            case ']':
+            {
+                bool array = c == ']';
+                if(mStack.empty() || (mStack.back() & 1) != array ||
+                   !(mState == S_COMMA_OR_CLOSE ||
+                     mState == (array ? S_VALUE_OR_CLOSE : S_KEY_OR_CLOSE)))
+                    return JSON_FALLBACK;
+
+                int index = mStack.back() >> 1;
+                mStack.pop_back();
+                if(index < capacity)
+                {
+                    tokens[index].len = (int) (json + pos + 1 - tokens[index].ptr);
+                    tokens[index].num_desc = (mCount - 1) - index;
+                }
+                mState = S_COMMA_OR_CLOSE;
+
+                if(mStack.empty())
+                {
+                    // Like frozen, stop at the end of the root value
+                    if(mCount + 1 > capacity)
+                    {
+                        mNeeded = mCount + 1;
+                        return JSON_TOKEN_ARRAY_TOO_SMALL;
+                    }
+                    emit(tokens, capacity, mCount, json + pos + 1, JSON_TYPE_EOF);
+                    return pos + 1;
+                }
+                break;
+            }
+
+            case ':':
+                if(mState != S_COLON)
+                    return JSON_FALLBACK;
+                mState = S_VALUE;
+                break;
+
+            case ',':
+                if(mState != S_COMMA_OR_CLOSE)
+                    return JSON_FALLBACK;
+                mState = (mStack.back() & 1) ? S_VALUE : S_KEY;
+                break;
+
+            case '"':
+                if(mState == S_KEY || mState == S_KEY_OR_CLOSE)
+                    mState = S_KEY_STRING;
+                else if(mState == S_VALUE || mState == S_VALUE_OR_CLOSE)
+                    mState = S_STRING;
+                else
+                    return JSON_FALLBACK;
+                mStringToken = mCount;
+                mStringStart = pos + 1;
+                emit(tokens, capacity, mCount, json + mStringStart, JSON_TYPE_STRING);
+                break;
+
+            default:
+            {
+                // Cut short only in documents that are invalid or have
+                // values longer than a block, both left to parse_json
+                enum json_type type;
+                int scalarLen;
+                if((mState != S_VALUE && mState != S_VALUE_OR_CLOSE) ||
+                   (scalarLen = scanScalar(json, pos, len, type)) < 0)
+                    return JSON_FALLBACK;
+                emit(tokens, capacity, mCount, json + pos, type);
+                if(mCount <= capacity)
+                    tokens[mCount - 1].len = scalarLen;
+                mState = S_COMMA_OR_CLOSE;
+                break;
+            }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef JSON_TOKENIZER_H
+#define JSON_TOKENIZER_H
+
+#include <vector>
+#include <epicsTypes.h>
+#include <frozen.h>
+
+// Drop-in replacement for frozen's parse_json producing the same tokens.
+//
+// The document is classified 64 bytes at a time with SSE2 or AVX2 (scalar
+// code elsewhere): quotes, escapes, structural characters and whitespace
+// become bit masks, string interiors are masked out with a prefix XOR, and
+// tokens are built by walking the remaining set bits. Only strict, ASCII
+// JSON takes this path. frozen is more lenient than that (unquoted keys,
+// missing and trailing commas, ...) and its handling of non-ASCII strings
+// depends on its UTF-8 decoding, so any other document, as well as any
+// invalid one, is handed to parse_json, which gives the exact same result
+// and error code as before.
+class JsonTokenizer
+{
+public:
+    JsonTokenizer ();
+
+    // Same arguments and return value as parse_json. When the document is
+    // valid but has too many tokens, needed is set to the capacity required
+    // to parse it (0 if that is not known)
+    int parse (const char *json, int len, struct json_token *tokens,
+               int capacity, int & needed);
+
+    // The same, for a document received in pieces into a buffer that doesn't
+    // move: begin with the buffer, feed the number of bytes received so far
+    // after each piece and finish with the final length, which returns what
+    // parse would. Tokens point into the buffer. Most of the document is
+    // tokenized by the time it is complete, the rest (and any document
+    // needing parse_json) by finish.
+    void begin (const char *json, struct json_token *tokens, int capacity);
+    void feed (int available);
+    int finish (int len, int & needed);
+
+    // Number of documents handed to parse_json
+    unsigned long getFallbacks (void);
+
+private:
+    std::vector<int> mStack;
+    unsigned long mFallbacks;
+
+    // State of the document being tokenized, kept between feeds
+    const char *mJson;
+    struct json_token *mTokens;
+    int mCapacity, mBase, mResult, mNeeded;
+    int mState, mCount, mStringToken, mStringStart;
+    bool mEscapes, mEscapeCarry;
+    epicsUInt64 mInStringCarry, mScalarCarry;
+
+    int tokenize (int len, bool complete);
+};
+
+#endif
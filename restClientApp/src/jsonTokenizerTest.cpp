@@ -0,0 +1,206 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "jsonTokenizer.h"
+
+#define TEST_TOKENS 4096
+
+// Deterministic pseudo random numbers
+static unsigned int nextRandom (unsigned int & seed)
+{
+  seed = seed * 1103515245u + 12345u;
+  return (seed >> 16) & 0x7fff;
+}
+
+static std::string randomString (unsigned int & seed)
+{
+  static const char *pieces[] = {
+    "a", "value", " ", "{", "}", "[", "]", ":", ",", "\\\"", "\\\\", "\\n", "\\u00e9", "\\/",
+    "\xc3\xa9", "\\x", "\t", "\\", "\""
+  };
+  std::string str;
+  int length = nextRandom(seed) % 6;
+  for (int i = 0; i < length; ++i) {
+    // Mostly valid pieces, the last few only rarely
+    int piece = nextRandom(seed) % (nextRandom(seed) % 20 ? 14 : 19);
+    str += pieces[piece];
+  }
+  return "\"" + str + "\"";
+}
+
+static std::string randomValue (unsigned int & seed, int depth)
+{
+  static const char *scalars[] = {
+    "0", "-1", "42", "3.25", "-0.5e10", "1E+3", "2e-7", "007", "true", "false", "null"
+  };
+  int kind = nextRandom(seed) % (depth > 4 ? 2 : 4);
+  if (kind == 0) {
+    return scalars[nextRandom(seed) % (sizeof(scalars) / sizeof(scalars[0]))];
+  }
+  if (kind == 1) {
+    return randomString(seed);
+  }
+
+  bool object = kind == 2;
+  std::string value = object ? "{" : "[";
+  int members = nextRandom(seed) % 8;
+  for (int i = 0; i < members; ++i) {
+    if (i) {
+      value += nextRandom(seed) % 2 ? ", " : ",\n  ";
+    }
+    if (object) {
+      value += randomString(seed) + ": ";
+    }
+    value += randomValue(seed, depth + 1);
+  }
+  return value + (object ? "}" : "]");
+}
+
+// Both tokenizers must agree on the result and on every token
+static void checkSame (std::string const & json, int capacity = TEST_TOKENS)
+{
+  static std::vector<struct json_token> expected(TEST_TOKENS), actual(TEST_TOKENS);
+  static JsonTokenizer tokenizer;
+  int needed;
+
+  int expectedResult = parse_json(json.c_str(), json.size(), &expected[0], capacity);
+  int actualResult = tokenizer.parse(json.c_str(), json.size(), &actual[0], capacity, needed);
+
+  BOOST_TEST_MESSAGE(json);
+  BOOST_REQUIRE_EQUAL(actualResult, expectedResult);
+  if (expectedResult < 0) {
+    return;
+  }
+
+  for (int i = 0; i < capacity; ++i) {
+    BOOST_REQUIRE_EQUAL(actual[i].type, expected[i].type);
+    BOOST_REQUIRE(actual[i].ptr == expected[i].ptr);
+    if (expected[i].type == JSON_TYPE_EOF) {
+      break;
+    }
+    BOOST_REQUIRE_EQUAL(actual[i].len, expected[i].len);
+    BOOST_REQUIRE_EQUAL(actual[i].num_desc, expected[i].num_desc);
+  }
+}
+
+// Fed in pieces of random sizes, the tokens are the same as parse_json's
+static void checkStream (std::string const & json, unsigned int & seed)
+{
+  static std::vector<struct json_token> expected(TEST_TOKENS), actual(TEST_TOKENS);
+  static JsonTokenizer tokenizer;
+  int needed;
+
+  int expectedResult = parse_json(json.c_str(), json.size(), &expected[0], TEST_TOKENS);
+  tokenizer.begin(json.c_str(), &actual[0], TEST_TOKENS);
+  for (size_t available = 0; available < json.size(); ) {
+    available = std::min(json.size(), available + 1 + nextRandom(seed) % 200);
+    tokenizer.feed(available);
+  }
+  int actualResult = tokenizer.finish(json.size(), needed);
+
+  BOOST_TEST_MESSAGE(json);
+  BOOST_REQUIRE_EQUAL(actualResult, expectedResult);
+  for (int i = 0; expectedResult >= 0 && i < TEST_TOKENS; ++i) {
+    BOOST_REQUIRE_EQUAL(actual[i].type, expected[i].type);
+    BOOST_REQUIRE(actual[i].ptr == expected[i].ptr);
+    if (expected[i].type == JSON_TYPE_EOF) {
+      break;
+    }
+    BOOST_REQUIRE_EQUAL(actual[i].len, expected[i].len);
+    BOOST_REQUIRE_EQUAL(actual[i].num_desc, expected[i].num_desc);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(JsonTokenizerUnitTests);
+
+BOOST_AUTO_TEST_CASE(SameTokensTest)
+{
+  const char *documents[] = {
+    "{\"value\": 3}", "[1, 2.5, -3e4, true, false, null, \"x\"]", "  {\"a\": {\"b\": [[], {}]}}  ",
+    "{}", "[]", "[\"\"]", "{\"key\": \"escaped \\\" quote\", \"k2\": \"\\\\\"}",
+    "{\"u\": \"\\u00e9\\n\\t\"}", "{\"e\": \"\xc3\xa9t\xc3\xa9\"}", "{\"v\": 1} trailing ]]",
+    "{value: 3}", "[1 2]", "[1,]", "{\"a\" 1}", "[truefalse]", "[1.]", "[-]", "[01, 1e5, 1e+5]",
+    "[\"unterminated]", "{\"a\": [1, 2}", "[1, 2", "", "   ", "5", "\"str\"", "[\"\\q\"]",
+    "[\"\\u12\"]", "[\"tab\there\"]", "[\"\\", "[nul]", "{\"a\":1,}", "[1}", "{\"a\":1]",
+    "[\"a\"\"b\"]", "[1\"a\"]", "{\"a\":1 \"b\":2}"
+  };
+  for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); ++i) {
+    checkSame(documents[i]);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(RandomDocumentsTest)
+{
+  unsigned int seed = 1;
+  for (int i = 0; i < 2000; ++i) {
+    bool object = nextRandom(seed) % 2;
+    std::string json = (object ? "{\"root\": " : "[") + randomValue(seed, 0) + (object ? "}" : "]");
+    checkSame(json);
+
+    // Truncated and corrupted copies
+    checkSame(json.substr(0, nextRandom(seed) % json.size()));
+    std::string corrupted(json);
+    corrupted[nextRandom(seed) % json.size()] = "\"\\{}[],: x1\x01\x80"[nextRandom(seed) % 14];
+    checkSame(corrupted);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(FastPathTest)
+{
+  // Long enough to span many blocks, with values across block boundaries
+  std::string json = "{\"name\": \"a string with \\\"quotes\\\" and [brackets]\", \"data\": [";
+  char value[32];
+  for (int i = 0; i < 1000; ++i) {
+    sprintf(value, "%s%d.%d", i ? ", " : "", i * 7919, i % 10);
+    json += value;
+  }
+  json += "]}";
+
+  JsonTokenizer tokenizer;
+  std::vector<struct json_token> tokens(TEST_TOKENS);
+  int needed;
+  BOOST_CHECK_EQUAL(tokenizer.parse(json.c_str(), json.size(), &tokens[0], TEST_TOKENS, needed),
+                    (int) json.size());
+  BOOST_CHECK_EQUAL(tokenizer.getFallbacks(), 0u);
+  checkSame(json);
+
+  // Too small: the exact capacity needed is reported
+  BOOST_CHECK_EQUAL(tokenizer.parse(json.c_str(), json.size(), &tokens[0], 100, needed),
+                    JSON_TOKEN_ARRAY_TOO_SMALL);
+  BOOST_CHECK_EQUAL(needed, 1006);
+  checkSame(json, 100);
+  checkSame(json, 1005);
+  checkSame(json, 1006);
+};
+
+BOOST_AUTO_TEST_CASE(StreamTest)
+{
+  unsigned int seed = 7;
+  for (int i = 0; i < 2000; ++i) {
+    std::string json = "{\"root\": " + randomValue(seed, 0) + "}";
+    checkStream(json, seed);
+    checkStream(json.substr(0, nextRandom(seed) % json.size()), seed);
+  }
+
+  // Mostly tokenized before the end arrives
+  std::string json = "[";
+  for (int i = 0; i < 1000; ++i) {
+    json += i ? ", 1.5" : "1.5";
+  }
+  json += "]";
+  JsonTokenizer tokenizer;
+  std::vector<struct json_token> tokens(TEST_TOKENS);
+  int needed;
+  tokenizer.begin(json.c_str(), &tokens[0], TEST_TOKENS);
+  tokenizer.feed(json.size() - 1);
+  BOOST_CHECK_EQUAL(tokenizer.finish(json.size(), needed), (int) json.size());
+  BOOST_CHECK_EQUAL(tokens[0].num_desc, 1000);
+  BOOST_CHECK_EQUAL(tokenizer.getFallbacks(), 0u);
+};
+
+BOOST_AUTO_TEST_SUITE_END();
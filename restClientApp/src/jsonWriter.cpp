@@ -0,0 +1,235 @@
+#include "jsonWriter.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "jsonNumber.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_SSE2
+#include <emmintrin.h>
+#endif
+
+static inline bool needsEscape (unsigned char c)
+{
+    return c == '"' || c == '\\' || c < 0x20;
+}
+
+static void appendEscaped (std::string & buffer, unsigned char c)
+{
+    static const char hex[] = "0123456789abcdef";
+    char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+
+    switch(c)
+    {
+    case '"':  buffer.append("\\\"", 2); break;
+    case '\\': buffer.append("\\\\", 2); break;
+    case '\b': buffer.append("\\b", 2);  break;
+    case '\f': buffer.append("\\f", 2);  break;
+    case '\n': buffer.append("\\n", 2);  break;
+    case '\r': buffer.append("\\r", 2);  break;
+    case '\t': buffer.append("\\t", 2);  break;
+    default:   buffer.append(escaped, 6); break;
+    }
+}
+
+#ifdef JSON_SSE2
+static inline int trailingZeros (unsigned int x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#else
+    int n = 0;
+    while(!(x & 1))
+    {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+#endif
+
+void JsonWriter::escape (std::string & buffer, const char *str, size_t len)
+{
+    // Runs of characters that need no escaping are appended in one go
+    size_t start = 0, i = 0;
+
+#ifdef JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    while(i + 16 <= len)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        // Unsigned v <= 0x1f
+        __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(special);
+        if(!mask)
+        {
+            i += 16;
+            continue;
+        }
+        i += trailingZeros(mask);
+        buffer.append(str + start, i - start);
+        appendEscaped(buffer, (unsigned char) str[i]);
+        start = ++i;
+    }
+#endif
+
+    for(; i < len; ++i)
+    {
+        if(needsEscape((unsigned char) str[i]))
+        {
+            buffer.append(str + start, i - start);
+            appendEscaped(buffer, (unsigned char) str[i]);
+            start = i + 1;
+        }
+    }
+    buffer.append(str + start, len - start);
+}
+
+JsonWriter::JsonWriter (std::string & buffer)
+    : mBuffer(buffer), mDepth(0), mAfterKey(false)
+{
+    mHasMembers[0] = false;
+}
+
+void JsonWriter::separate (void)
+{
+    if(mAfterKey)
+        mAfterKey = false;
+    else if(mHasMembers[mDepth])
+        mBuffer.append(", ", 2);
+    mHasMembers[mDepth] = true;
+}
+
+void JsonWriter::open (char bracket)
+{
+    if(mDepth == JSON_WRITER_MAX_DEPTH)
+        throw std::length_error("JSON nested too deep");
+    separate();
+    mBuffer += bracket;
+    mHasMembers[++mDepth] = false;
+}
+
+void JsonWriter::close (char bracket)
+{
+    mBuffer += bracket;
+    if(mDepth > 0)
+        --mDepth;
+}
+
+void JsonWriter::beginObject (void)
+{
+    open('{');
+}
+
+void JsonWriter::endObject (void)
+{
+    close('}');
+}
+
+void JsonWriter::beginArray (void)
+{
+    open('[');
+}
+
+void JsonWriter::endArray (void)
+{
+    close(']');
+}
+
+void JsonWriter::key (const char *key, size_t len)
+{
+    separate();
+    mBuffer += '"';
+    escape(mBuffer, key, len);
+    mBuffer.append("\": ", 3);
+    mAfterKey = true;
+}
+
+void JsonWriter::key (std::string const & key)
+{
+    this->key(key.data(), key.size());
+}
+
+void JsonWriter::value (const char *value, size_t len)
+{
+    separate();
+    mBuffer += '"';
+    escape(mBuffer, value, len);
+    mBuffer += '"';
+}
+
+void JsonWriter::value (const char *value)
+{
+    this->value(value, strlen(value));
+}
+
+void JsonWriter::value (std::string const & value)
+{
+    this->value(value.data(), value.size());
+}
+
+void JsonWriter::value (bool value)
+{
+    separate();
+    if(value)
+        mBuffer.append("true", 4);
+    else
+        mBuffer.append("false", 5);
+}
+
+void JsonWriter::value (int value)
+{
+    char number[JSON_NUMBER_SIZE];
+    separate();
+    mBuffer.append(number, formatNumber(value, number));
+}
+
+void JsonWriter::value (double value)
+{
+    char number[JSON_NUMBER_SIZE];
+    separate();
+    mBuffer.append(number, formatNumber(value, number));
+}
+
+void JsonWriter::rawValue (const char *json, size_t len)
+{
+    separate();
+    mBuffer.append(json, len);
+}
+
+void JsonWriter::rawValue (std::string const & json)
+{
+    rawValue(json.data(), json.size());
+}
+
+void JsonWriter::rawString (const char *str, size_t len)
+{
+    separate();
+    mBuffer += '"';
+    mBuffer.append(str, len);
+    mBuffer += '"';
+}
+
+void JsonWriter::rawString (std::string const & str)
+{
+    rawString(str.data(), str.size());
+}
+
+void JsonWriter::members (std::string const & object)
+{
+    if(object.size() > 2)
+    {
+        separate();
+        mBuffer.append(object, 1, object.size() - 2);
+    }
+}
+
+std::string & JsonWriter::getBuffer (void)
+{
+    return mBuffer;
+}
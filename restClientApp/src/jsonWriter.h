@@ -0,0 +1,63 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <stddef.h>
+
+#define JSON_WRITER_MAX_DEPTH 32
+
+// Appends JSON to a caller's buffer, which can be cleared and reused so that
+// writing allocates nothing once it has grown large enough. Separators are
+// inserted as needed, in JsonDict's layout: {"key": value, "key": [1, 2]}.
+// Strings are escaped as JSON requires (quotes, backslashes and control
+// characters), 16 bytes at a time with SSE2 where available.
+//
+// Nesting deeper than JSON_WRITER_MAX_DEPTH throws std::length_error.
+class JsonWriter
+{
+public:
+    explicit JsonWriter (std::string & buffer);
+
+    void beginObject (void);
+    void endObject (void);
+    void beginArray (void);
+    void endArray (void);
+
+    // Inside an object, a key precedes each value
+    void key (const char *key, size_t len);
+    void key (std::string const & key);
+
+    void value (const char *value, size_t len);
+    void value (const char *value);
+    void value (std::string const & value);
+    void value (bool value);
+    void value (int value);
+    void value (double value);
+
+    // Already formatted JSON: a whole value, or the members of an object
+    // (the object minus its braces) merged into the one being written
+    void rawValue (const char *json, size_t len);
+    void rawValue (std::string const & json);
+    void members (std::string const & object);
+
+    // A string value whose contents are already escaped (no quotes)
+    void rawString (const char *str, size_t len);
+    void rawString (std::string const & str);
+
+    std::string & getBuffer (void);
+
+    // Append str to buffer as the contents of a JSON string (no quotes)
+    static void escape (std::string & buffer, const char *str, size_t len);
+
+private:
+    std::string & mBuffer;
+    int mDepth;
+    bool mAfterKey;
+    bool mHasMembers[JSON_WRITER_MAX_DEPTH + 1];
+
+    void separate (void);
+    void open (char bracket);
+    void close (char bracket);
+};
+
+#endif
@@ -0,0 +1,491 @@
+#include "mockRestServer.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <epicsThread.h>
+#include <epicsGuard.h>
+#include <epicsStdio.h>
+#include <frozen.h>
+
+#define EOH                 "\r\n\r\n"
+#define MAX_BUF_SIZE        65536
+#define MAX_HEADER_SIZE     256
+#define SEND_CHUNK_SIZE     16384
+
+using std::string;
+using std::vector;
+
+typedef struct
+{
+    MockRestServer *server;
+    SOCKET fd;
+} mock_connection_t;
+
+static void acceptTaskC (void *server)
+{
+    ((MockRestServer *) server)->acceptTask();
+}
+
+static void connectionTaskC (void *arg)
+{
+    mock_connection_t *connection = (mock_connection_t *) arg;
+    connection->server->connectionTask(connection->fd);
+    delete connection;
+}
+
+MockRestServer::MockRestServer ()
+    : mListenFd(INVALID_SOCKET), mPort(0), mExiting(false), mThreads(0), mConnections(),
+      mParams(), mLatency(0.0), mBandwidth(0.0), mChunkSize(0), mConnectionClose(false),
+      mGets(0), mPuts(0), mAccepted(0), mLock()
+{
+    struct sockaddr_in address;
+    osiSocklen_t addressLen = sizeof(address);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    mListenFd = epicsSocketCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(mListenFd == INVALID_SOCKET)
+        throw std::runtime_error("failed to create socket");
+
+    epicsSocketEnableAddressReuseDuringTimeWaitState(mListenFd);
+    if(bind(mListenFd, (struct sockaddr *) &address, sizeof(address)) ||
+       listen(mListenFd, 64) ||
+       getsockname(mListenFd, (struct sockaddr *) &address, &addressLen))
+    {
+        epicsSocketDestroy(mListenFd);
+        throw std::runtime_error("failed to listen on loopback");
+    }
+    mPort = ntohs(address.sin_port);
+
+    mThreads = 1;
+    epicsThreadMustCreate("mockRestAccept", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            (EPICSTHREADFUNC) acceptTaskC, this);
+}
+
+MockRestServer::~MockRestServer ()
+{
+    {
+        epicsGuard<epicsMutex> guard(mLock);
+        mExiting = true;
+        shutdown(mListenFd, SHUT_RDWR);
+        std::set<SOCKET>::iterator it;
+        for(it = mConnections.begin(); it != mConnections.end(); ++it)
+            shutdown(*it, SHUT_RDWR);
+    }
+
+    for(;;)
+    {
+        {
+            epicsGuard<epicsMutex> guard(mLock);
+            if(!mThreads)
+                break;
+        }
+        epicsThreadSleep(0.001);
+    }
+    epicsSocketDestroy(mListenFd);
+}
+
+int MockRestServer::getPort (void)
+{
+    return mPort;
+}
+
+void MockRestServer::addParam (string const & subSystem, string const & name,
+                               string const & value, string const & putReply)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mock_param_t & param = mParams[subSystem + name];
+    param.name = name;
+    param.values = vector<string>(1, value);
+    param.isArray = false;
+    param.putReply = putReply;
+}
+
+void MockRestServer::addArray (string const & subSystem, string const & name,
+                               vector<string> const & values, string const & putReply)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mock_param_t & param = mParams[subSystem + name];
+    param.name = name;
+    param.values = values;
+    param.isArray = true;
+    param.putReply = putReply;
+}
+
+int MockRestServer::addTree (string const & json)
+{
+    struct json_token *tokens = parse_json2(json.c_str(), json.size());
+    if(!tokens || tokens[0].type != JSON_TYPE_OBJECT)
+    {
+        free(tokens);
+        return EXIT_FAILURE;
+    }
+
+    // Keys and values alternate, each value followed by its descendants
+    int status = EXIT_SUCCESS;
+    int i = 1;
+    while(i <= tokens[0].num_desc && !status)
+    {
+        string subSystem(tokens[i].ptr, tokens[i].len);
+        struct json_token *params = &tokens[i + 1];
+        if(params->type != JSON_TYPE_OBJECT)
+        {
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        int j = 1;
+        while(j <= params->num_desc)
+        {
+            string name(params[j].ptr, params[j].len);
+            struct json_token *value = &params[j + 1];
+            if(value->type == JSON_TYPE_ARRAY)
+            {
+                vector<string> values;
+                for(int k = 1; k <= value->num_desc; ++k)
+                {
+                    struct json_token *t = &value[k];
+                    if(t->type == JSON_TYPE_STRING)
+                        values.push_back("\"" + string(t->ptr, t->len) + "\"");
+                    else
+                        values.push_back(string(t->ptr, t->len));
+                }
+                addArray(subSystem, name, values);
+            }
+            else if(value->type == JSON_TYPE_STRING)
+                addParam(subSystem, name, "\"" + string(value->ptr, value->len) + "\"");
+            else
+                addParam(subSystem, name, string(value->ptr, value->len));
+            j += 2 + value->num_desc;
+        }
+        i += 2 + params->num_desc;
+    }
+    free(tokens);
+    return status;
+}
+
+string MockRestServer::getValue (string const & path, size_t index)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    std::map<string, mock_param_t>::iterator it = mParams.find(path);
+    if(it == mParams.end() || index >= it->second.values.size())
+        return "";
+    return it->second.values[index];
+}
+
+void MockRestServer::setValue (string const & path, string const & value, size_t index)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    std::map<string, mock_param_t>::iterator it = mParams.find(path);
+    if(it != mParams.end() && index < it->second.values.size())
+        it->second.values[index] = value;
+}
+
+void MockRestServer::setLatency (double seconds)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mLatency = seconds;
+}
+
+void MockRestServer::setBandwidth (double bytesPerSecond)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mBandwidth = bytesPerSecond;
+}
+
+void MockRestServer::setChunkSize (size_t bytes)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mChunkSize = bytes;
+}
+
+void MockRestServer::setConnectionClose (bool close)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mConnectionClose = close;
+}
+
+void MockRestServer::setRawResponse (string const & response)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mRawResponse = response;
+}
+
+unsigned long MockRestServer::getGets (void)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    return mGets;
+}
+
+unsigned long MockRestServer::getPuts (void)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    return mPuts;
+}
+
+unsigned long MockRestServer::getConnections (void)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    return mAccepted;
+}
+
+void MockRestServer::acceptTask (void)
+{
+    for(;;)
+    {
+        SOCKET fd = accept(mListenFd, NULL, NULL);
+
+        epicsGuard<epicsMutex> guard(mLock);
+        if(mExiting)
+        {
+            if(fd != INVALID_SOCKET)
+                epicsSocketDestroy(fd);
+            break;
+        }
+        if(fd == INVALID_SOCKET)
+            continue;
+
+        mock_connection_t *connection = new mock_connection_t;
+        connection->server = this;
+        connection->fd = fd;
+        mConnections.insert(fd);
+        ++mAccepted;
+        ++mThreads;
+        epicsThreadMustCreate("mockRestConn", epicsThreadPriorityMedium,
+                epicsThreadGetStackSize(epicsThreadStackMedium),
+                (EPICSTHREADFUNC) connectionTaskC, connection);
+    }
+
+    epicsGuard<epicsMutex> guard(mLock);
+    --mThreads;
+}
+
+void MockRestServer::connectionTask (SOCKET fd)
+{
+    string buffer;
+    char *chunk = new char[MAX_BUF_SIZE];
+
+    for(;;)
+    {
+        // Header
+        size_t headerEnd;
+        bool closed = false;
+        while((headerEnd = buffer.find(EOH)) == string::npos && !closed)
+        {
+            int received = recv(fd, chunk, MAX_BUF_SIZE, 0);
+            if(received <= 0)
+                closed = true;
+            else
+                buffer.append(chunk, received);
+        }
+        if(closed)
+            break;
+
+        string header(buffer, 0, headerEnd);
+        size_t bodyStart = headerEnd + strlen(EOH);
+        size_t contentLength = 0;
+        size_t field = header.find("Content-Length:");
+        if(field != string::npos)
+            contentLength = strtoul(header.c_str() + field + strlen("Content-Length:"), NULL, 10);
+
+        // Body
+        while(buffer.size() < bodyStart + contentLength && !closed)
+        {
+            int received = recv(fd, chunk, MAX_BUF_SIZE, 0);
+            if(received <= 0)
+                closed = true;
+            else
+                buffer.append(chunk, received);
+        }
+        if(closed)
+            break;
+
+        size_t methodEnd = header.find(' ');
+        size_t pathEnd = header.find(' ', methodEnd + 1);
+        string method(header, 0, methodEnd);
+        string path(header, methodEnd + 1, pathEnd - methodEnd - 1);
+        string body(buffer, bodyStart, contentLength);
+        buffer.erase(0, bodyStart + contentLength);
+
+        string reply;
+        int code = handle(method, path, body, reply);
+
+        double bandwidth;
+        size_t chunkSize;
+        bool connectionClose;
+        string rawResponse;
+        {
+            epicsGuard<epicsMutex> guard(mLock);
+            bandwidth = mBandwidth;
+            chunkSize = mChunkSize;
+            connectionClose = mConnectionClose;
+            rawResponse = mRawResponse;
+        }
+
+        char responseHeader[MAX_HEADER_SIZE];
+        int headerLen = epicsSnprintf(responseHeader, sizeof(responseHeader),
+                "HTTP/1.1 %d %s\r\n"
+                "Content-Type: application/json\r\n",
+                code, code == 200 ? "OK" : "Not Found");
+        string response(responseHeader, headerLen);
+        if(connectionClose)
+            response += "Connection: close\r\n";
+        if(chunkSize)
+        {
+            response += "Transfer-Encoding: chunked\r\n\r\n";
+            response += encodeChunked(reply, chunkSize);
+        }
+        else
+        {
+            headerLen = epicsSnprintf(responseHeader, sizeof(responseHeader),
+                    "Content-Length: %lu\r\n\r\n", (unsigned long) reply.size());
+            response.append(responseHeader, headerLen);
+            response += reply;
+        }
+        if(!rawResponse.empty())
+            response = rawResponse;
+
+        size_t sendSize = bandwidth > 0.0 ? SEND_CHUNK_SIZE : response.size();
+        bool failed = false;
+        for(size_t sent = 0; sent < response.size() && !failed; sent += sendSize)
+        {
+            if(sent && bandwidth > 0.0)
+                epicsThreadSleep(sendSize / bandwidth);
+            size_t len = std::min(sendSize, response.size() - sent);
+            failed = send(fd, response.data() + sent, len, MSG_NOSIGNAL) < 0;
+        }
+        if(failed || connectionClose)
+            break;
+    }
+
+    delete[] chunk;
+    epicsGuard<epicsMutex> guard(mLock);
+    mConnections.erase(fd);
+    epicsSocketDestroy(fd);
+    --mThreads;
+}
+
+int MockRestServer::handle (string const & method, string const & path,
+                            string const & body, string & reply)
+{
+    double latency;
+    {
+        epicsGuard<epicsMutex> guard(mLock);
+        latency = mLatency;
+    }
+    if(latency > 0.0)
+        epicsThreadSleep(latency);
+
+    epicsGuard<epicsMutex> guard(mLock);
+
+    if(method == "GET")
+    {
+        ++mGets;
+        std::map<string, mock_param_t>::iterator it = mParams.find(path);
+        if(it == mParams.end())
+            return 404;
+        reply = render(it->second);
+        return 200;
+    }
+
+    if(method == "PUT")
+    {
+        ++mPuts;
+        int index = -1;
+        std::map<string, mock_param_t>::iterator it = mParams.find(path);
+        if(it == mParams.end())
+        {
+            size_t slash = path.rfind('/');
+            if(slash == string::npos)
+                return 404;
+            index = atoi(path.c_str() + slash + 1);
+            it = mParams.find(path.substr(0, slash));
+        }
+        if(it == mParams.end() || store(it->second, body, index))
+            return 404;
+        reply = it->second.putReply;
+        return 200;
+    }
+
+    return 404;
+}
+
+string MockRestServer::render (mock_param_t const & param)
+{
+    string rendered;
+    if(param.isArray)
+    {
+        rendered = "[";
+        for(size_t index = 0; index < param.values.size(); ++index)
+        {
+            if(index)
+                rendered += ", ";
+            rendered += param.values[index];
+        }
+        rendered += "]";
+    }
+    else
+    {
+        rendered = "{\"" + param.name + "\": " + param.values[0] + "}";
+    }
+    return rendered;
+}
+
+int MockRestServer::store (mock_param_t & param, string const & body, int index)
+{
+    if(index >= 0)
+    {
+        if((size_t) index >= param.values.size())
+            return EXIT_FAILURE;
+        param.values[index] = body;
+        return EXIT_SUCCESS;
+    }
+
+    if(!param.isArray)
+    {
+        param.values[0] = body;
+        return EXIT_SUCCESS;
+    }
+
+    struct json_token *tokens = parse_json2(body.c_str(), body.size());
+    if(!tokens || tokens[0].type != JSON_TYPE_ARRAY)
+    {
+        free(tokens);
+        return EXIT_FAILURE;
+    }
+    param.values.clear();
+    for(int i = 1; i <= tokens[0].num_desc; ++i)
+    {
+        struct json_token *t = &tokens[i];
+        if(t->type == JSON_TYPE_STRING)
+            param.values.push_back("\"" + string(t->ptr, t->len) + "\"");
+        else
+            param.values.push_back(string(t->ptr, t->len));
+    }
+    free(tokens);
+    return EXIT_SUCCESS;
+}
+
+string MockRestServer::encodeChunked (string const & body, size_t chunkSize)
+{
+    string chunked;
+    char size[32];
+    for(size_t start = 0; start < body.size(); start += chunkSize)
+    {
+        size_t len = std::min(chunkSize, body.size() - start);
+        int sizeLen = epicsSnprintf(size, sizeof(size), "%lx\r\n", (unsigned long) len);
+        chunked.append(size, sizeLen);
+        chunked.append(body, start, len);
+        chunked += "\r\n";
+    }
+    chunked += "0\r\n\r\n";
+    return chunked;
+}
@@ -0,0 +1,121 @@
+#ifndef MOCK_REST_SERVER_H
+#define MOCK_REST_SERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <stdlib.h>
+#include <epicsMutex.h>
+#include <osiSock.h>
+#include <asynPortDriver.h>
+
+#include "restApi.h"
+
+// A parameter served by MockRestServer
+typedef struct
+{
+    std::string name;
+    std::vector<std::string> values;
+    bool isArray;
+    std::string putReply;
+} mock_param_t;
+
+// Minimal HTTP/1.1 server on the loopback interface that serves parameters
+// the way RestParam expects them, for tests and benchmarks:
+//  - GET  <subSystem><name>          -> {"<name>": <value>} or [<values>]
+//  - PUT  <subSystem><name>          <- <value> or [<values>]
+//  - PUT  <subSystem><name>/<index>  <- <value>
+// PUT replies carry the configured putReply body (e.g. a list of parameter
+// names to refetch). Replies can be delayed, paced, chunked or followed by
+// closing the connection, to exercise each path of RestAPI.
+class MockRestServer
+{
+public:
+    MockRestServer ();
+    ~MockRestServer ();
+
+    int getPort (void);
+
+    void addParam (std::string const & subSystem, std::string const & name,
+                   std::string const & value, std::string const & putReply = "");
+    void addArray (std::string const & subSystem, std::string const & name,
+                   std::vector<std::string> const & values,
+                   std::string const & putReply = "");
+
+    // A whole tree at once, as {"<subSystem>": {"<name>": <value>, ...}, ...}:
+    // array values are added as arrays. Fails on anything else
+    int addTree (std::string const & json);
+
+    // Raw JSON value of a parameter, by full path (<subSystem><name>)
+    std::string getValue (std::string const & path, size_t index = 0);
+    void setValue (std::string const & path, std::string const & value, size_t index = 0);
+
+    // Delay applied before answering each request
+    void setLatency (double seconds);
+    // Pace replies to about this rate, sent in pieces (0: all at once)
+    void setBandwidth (double bytesPerSecond);
+    // Send replies with Transfer-Encoding: chunked, in chunks of up to this
+    // many bytes (0: with a Content-Length)
+    void setChunkSize (size_t bytes);
+    // Answer with Connection: close and close each connection after a reply
+    void setConnectionClose (bool close);
+    // Send this instead of each reply, header included, to exercise error
+    // handling (empty: reply normally)
+    void setRawResponse (std::string const & response);
+
+    unsigned long getGets (void);
+    unsigned long getPuts (void);
+    unsigned long getConnections (void);
+
+    // Thread bodies, only public to be reachable from the thread entries
+    void acceptTask (void);
+    void connectionTask (SOCKET fd);
+
+private:
+    SOCKET mListenFd;
+    int mPort;
+    bool mExiting;
+    int mThreads;
+    std::set<SOCKET> mConnections;
+    std::map<std::string, mock_param_t> mParams;
+    double mLatency, mBandwidth;
+    size_t mChunkSize;
+    bool mConnectionClose;
+    std::string mRawResponse;
+    unsigned long mGets, mPuts, mAccepted;
+    epicsMutex mLock;
+
+    int handle (std::string const & method, std::string const & path,
+                std::string const & body, std::string & reply);
+    std::string render (mock_param_t const & param);
+    int store (mock_param_t & param, std::string const & body, int index);
+    std::string encodeChunked (std::string const & body, size_t chunkSize);
+};
+
+// RestAPI connecting to a MockRestServer, with every subsystem read-write
+class MockRestAPI : public RestAPI
+{
+public:
+    MockRestAPI (int port) : RestAPI("127.0.0.1", port) {}
+
+    int lookupAccessMode (std::string, rest_access_mode_t &accessMode)
+    {
+        accessMode = REST_ACC_RW;
+        return EXIT_SUCCESS;
+    }
+};
+
+// Bare port driver to own a RestParamSet outside of an IOC
+class MockPortDriver : public asynPortDriver
+{
+public:
+    MockPortDriver (const char *portName, int maxAddr = 1)
+        : asynPortDriver(portName, maxAddr,
+                         asynInt32Mask | asynFloat64Mask | asynOctetMask | asynDrvUserMask,
+                         asynInt32Mask | asynFloat64Mask | asynOctetMask,
+                         ASYN_MULTIDEVICE, 1, 0, 0)
+    {}
+};
+
+#endif
@@ -1,15 +1,22 @@
 #include "restApi.h"
 
+#include <sstream>
 #include <stdexcept>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <algorithm>
+#include <vector>
 #include <fcntl.h>
 
 #include <epicsStdio.h>
 #include <epicsTime.h>
+#include <epicsGuard.h>
 
 #include "jsonDict.h"
+#include "restTrace.h"
 
 #define EOL                     "\r\n"      // End of Line
 #define EOL_LEN                 2           // End of Line Length
@@ -21,16 +28,25 @@
 
 #define MAX_HTTP_RETRIES        1
 #define MAX_MESSAGE_SIZE        8192
+#define MAX_CONTENT_LENGTH      (64 * 1024 * 1024)  // Largest body accepted
 #define MAX_BUF_SIZE            256
-#define MAX_JSON_TOKENS         100
 
 #define DEFAULT_TIMEOUT_CONNECT 1
 
-#define ERROR(message) \
+// Errors are keyed on their function and line, and for ERROR_FOR on a cheap
+// discriminator too. The message is only formatted if it is going to be
+// printed
+#define ERROR(message) ERROR_FOR(message, 0)
+
+#define ERROR_FOR(message, discriminator) \
         { \
-            std::stringstream ss; \
-            ss << message; \
-            setError(functionName, ss.str()); \
+            unsigned long suppressed_; \
+            if (mErrorFilter->newError(ErrorFilter::key(functionName, __LINE__, -1, \
+                                                        discriminator), suppressed_)) { \
+                std::stringstream ss; \
+                ss << message; \
+                printError(functionName, ss.str(), suppressed_); \
+            } \
         }
 
 // Requests
@@ -41,12 +57,13 @@
     "Content-Length: 0" EOL \
     "Accept: " DATA_NATIVE EOH
 
+// Followed by the content length and EOH
 #define REQUEST_PUT\
     "PUT %s%s HTTP/1.1" EOL \
     "Host: %s" EOL\
     "Accept-Encoding: identity" EOL\
     "Content-Type: " DATA_NATIVE EOL \
-    "Content-Length: %lu" EOH
+    "Content-Length: "
 
 const std::string RestAPI::PARAM_VALUE           = "";
 const std::string RestAPI::PARAM_TYPE            = "";
@@ -61,7 +78,8 @@ using std::string;
 
 RestAPI::RestAPI (string const & hostname, int port, size_t numSockets) :
     mHostname(hostname), mPort(port), mNumSockets(numSockets),
-    mSockets(new socket_t[numSockets]), mErrorFilter(new ErrorFilter())
+    mSockets(new socket_t[numSockets]), mEndpoints(), mEndpointLock(),
+    mHostStats(), mErrorFilter(new ErrorFilter())
 {
       memset(&mAddress, 0, sizeof(mAddress));
 
@@ -80,10 +98,26 @@ RestAPI::RestAPI (string const & hostname, int port, size_t numSockets) :
 }
 RestAPI::~RestAPI()
 {
+    rest_endpoint_map_t::iterator it;
+    for(it = mEndpoints.begin(); it != mEndpoints.end(); ++it)
+    {
+        delete it->second->stats;
+        delete it->second;
+    }
     delete[] this->mSockets;
     delete this->mErrorFilter;
 }
 
+size_t RestAPI::getNumSockets (void)
+{
+    return mNumSockets;
+}
+
+RestRequestStats & RestAPI::getHostStats (void)
+{
+    return mHostStats;
+}
+
 int RestAPI::connectedSockets()
 {
   int connected = 0;
@@ -178,16 +212,35 @@ int RestAPI::setNonBlock (socket_t *s, bool nonBlock)
     return fcntl(s->fd, F_SETFL, flags) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-int RestAPI::doRequest (const request_t *request, response_t *response, int timeout)
+int RestAPI::waitReadable (socket_t *s, int timeout)
 {
-    const char *functionName = "doRequest";
-    int status = EXIT_SUCCESS;
-    int received, ret;
-    int errcode;
+    const char *functionName = "waitReadable";
     struct timeval recvTimeout;
     struct timeval *pRecvTimeout = NULL;
     fd_set fds;
 
+    FD_ZERO(&fds);
+    FD_SET(s->fd, &fds);
+    if(timeout >= 0)
+    {
+        recvTimeout.tv_sec = timeout;
+        recvTimeout.tv_usec = 0;
+        pRecvTimeout = &recvTimeout;
+    }
+
+    int ret = select(s->fd+1, &fds, NULL, NULL, pRecvTimeout);
+    if(ret <= 0)
+    {
+        const char *error = ret ? "select() failed" : "Timed out";
+        ERROR_FOR(error, (size_t) error);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int RestAPI::doRequest (const request_t *request, response_t *response, int timeout)
+{
+    const char *functionName = "doRequest";
     socket_t *s = NULL;
     bool gotSocket = false;
 
@@ -201,10 +254,41 @@ int RestAPI::doRequest (const request_t *request, response_t *response, int time
     if(!gotSocket)
     {
         ERROR("No available socket");
-        status = EXIT_FAILURE;
-        goto end;
+        return EXIT_FAILURE;
+    }
+    response->checkoutTime = epicsMonotonicGet();
+    REST_TRACE(REST_TRACE_SOCKET_CHECKOUT, request->traceId);
+
+    int status;
+    bool retry = false;
+    {
+        // The guard takes over the lock tryLock took (the mutex is
+        // recursive), so that the socket is released however the exchange
+        // ends, exceptions included
+        epicsGuard<epicsMutex> guard(s->mutex);
+        s->mutex.unlock();
+        status = exchange(s, request, response, timeout, retry);
+        if(!retry)
+            s->retries = 0;
     }
 
+    if(retry)
+        return doRequest(request, response, timeout);
+    return status;
+}
+
+// Send the request and receive the response on a socket the caller holds.
+// retry is set if the socket turned out to be closed by the server
+int RestAPI::exchange (socket_t *s, const request_t *request, response_t *response,
+                       int timeout, bool & retry)
+{
+    const char *functionName = "exchange";
+    int status = EXIT_SUCCESS;
+    int received;
+    int errcode;
+    size_t headerReceived, contentReceived;
+    epicsUInt64 parseStart;
+
     if(s->closed)
     {
         if(connect(s))
@@ -249,73 +333,140 @@ int RestAPI::doRequest (const request_t *request, response_t *response, int time
             goto end;
         }
     }
+    REST_TRACE(REST_TRACE_SEND, request->traceId);
 
-    if(timeout >= 0)
+    // The header, with whatever part of the content comes with it
+    headerReceived = 0;
+    do
     {
-        recvTimeout.tv_sec = timeout;
-        recvTimeout.tv_usec = 0;
-        FD_ZERO(&fds);
-        FD_SET(s->fd, &fds);
-        pRecvTimeout = &recvTimeout;
+        if(waitReadable(s, timeout))
+        {
+            status = EXIT_FAILURE;
+            goto end;
+        }
+
+        received = recv(s->fd, response->data + headerReceived,
+                        response->dataLen - headerReceived, 0);
+        if(received <= 0)
+        {
+            if(!headerReceived && s->retries++ < MAX_HTTP_RETRIES)
+                goto retry;
+            ERROR("Failed to recv");
+            status = EXIT_FAILURE;
+            goto failed;
+        }
+        if(!headerReceived)
+            REST_TRACE(REST_TRACE_FIRST_BYTE, request->traceId);
+        headerReceived += (size_t) received;
+        response->data[headerReceived] = '\0';
+
+        if(!strstr(response->data, EOH) && headerReceived == response->dataLen)
+        {
+            ERROR("Response header too long");
+            status = EXIT_FAILURE;
+            goto failed;
+        }
+    } while(!strstr(response->data, EOH));
+
+    response->actualLen = headerReceived;
+
+    parseStart = epicsMonotonicGet();
+    status = parseHeader(response);
+    response->parseTime += epicsMonotonicGet() - parseStart;
+    if(status)
+    {
+        ERROR("Failed to parseHeader");
+        goto failed;
     }
 
-    ret = select(s->fd+1, &fds, NULL, NULL, pRecvTimeout);
-    if(ret <= 0)
+    if(response->contentLength > MAX_CONTENT_LENGTH)
     {
-        std::string error = ret ? "select() failed" : "Timed out";
-        ERROR(error);
+        ERROR("Content-Length " << response->contentLength << " exceeds "
+              << MAX_CONTENT_LENGTH);
         status = EXIT_FAILURE;
-        goto end;
+        goto failed;
     }
 
-    if((received = recv(s->fd, response->data, response->dataLen, 0) <= 0))
+    if(response->chunked)
     {
-        if(s->retries++ < MAX_HTTP_RETRIES)
-            goto retry;
-        else
+        if(readChunked(s, response, headerReceived - response->headerLen, timeout))
         {
-            ERROR("Failed to recv");
+            ERROR("Failed to read chunked content");
             status = EXIT_FAILURE;
-            goto end;
+            goto failed;
         }
+        goto received;
     }
 
-    response->actualLen = (size_t) received;
-    response->data[MAX_MESSAGE_SIZE] = 0; // add null character at end
+    // The content goes straight to the body string, sized once so that it
+    // doesn't move, and is tokenized as it arrives if asked to
+    contentReceived = std::min(headerReceived - response->headerLen, response->contentLength);
+    response->body->resize(response->contentLength);
+    if(contentReceived)
+        memcpy(&(*response->body)[0], response->content, contentReceived);
+    if(response->arena)
+    {
+        parseStart = epicsMonotonicGet();
+        response->arena->begin(response->body->c_str());
+        response->arena->feed(contentReceived);
+        response->parseTime += epicsMonotonicGet() - parseStart;
+    }
 
-    if((status = parseHeader(response)))
+    while(contentReceived < response->contentLength)
     {
-        ERROR("Failed to parseHeader");
-        goto end;
+        if(waitReadable(s, timeout))
+        {
+            status = EXIT_FAILURE;
+            goto failed;
+        }
+
+        received = recv(s->fd, &(*response->body)[contentReceived],
+                        response->contentLength - contentReceived, 0);
+        if(received <= 0)
+        {
+            ERROR("Failed to recv content");
+            status = EXIT_FAILURE;
+            goto failed;
+        }
+        contentReceived += (size_t) received;
+        if(response->arena)
+        {
+            parseStart = epicsMonotonicGet();
+            response->arena->feed(contentReceived);
+            response->parseTime += epicsMonotonicGet() - parseStart;
+        }
     }
+    response->content = response->contentLength ? &(*response->body)[0] : NULL;
 
+received:
     if(response->reconnect)
     {
         close(s->fd);
         s->closed = true;
     }
 
-    if (response->contentLength > MAX_MESSAGE_SIZE) {
-        // We stored MAX_MESSAGE_SIZE bytes into our buffer and the rest could not fit
-        // The buffer contents will be malformed by an abrupt cut-off and will not be parseable
-        status = EXIT_FAILURE;
-        goto end;
-    }
-
     // We successfully completed a request, so connection to server must be OK
     // Clear any errors so they are printed again if the reoccur
-    mErrorFilter->clearErrors();
+    {
+        unsigned long suppressed = mErrorFilter->clearErrors();
+        if(suppressed)
+            printError(functionName, "Recovered", suppressed);
+    }
 
 end:
-    s->retries = 0;
-    s->mutex.unlock();
     return status;
 
+failed:
+    // Whatever is left of the response can't be told from the next one
+    epicsSocketDestroy(s->fd);
+    s->closed = true;
+    goto end;
+
 retry:
     close(s->fd);
     s->closed = true;
-    s->mutex.unlock();
-    return doRequest(request, response, timeout);
+    retry = true;
+    return EXIT_FAILURE;
 }
 
 int RestAPI::parseHeader (response_t *response)
@@ -326,6 +477,7 @@ int RestAPI::parseHeader (response_t *response)
 
     response->contentLength = 0;
     response->reconnect = false;
+    response->chunked = false;
 
     scanned = sscanf(data, "%*s %d", &response->code);
     if(scanned != 1)
@@ -359,6 +511,13 @@ int RestAPI::parseHeader (response_t *response)
             response->reconnect = !strcasecmp(value, "close");
             delete[] value;
         }
+        else if(!strcasecmp(key, "transfer-encoding"))
+        {
+            char* value = new char[MAX_BUF_SIZE];
+            sscanf(colon + 1, "%s", value);
+            response->chunked = !strcasecmp(value, "chunked");
+            delete[] value;
+        }
 
         data = eol + EOL_LEN;
         eol = strstr(data, EOL);
@@ -373,14 +532,152 @@ int RestAPI::parseHeader (response_t *response)
     return EXIT_SUCCESS;
 }
 
-int RestAPI::put (std::string subSystem, string const & param,
+// Chunked content, of which received bytes came with the header, decoded
+// into the body. Its size isn't known until the last chunk, so it is only
+// tokenized once complete. response->data is reused to receive the rest
+int RestAPI::readChunked (socket_t *s, response_t *response, size_t received, int timeout)
+{
+    const char *functionName = "readChunked";
+    string raw(response->content, received);
+    size_t pos = 0;
+    bool trailer = false;
+    epicsUInt64 parseStart;
+
+    response->body->clear();
+    for(;;)
+    {
+        // A chunk is taken once it is whole: its size line, data and EOL.
+        // Trailer lines follow the last, empty, chunk up to an empty line
+        size_t eol = raw.find(EOL, pos);
+        bool taken = false;
+        if(eol != string::npos && trailer)
+        {
+            if(eol == pos)
+                break;
+            pos = eol + EOL_LEN;
+            taken = true;
+        }
+        else if(eol != string::npos)
+        {
+            // chunk-size [ chunk-ext ] CRLF
+            const char *sizeStart = raw.c_str() + pos;
+            char *sizeEnd;
+            errno = 0;
+            unsigned long size = strtoul(sizeStart, &sizeEnd, 16);
+            if(sizeEnd == sizeStart || !isxdigit(*sizeStart) || errno == ERANGE ||
+               (*sizeEnd != ';' && *sizeEnd != ' ' && *sizeEnd != '\t' && *sizeEnd != '\r'))
+            {
+                ERROR("Malformed chunk header");
+                return EXIT_FAILURE;
+            }
+
+            if(size > MAX_CONTENT_LENGTH - response->body->size())
+            {
+                ERROR("Chunked body exceeds " << MAX_CONTENT_LENGTH);
+                return EXIT_FAILURE;
+            }
+
+            if(!size)
+            {
+                pos = eol + EOL_LEN;
+                trailer = taken = true;
+            }
+            else if(raw.size() >= eol + EOL_LEN + size + EOL_LEN)
+            {
+                if(raw.compare(eol + EOL_LEN + size, EOL_LEN, EOL))
+                {
+                    ERROR("Chunk not terminated by EOL");
+                    return EXIT_FAILURE;
+                }
+                response->body->append(raw, eol + EOL_LEN, size);
+                raw.erase(0, eol + EOL_LEN + size + EOL_LEN);
+                pos = 0;
+                taken = true;
+            }
+        }
+
+        if(!taken)
+        {
+            // Only the chunk being received is held, and no chunk may be
+            // larger than the largest body
+            if(raw.size() > MAX_CONTENT_LENGTH + MAX_MESSAGE_SIZE)
+            {
+                ERROR("Chunked body exceeds " << MAX_CONTENT_LENGTH);
+                return EXIT_FAILURE;
+            }
+            if(waitReadable(s, timeout))
+                return EXIT_FAILURE;
+            int len = recv(s->fd, response->data, response->dataLen, 0);
+            if(len <= 0)
+                return EXIT_FAILURE;
+            raw.append(response->data, len);
+        }
+    }
+
+    response->contentLength = response->body->size();
+    response->content = response->contentLength ? &(*response->body)[0] : NULL;
+    if(response->arena)
+    {
+        parseStart = epicsMonotonicGet();
+        response->arena->begin(response->body->c_str());
+        response->arena->feed(response->contentLength);
+        response->parseTime += epicsMonotonicGet() - parseStart;
+    }
+    return EXIT_SUCCESS;
+}
+
+void RestAPI::prepareEndpoint (rest_endpoint_t & endpoint)
+{
+    // Requests too long for the buffer are truncated, as they always were
+    std::vector<char> buffer(MAX_MESSAGE_SIZE);
+    int len = epicsSnprintf(&buffer[0], buffer.size(), REQUEST_GET,
+            endpoint.subSystem.c_str(), endpoint.param.c_str(), mHostname.c_str());
+    endpoint.getRequest.assign(&buffer[0], std::min(len, (int) buffer.size() - 1));
+    len = epicsSnprintf(&buffer[0], buffer.size(), REQUEST_PUT,
+            endpoint.subSystem.c_str(), endpoint.param.c_str(), mHostname.c_str());
+    endpoint.putRequest.assign(&buffer[0], std::min(len, (int) buffer.size() - 1));
+    endpoint.traceId = 0;
+    endpoint.stats = NULL;
+}
+
+const rest_endpoint_t *RestAPI::getEndpoint (string const & subSystem, string const & param)
+{
+    epicsGuard<epicsMutex> guard(mEndpointLock);
+    string path(subSystem + param);
+    rest_endpoint_map_t::iterator item(mEndpoints.find(path));
+    if(item != mEndpoints.end())
+        return item->second;
+
+    rest_endpoint_t *endpoint = new rest_endpoint_t;
+    endpoint->subSystem = subSystem;
+    endpoint->param = param;
+    prepareEndpoint(*endpoint);
+    std::stringstream name;
+    name << mHostname << ":" << mPort << path;
+    endpoint->traceId = restTraceEndpoint(name.str());
+    endpoint->stats = new RestRequestStats();
+    mEndpoints.insert(std::make_pair(path, endpoint));
+    return endpoint;
+}
+
+int RestAPI::put (string const & subSystem, string const & param,
         string const & value,string * reply, int timeout)
 {
-    int status = basePut(subSystem, param, value.c_str(), value.length(), reply, timeout);
+    rest_endpoint_t endpoint;
+    endpoint.subSystem = subSystem;
+    endpoint.param = param;
+    prepareEndpoint(endpoint);
+    int status = basePut(endpoint, value.c_str(), value.length(), reply, timeout);
     return status;
 }
 
-int RestAPI::put(std::string subSystem, const std::string & param,
+int RestAPI::put (const rest_endpoint_t *endpoint, string const & value, string * reply,
+        int timeout)
+{
+    return basePut(*endpoint, value.c_str(), value.length(), reply, timeout);
+}
+
+int RestAPI::put(string const & subSystem, const std::string & param,
                  const std::string & key, const std::string & value,
                  std::string * reply, int timeout)
 {
@@ -390,48 +687,77 @@ int RestAPI::put(std::string subSystem, const std::string & param,
   return rc;
 }
 
-int RestAPI::get(std::string subSystem, string const & param, string & value, int timeout)
+int RestAPI::get(string const & subSystem, string const & param, string & value, int timeout)
 {
+    rest_endpoint_t endpoint;
+    endpoint.subSystem = subSystem;
+    endpoint.param = param;
+    prepareEndpoint(endpoint);
+    return baseGet(endpoint, value, NULL, timeout);
+}
+
+int RestAPI::get(string const & subSystem, string const & param, string & value,
+                 JsonTokenArena & arena, int timeout)
+{
+    rest_endpoint_t endpoint;
+    endpoint.subSystem = subSystem;
+    endpoint.param = param;
+    prepareEndpoint(endpoint);
+    return baseGet(endpoint, value, &arena, timeout);
+}
+
+int RestAPI::get(const rest_endpoint_t *endpoint, string & value, int timeout)
+{
+    return baseGet(*endpoint, value, NULL, timeout);
+}
+
+int RestAPI::get(const rest_endpoint_t *endpoint, string & value, JsonTokenArena & arena,
+                 int timeout)
+{
+    return baseGet(*endpoint, value, &arena, timeout);
+}
+
+int RestAPI::baseGet(rest_endpoint_t const & endpoint, string & value,
+                     JsonTokenArena * arena, int timeout)
+{
+    REST_TRACE(REST_TRACE_REQUEST_START, endpoint.traceId);
+    epicsUInt64 start = epicsMonotonicGet();
     request_t request = {};
-    char* requestBuf = new char[MAX_MESSAGE_SIZE];
-    request.data = requestBuf;
-    request.dataLen = MAX_MESSAGE_SIZE;
-    request.actualLen = epicsSnprintf(request.data, request.dataLen,
-            REQUEST_GET, subSystem.c_str(), param.c_str(), mHostname.c_str());
+    request.data = endpoint.getRequest.data();
+    request.dataLen = endpoint.getRequest.size();
+    request.actualLen = request.dataLen;
+    request.traceId = endpoint.traceId;
 
     response_t response = {};
-    char* responseBuf = new char[MAX_MESSAGE_SIZE];
+    char* responseBuf = new char[MAX_MESSAGE_SIZE + 1];
     response.data = responseBuf;
     response.dataLen = MAX_MESSAGE_SIZE;
+    response.body = &value;
+    response.arena = arena;
 
-    if(doRequest(&request, &response, timeout))
-    {
-        delete[] requestBuf;
-        delete[] responseBuf;
-        return EXIT_FAILURE;
-    }
-
-    if(response.code != 200)
+    int status = EXIT_SUCCESS;
+    if(doRequest(&request, &response, timeout) || response.code != 200)
     {
-        delete[] requestBuf;
-        delete[] responseBuf;
-        return EXIT_FAILURE;
+        // Nothing to parse
+        value.clear();
+        if(arena)
+            arena->begin(value.c_str());
+        status = EXIT_FAILURE;
     }
+    recordRequest(endpoint, start, &request, &response, status != EXIT_SUCCESS);
 
-    value = string(response.content, response.contentLength);
-    delete[] requestBuf;
     delete[] responseBuf;
-    return EXIT_SUCCESS;
+    return status;
 }
 
-int RestAPI::basePut(std::string & subSystem, const std::string & param,
+int RestAPI::basePut(rest_endpoint_t const & endpoint,
                      const char * valueBuf, int valueLen, string * reply, int timeout)
 {
-  int headerLen;
-  char* header = new char[MAX_BUF_SIZE];
-  headerLen = epicsSnprintf(header, MAX_BUF_SIZE, REQUEST_PUT,
-                            subSystem.c_str(), param.c_str(), mHostname.c_str(),
-                            (size_t)valueLen);
+  REST_TRACE(REST_TRACE_REQUEST_START, endpoint.traceId);
+  epicsUInt64 start = epicsMonotonicGet();
+  char length[32];
+  int lengthLen = epicsSnprintf(length, sizeof(length), "%lu" EOH, (unsigned long) valueLen);
+  size_t headerLen = endpoint.putRequest.size() + lengthLen;
 
   request_t request = {};
   char* requestBuf = new char[headerLen + valueLen];
@@ -439,21 +765,26 @@ int RestAPI::basePut(std::string & subSystem, const std::string & param,
   request.data      = requestBuf;
   request.dataLen   = headerLen + valueLen;
   request.actualLen = request.dataLen;
+  request.traceId   = endpoint.traceId;
 
   response_t response = {};
-  char* responseBuf = new char[MAX_MESSAGE_SIZE];
+  char* responseBuf = new char[MAX_MESSAGE_SIZE + 1];
+  string content;
 
   response.data    = responseBuf;
   response.dataLen = MAX_MESSAGE_SIZE;
+  response.body    = reply ? reply : &content;
 
-  memcpy(request.data, header, headerLen);
-  memcpy(request.data + headerLen, valueBuf, valueLen);
+  memcpy(requestBuf, endpoint.putRequest.data(), endpoint.putRequest.size());
+  memcpy(requestBuf + endpoint.putRequest.size(), length, lengthLen);
+  memcpy(requestBuf + headerLen, valueBuf, valueLen);
 
-  if(doRequest(&request, &response, timeout))
+  int status = doRequest(&request, &response, timeout);
+  recordRequest(endpoint, start, &request, &response, status || response.code != 200);
+  if(status)
   {
     delete[] responseBuf;
     delete[] requestBuf;
-    delete[] header;
     return EXIT_FAILURE;
   }
 
@@ -461,25 +792,39 @@ int RestAPI::basePut(std::string & subSystem, const std::string & param,
   {
     delete[] responseBuf;
     delete[] requestBuf;
-    delete[] header;
     return EXIT_FAILURE;
   }
 
-  if(reply)
-    *reply = string(response.content, response.contentLength);
   delete[] responseBuf;
   delete[] requestBuf;
-  delete[] header;
 
   return EXIT_SUCCESS;
 }
 
-void RestAPI::setError(const char* functionName, std::string error)
+// The time up to the checkout is spent waiting for a socket, the rest,
+// less parsing, on the network
+void RestAPI::recordRequest(rest_endpoint_t const & endpoint, epicsUInt64 start,
+                            const request_t *request, const response_t *response, bool error)
 {
-  std::stringstream errorMessage;
-  errorMessage << "RestAPI::" << functionName << ": " << error << "\n";
+  epicsUInt64 end = epicsMonotonicGet();
+  epicsUInt64 checkout = response->checkoutTime ? response->checkoutTime - start : end - start;
+  epicsUInt64 network = end - start - checkout;
+  epicsUInt64 parse = std::min(response->parseTime, network);
+  network -= parse;
+  size_t bytes = request->actualLen + response->headerLen + response->contentLength;
+
+  if(endpoint.stats)
+    endpoint.stats->record(checkout, network, parse, bytes, error);
+  mHostStats.record(checkout, network, parse, bytes, error);
+}
 
-  if (mErrorFilter->newError(errorMessage.str())) {
-    fprintf(stderr, errorMessage.str().c_str());
+void RestAPI::printError(const char* functionName, std::string const & error,
+                         unsigned long suppressed)
+{
+  if (suppressed) {
+    fprintf(stderr, "RestAPI::%s: %s (%lu repeats suppressed)\n", functionName,
+            error.c_str(), suppressed);
+  } else {
+    fprintf(stderr, "RestAPI::%s: %s\n", functionName, error.c_str());
   }
 }
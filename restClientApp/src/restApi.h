@@ -2,11 +2,15 @@
 #define REST_API_H
 
 #include <string>
+#include <map>
 #include <epicsMutex.h>
+#include <epicsTypes.h>
 #include <osiSock.h>
 
 #include "restDefinitions.h"
 #include "errorFilter.h"
+#include "jsonTokenArena.h"
+#include "restStats.h"
 
 #define DEFAULT_TIMEOUT     20      // seconds
 
@@ -21,20 +25,44 @@ typedef struct socket
 
 typedef struct request
 {
-  char *data;
+  const char *data;
   size_t dataLen, actualLen;
+  epicsUInt32 traceId;
 } request_t;
 
+// data holds the header, body receives the content (which content then
+// points to), tokenized by arena as it arrives if set (once complete, for
+// chunked content). checkoutTime is when
+// the socket was taken and parseTime the ns spent parsing it (both from
+// epicsMonotonicGet)
 typedef struct response
 {
   char *data;
   size_t dataLen, actualLen, headerLen;
-  bool reconnect;
+  bool reconnect, chunked;
   char *content;
   size_t contentLength;
   int code;
+  std::string *body;
+  JsonTokenArena *arena;
+  epicsUInt64 checkoutTime, parseTime;
 } response_t;
 
+// A parameter's URL with the parts of its requests that never change,
+// formatted once: the whole GET request and the PUT request up to the value
+// of its Content-Length header. traceId tags its trace events and stats
+// records its requests (0 and NULL for the endpoints of the string versions
+// of get and put)
+typedef struct endpoint
+{
+  std::string subSystem, param;
+  std::string getRequest, putRequest;
+  epicsUInt32 traceId;
+  RestRequestStats *stats;
+} rest_endpoint_t;
+
+typedef std::map<std::string, rest_endpoint_t*> rest_endpoint_map_t;
+
 class RestAPI : ErrorFilter
 {
 protected:
@@ -43,13 +71,20 @@ protected:
     struct sockaddr_in mAddress;
     size_t mNumSockets;
     socket_t *mSockets;
+    rest_endpoint_map_t mEndpoints;
+    epicsMutex mEndpointLock;
+    RestRequestStats mHostStats;
 
     int connectedSockets();
     int connect (socket_t *s);
     int setNonBlock (socket_t *s, bool nonBlock);
+    int waitReadable (socket_t *s, int timeout);
 
     int doRequest (const request_t *request, response_t *response, int timeout = DEFAULT_TIMEOUT);
+    int exchange (socket_t *s, const request_t *request, response_t *response, int timeout,
+                  bool & retry);
     int parseHeader (response_t *response);
+    int readChunked (socket_t *s, response_t *response, size_t received, int timeout);
 
 public:
     static const std::string PARAM_VALUE;
@@ -63,13 +98,33 @@ public:
     RestAPI (std::string const & hostname, int port = 80, size_t numSockets=5);
     ~RestAPI();
 
-    int get (std::string subSystem, std::string const & param, std::string & value, int timeout = DEFAULT_TIMEOUT);
+    // Requests beyond this many at once fail
+    size_t getNumSockets (void);
+
+    // Every request to the host, whichever endpoint it went through
+    RestRequestStats & getHostStats (void);
+
+    // The endpoint of a parameter, created on first use and kept, unchanged,
+    // for the lifetime of the RestAPI: requests through it only send the
+    // prepared text, where the string versions format a request each time
+    const rest_endpoint_t *getEndpoint (std::string const & subSystem, std::string const & param);
+
+    int get (std::string const & subSystem, std::string const & param, std::string & value, int timeout = DEFAULT_TIMEOUT);
+    // The same, tokenizing the value into arena while it is received. Finish
+    // with arena.end(value.size()), whether the request succeeded or not
+    int get (std::string const & subSystem, std::string const & param, std::string & value,
+             JsonTokenArena & arena, int timeout = DEFAULT_TIMEOUT);
+    int get (const rest_endpoint_t *endpoint, std::string & value, int timeout = DEFAULT_TIMEOUT);
+    int get (const rest_endpoint_t *endpoint, std::string & value, JsonTokenArena & arena,
+             int timeout = DEFAULT_TIMEOUT);
     // Put with just value -> Payload: <value>
-    int put(std::string sys, const std::string & param,
+    int put(std::string const & sys, const std::string & param,
             const std::string & value = "",
             std::string * reply = NULL, int timeout = DEFAULT_TIMEOUT);
+    int put(const rest_endpoint_t *endpoint, const std::string & value,
+            std::string * reply = NULL, int timeout = DEFAULT_TIMEOUT);
     // Put with key and value -> Payload: {<key>: <value>}
-    int put(std::string sys, const std::string & param,
+    int put(std::string const & sys, const std::string & param,
             const std::string & key, const std::string & value,
             std::string * reply = NULL, int timeout = DEFAULT_TIMEOUT);
 
@@ -77,11 +132,17 @@ public:
           std::string subSystem, rest_access_mode_t &accessMode) = 0;
 
  private:
-  int basePut(std::string &subSystem, std::string const & param,
+  void prepareEndpoint(rest_endpoint_t & endpoint);
+  int baseGet(rest_endpoint_t const & endpoint, std::string & value,
+              JsonTokenArena * arena, int timeout);
+  int basePut(rest_endpoint_t const & endpoint,
               const char * valueBuf, int valueLen,
               std::string * reply = NULL, int timeout = DEFAULT_TIMEOUT);
+  void recordRequest(rest_endpoint_t const & endpoint, epicsUInt64 start,
+                     const request_t *request, const response_t *response, bool error);
 
   ErrorFilter* mErrorFilter;
-  void setError(const char* functionName, std::string error);
+  void printError(const char* functionName, std::string const & error,
+                  unsigned long suppressed);
 };
 #endif
@@ -0,0 +1,1479 @@
+// Benchmarks for the restClient library, run against a MockRestServer on the
+// loopback interface. Each benchmark prints one JSON object per line.
+//
+// Usage: restClientBench [benchmark ...]
+// With no arguments every benchmark is run.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <time.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <frozen.h>
+
+#include "restApi.h"
+#include "restParam.h"
+#include "typedRestParam.h"
+#include "jsonTokenArena.h"
+#include "jsonTokenizer.h"
+#include "jsonNumber.h"
+#include "jsonDict.h"
+#include "jsonWriter.h"
+#include "restStringIndex.h"
+#include "errorFilter.h"
+#include "restTrace.h"
+#include "restStats.h"
+#include "mockRestServer.h"
+
+static double elapsedSince (epicsUInt64 start)
+{
+    return (epicsMonotonicGet() - start) * 1e-9;
+}
+
+// Ramp a write-behind setpoint much faster than the server can answer and
+// compare the number of PUTs sent with the number requested
+static void benchWriteBehind (void)
+{
+    const int requested = 500;
+    const char *ports[] = {"BENCH_WB_OFF", "BENCH_WB_ON"};
+
+    for (int writeBehind = 0; writeBehind < 2; ++writeBehind) {
+        MockRestServer server;
+        server.addParam("/api/", "setpoint", "0");
+        server.setLatency(0.002);
+
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver(ports[writeBehind]);
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        RestParam *setpoint = set.create("SETPOINT", REST_P_DOUBLE, "/api/", "setpoint");
+        setpoint->setWriteBehind(writeBehind);
+
+        driver.lock();
+        setpoint->fetch();
+        driver.unlock();
+        unsigned long putsBefore = server.getPuts();
+
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 1; i <= requested; ++i) {
+            driver.lock();
+            setpoint->put((double) i);
+            driver.unlock();
+            epicsThreadSleep(0.0001);
+        }
+        double rampTime = elapsedSince(start);
+
+        driver.lock();
+        int status = setpoint->flushWrite();
+        driver.unlock();
+        double totalTime = elapsedSince(start);
+
+        printf("{\"benchmark\": \"writeBehind\", \"writeBehind\": %s, "
+               "\"putsRequested\": %d, \"putsSent\": %lu, \"rampSeconds\": %.4f, "
+               "\"totalSeconds\": %.4f, \"finalValue\": %s, \"finalStatus\": %d}\n",
+               writeBehind ? "true" : "false", requested, server.getPuts() - putsBefore,
+               rampTime, totalTime, server.getValue("/api/setpoint").c_str(), status);
+    }
+}
+
+// A document of about the given number of tokens: a flat list of numbers,
+// or an object of numbers keyed by name (two tokens per entry)
+static std::string makeDocument (size_t tokens, bool object)
+{
+    std::string document(object ? "{" : "[");
+    char item[64];
+    size_t entries = object ? tokens / 2 : tokens - 1;
+    for (size_t i = 0; i < entries; ++i) {
+        if (object)
+            epicsSnprintf(item, sizeof(item), "%s\"p%lu\": %lu", i ? ", " : "",
+                          (unsigned long) i, (unsigned long) i);
+        else
+            epicsSnprintf(item, sizeof(item), "%s%lu", i ? ", " : "", (unsigned long) i);
+        document += item;
+    }
+    document += object ? "}" : "]";
+    return document;
+}
+
+// Tokenize documents well past the default arena capacity: into a warm
+// arena, into a new arena each time (growth included) and with parse_json2
+static void benchTokenize (void)
+{
+    const size_t sizes[] = {1000, 10000, 100000};
+
+    for (int object = 0; object < 2; ++object) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            std::string document = makeDocument(sizes[i], object);
+            int repeats = (int) (2000000 / sizes[i]);
+
+            JsonTokenArena arena;
+            arena.parse(document);
+            int tokens = arena.getTokens()[0].num_desc + 1;
+            epicsUInt64 start = epicsMonotonicGet();
+            for (int r = 0; r < repeats; ++r)
+                arena.parse(document);
+            double warm = elapsedSince(start) / repeats;
+
+            start = epicsMonotonicGet();
+            for (int r = 0; r < repeats; ++r) {
+                JsonTokenArena cold;
+                cold.parse(document);
+            }
+            double cold = elapsedSince(start) / repeats;
+
+            start = epicsMonotonicGet();
+            for (int r = 0; r < repeats; ++r)
+                free(parse_json2(document.c_str(), document.size()));
+            double realloc = elapsedSince(start) / repeats;
+
+            printf("{\"benchmark\": \"tokenize\", \"document\": \"%s\", \"tokens\": %d, "
+                   "\"bytes\": %lu, \"warmArenaUs\": %.2f, \"coldArenaUs\": %.2f, "
+                   "\"parseJson2Us\": %.2f, \"warmNsPerToken\": %.2f}\n",
+                   object ? "object" : "array", tokens, (unsigned long) document.size(),
+                   warm * 1e6, cold * 1e6, realloc * 1e6, warm * 1e9 / tokens);
+        }
+    }
+}
+
+// Pull every parameter out of a subsystem tree document, as the hashed
+// index does (index build included) and as find_json_token does
+static void benchKeyLookup (void)
+{
+    const size_t sizes[] = {10, 100, 1000};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        std::string document = "{\"detector\": {\"config\": " + makeDocument(2 * sizes[i], true) + "}}";
+        std::vector<std::string> paths;
+        char path[64];
+        for (size_t p = 0; p < sizes[i]; ++p) {
+            epicsSnprintf(path, sizeof(path), "detector.config.p%lu", (unsigned long) p);
+            paths.push_back(path);
+        }
+        int repeats = (int) (200000 / sizes[i]);
+        bool found = true;
+
+        JsonTokenArena arena;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r) {
+            arena.parse(document);
+            for (size_t p = 0; p < paths.size(); ++p)
+                found = found && arena.find(paths[p]);
+        }
+        double indexed = elapsedSince(start) / repeats;
+
+        start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r) {
+            arena.parse(document);
+            for (size_t p = 0; p < paths.size(); ++p)
+                found = found && find_json_token(arena.getTokens(), paths[p].c_str());
+        }
+        double linear = elapsedSince(start) / repeats;
+
+        printf("{\"benchmark\": \"keyLookup\", \"params\": %lu, \"indexedUs\": %.2f, "
+               "\"findJsonTokenUs\": %.2f, \"found\": %s}\n",
+               (unsigned long) sizes[i], indexed * 1e6, linear * 1e6, found ? "true" : "false");
+    }
+}
+
+// A response shaped like a detector configuration subsystem
+static std::string makeConfigResponse (size_t params)
+{
+    std::string document("{");
+    char item[160];
+    for (size_t i = 0; i < params; ++i) {
+        epicsSnprintf(item, sizeof(item),
+                "%s\n  \"param_%lu\": {\"value\": %g, \"value_type\": \"float\", "
+                "\"access_mode\": \"rw\", \"min\": 0, \"max\": 1e6, \"enabled\": %s}",
+                i ? "," : "", (unsigned long) i, i * 0.125, i % 2 ? "true" : "false");
+        document += item;
+    }
+    return document + "\n}";
+}
+
+// A waveform-like array of doubles
+static std::string makeWaveformResponse (size_t points)
+{
+    std::string document("[");
+    char item[32];
+    for (size_t i = 0; i < points; ++i) {
+        epicsSnprintf(item, sizeof(item), "%s%.6f", i ? ", " : "", (i % 1000) * 0.001 - 0.5);
+        document += item;
+    }
+    return document + "]";
+}
+
+static bool readFile (const char *path, std::string & contents)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, n);
+    fclose(file);
+    return true;
+}
+
+// Throughput of JsonTokenizer against frozen's parse_json. Captured responses
+// can be added with RESTCLIENT_BENCH_JSON=file1:file2:...
+static void benchTokenizer (void)
+{
+    std::vector<std::string> names, documents;
+    names.push_back("parameter");
+    documents.push_back("{\"value\": 1250.5, \"value_type\": \"float\", \"access_mode\": \"rw\"}");
+    names.push_back("config1k");
+    documents.push_back(makeConfigResponse(1000));
+    names.push_back("waveform100k");
+    documents.push_back(makeWaveformResponse(100000));
+
+    const char *files = getenv("RESTCLIENT_BENCH_JSON");
+    if (files) {
+        std::string list(files);
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t end = list.find(':', start);
+            std::string path(list, start, end == std::string::npos ? std::string::npos : end - start);
+            std::string contents;
+            if (!path.empty() && readFile(path.c_str(), contents)) {
+                names.push_back(path);
+                documents.push_back(contents);
+            }
+            start = end == std::string::npos ? list.size() + 1 : end + 1;
+        }
+    }
+
+    for (size_t i = 0; i < documents.size(); ++i) {
+        std::string const & document = documents[i];
+        int len = (int) document.size();
+        std::vector<struct json_token> tokens(len + 1);
+        int repeats = (int) std::max((size_t) 20, (size_t) 200000000 / (document.size() * 20));
+        JsonTokenizer tokenizer;
+        int needed, result = 0;
+
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r)
+            result |= parse_json(document.c_str(), len, &tokens[0], len + 1);
+        double frozen = elapsedSince(start) / repeats;
+
+        start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r)
+            result |= tokenizer.parse(document.c_str(), len, &tokens[0], len + 1, needed);
+        double simd = elapsedSince(start) / repeats;
+
+        printf("{\"benchmark\": \"tokenizer\", \"document\": \"%s\", \"bytes\": %d, "
+               "\"parseJsonGBps\": %.3f, \"tokenizerGBps\": %.3f, \"speedup\": %.2f, "
+               "\"fallbacks\": %lu, \"ok\": %s}\n",
+               names[i].c_str(), len, len / frozen * 1e-9, len / simd * 1e-9, frozen / simd,
+               tokenizer.getFallbacks(), result < 0 ? "false" : "true");
+    }
+}
+
+// Decode a tokenized numeric array the way array fetches used to, through
+// a string per element and sscanf, and straight from the tokens
+static void benchArrayDecode (void)
+{
+    const size_t sizes[] = {1000, 100000};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        std::string document = makeWaveformResponse(sizes[i]);
+        JsonTokenArena arena;
+        arena.parse(document);
+        struct json_token *array = arena.getTokens();
+        int repeats = (int) std::max((size_t) 5, (size_t) 5000000 / sizes[i]);
+        std::vector<double> values(sizes[i]);
+        double sum = 0.0;
+
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r) {
+            std::vector<std::string> rawValues;
+            for (size_t e = 0; e < jsonArraySize(array); ++e) {
+                struct json_token *element = jsonArrayElement(array, e);
+                rawValues.push_back(std::string(element->ptr, element->len));
+            }
+            for (size_t e = 0; e < rawValues.size(); ++e)
+                sscanf(rawValues[e].c_str(), "%lf", &values[e]);
+            sum += values[0];
+        }
+        double strings = elapsedSince(start) / repeats;
+
+        start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r) {
+            for (size_t e = 0; e < jsonArraySize(array); ++e)
+                parseJsonNumber(jsonArrayElement(array, e), values[e]);
+            sum += values[0];
+        }
+        double direct = elapsedSince(start) / repeats;
+
+        printf("{\"benchmark\": \"arrayDecode\", \"elements\": %lu, \"stringSscanfUs\": %.2f, "
+               "\"directUs\": %.2f, \"speedup\": %.2f, \"checksum\": %g}\n",
+               (unsigned long) sizes[i], strings * 1e6, direct * 1e6, strings / direct, sum);
+    }
+}
+
+// Fetch a whole integer array parameter from the mock server
+static void benchArrayFetch (void)
+{
+    const int elements = 1000, repeats = 200;
+    std::vector<std::string> values;
+    for (int i = 0; i < elements; ++i)
+        values.push_back(i % 2 ? "1" : "0");
+
+    MockRestServer server;
+    server.addArray("/api/", "mask", values);
+    MockRestAPI api(server.getPort());
+    MockPortDriver driver("BENCH_ARRAY", elements);
+    RestParamSet set(&driver, &api, driver.pasynUserSelf);
+    RestParam *mask = set.create("MASK", REST_P_INT, "/api/", "mask", elements);
+
+    std::vector<int> value;
+    int failed = 0;
+    driver.lock();
+    mask->fetch(value);
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r) {
+        std::vector<int> status = mask->fetch(value);
+        failed += std::count(status.begin(), status.end(), 1);
+    }
+    double fetch = elapsedSince(start) / repeats;
+    driver.unlock();
+
+    printf("{\"benchmark\": \"arrayFetch\", \"elements\": %d, \"fetchUs\": %.2f, "
+           "\"failedElements\": %d}\n", elements, fetch * 1e6, failed);
+}
+
+// GET a waveform and tokenize it once received, or while it is received,
+// from a server sending as fast as it can and at about 1 Gbit/s
+static void benchStreamingGet (void)
+{
+    const size_t sizes[] = {1000, 100000, 1000000};
+    const double bandwidths[] = {0.0, 125e6};
+
+    for (size_t n = 0; n < sizeof(sizes) * 2 / sizeof(sizes[0]); ++n) {
+        size_t i = n / 2;
+        double bandwidth = bandwidths[n % 2];
+        std::vector<std::string> values;
+        char value[32];
+        for (size_t v = 0; v < sizes[i]; ++v) {
+            epicsSnprintf(value, sizeof(value), "%.6f", (v % 1000) * 0.001 - 0.5);
+            values.push_back(value);
+        }
+        MockRestServer server;
+        server.addArray("/api/", "waveform", values);
+        server.setBandwidth(bandwidth);
+        MockRestAPI api(server.getPort());
+        JsonTokenArena arena;
+        std::string body;
+        int repeats = (int) std::max((size_t) 10, (size_t) 2000000 / sizes[i]);
+        int failed = 0;
+
+        api.get("/api/", "waveform", body, arena);
+        arena.end(body.size());
+
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r) {
+            api.get("/api/", "waveform", body);
+            failed += arena.parse(body) < 0;
+        }
+        double afterwards = elapsedSince(start) / repeats;
+
+        start = epicsMonotonicGet();
+        for (int r = 0; r < repeats; ++r) {
+            api.get("/api/", "waveform", body, arena);
+            failed += arena.end(body.size()) < 0;
+        }
+        double streaming = elapsedSince(start) / repeats;
+
+        printf("{\"benchmark\": \"streamingGet\", \"elements\": %lu, \"bytes\": %lu, "
+               "\"bandwidthMBps\": %.0f, \"parseAfterUs\": %.2f, \"streamingUs\": %.2f, "
+               "\"failed\": %d}\n",
+               (unsigned long) sizes[i], (unsigned long) body.size(), bandwidth * 1e-6,
+               afterwards * 1e6, streaming * 1e6, failed);
+    }
+}
+
+// Number parsing and formatting, previous implementation against the codec
+static void benchNumberCodec (void)
+{
+    const int count = 100000;
+    std::vector<double> doubles(count);
+    std::vector<std::string> texts(count), intTexts(count);
+    char text[64];
+    for (int i = 0; i < count; ++i) {
+        doubles[i] = (i % 2 ? 1e-3 : 1e3) * ((i * 7919) % 100003) / 7.0;
+        epicsSnprintf(text, sizeof(text), "%.17g", doubles[i]);
+        texts[i] = text;
+        epicsSnprintf(text, sizeof(text), "%d", i * 7919 - 400000);
+        intTexts[i] = text;
+    }
+    double sum = 0.0;
+    size_t length = 0;
+
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        double value;
+        sscanf(texts[i].c_str(), "%lf", &value);
+        sum += value;
+    }
+    double sscanfDouble = elapsedSince(start) / count;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        double value;
+        parseNumber(texts[i], value);
+        sum += value;
+    }
+    double parseDouble = elapsedSince(start) / count;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        int value;
+        sscanf(intTexts[i].c_str(), "%d", &value);
+        sum += value;
+    }
+    double sscanfInt = elapsedSince(start) / count;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        int value;
+        parseNumber(intTexts[i], value);
+        sum += value;
+    }
+    double parseInt = elapsedSince(start) / count;
+
+    size_t streamLength = 0;
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        std::ostringstream os;
+        os << std::setprecision(std::numeric_limits<long double>::digits10 + 2) << doubles[i];
+        streamLength += os.str().size();
+    }
+    double streamDouble = elapsedSince(start) / count;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i)
+        length += formatNumber(doubles[i]).size();
+    double formatDouble = elapsedSince(start) / count;
+
+    printf("{\"benchmark\": \"numberCodec\", \"sscanfDoubleNs\": %.1f, \"parseDoubleNs\": %.1f, "
+           "\"sscanfIntNs\": %.1f, \"parseIntNs\": %.1f, \"ostreamDoubleNs\": %.1f, "
+           "\"formatDoubleNs\": %.1f, \"ostreamChars\": %.2f, \"formatChars\": %.2f, "
+           "\"checksum\": %g}\n",
+           sscanfDouble * 1e9, parseDouble * 1e9, sscanfInt * 1e9, parseInt * 1e9,
+           streamDouble * 1e9, formatDouble * 1e9, (double) streamLength / count,
+           (double) length / count, sum);
+}
+
+// Build a PUT body of mixed parameters the way JsonDict used to (a
+// stringstream per value and per level), through JsonDict and straight into
+// a reused buffer; then escape a long string a character at a time and with
+// JsonWriter::escape
+static void benchJsonWriter (void)
+{
+    const int fields = 32, count = 20000;
+    std::vector<std::string> keys(fields), strings(fields);
+    char text[64];
+    for (int f = 0; f < fields; ++f) {
+        epicsSnprintf(text, sizeof(text), "parameter_%d", f);
+        keys[f] = text;
+        epicsSnprintf(text, sizeof(text), "C:\\data\\run_%d \"final\"", f);
+        strings[f] = text;
+    }
+    size_t length = 0;
+
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        std::stringstream dict;
+        for (int f = 0; f < fields; ++f) {
+            std::stringstream key, value;
+            key << "\"" << keys[f] << "\"";
+            if (f % 3 == 0)
+                value << "\"" << strings[f] << "\"";
+            else if (f % 3 == 1)
+                value << formatNumber(f * 0.125 + i);
+            else
+                value << formatNumber(f + i);
+            dict << key.str() << ": " << value.str();
+            if (f < fields - 1)
+                dict << ", ";
+        }
+        std::stringstream object;
+        object << "{" << dict.str() << "}";
+        length += object.str().size();
+    }
+    double stream = elapsedSince(start) / count;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        std::vector<JsonDict> dicts;
+        for (int f = 0; f < fields; ++f) {
+            if (f % 3 == 0)
+                dicts.push_back(JsonDict(keys[f], strings[f].c_str()));
+            else if (f % 3 == 1)
+                dicts.push_back(JsonDict(keys[f], f * 0.125 + i));
+            else
+                dicts.push_back(JsonDict(keys[f], f + i));
+        }
+        length += JsonDict(dicts).str().size();
+    }
+    double dict = elapsedSince(start) / count;
+
+    std::string buffer;
+    start = epicsMonotonicGet();
+    for (int i = 0; i < count; ++i) {
+        buffer.clear();
+        JsonWriter writer(buffer);
+        writer.beginObject();
+        for (int f = 0; f < fields; ++f) {
+            writer.key(keys[f]);
+            if (f % 3 == 0)
+                writer.value(strings[f]);
+            else if (f % 3 == 1)
+                writer.value(f * 0.125 + i);
+            else
+                writer.value(f + i);
+        }
+        writer.endObject();
+        length += buffer.size();
+    }
+    double writer = elapsedSince(start) / count;
+
+    // Mostly plain text with an escape every 100 or so characters
+    std::string value(1 << 20, 'x');
+    for (size_t c = 0; c < value.size(); c += 97)
+        value[c] = c % 2 ? '"' : '\n';
+    const int repeats = 50;
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r) {
+        buffer.clear();
+        for (size_t c = 0; c < value.size(); ++c) {
+            if (value[c] == '"' || value[c] == '\\')
+                buffer += '\\';
+            else if (value[c] == '\n') {
+                buffer += "\\n";
+                continue;
+            }
+            buffer += value[c];
+        }
+    }
+    double perChar = elapsedSince(start) / repeats;
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r) {
+        buffer.clear();
+        JsonWriter::escape(buffer, value.data(), value.size());
+    }
+    double escape = elapsedSince(start) / repeats;
+
+    printf("{\"benchmark\": \"jsonWriter\", \"fields\": %d, \"stringstreamUs\": %.2f, "
+           "\"jsonDictUs\": %.2f, \"writerUs\": %.2f, \"perCharEscapeMBps\": %.0f, "
+           "\"escapeMBps\": %.0f, \"chars\": %lu}\n",
+           fields, stream * 1e6, dict * 1e6, writer * 1e6,
+           value.size() / perChar * 1e-6, value.size() / escape * 1e-6,
+           (unsigned long) length / (3 * count));
+}
+
+// Initialise 500 parameters from a server answering after 1 ms, by fetching
+// each as at startup without a cache, and by loading the metadata cache
+static void benchMetadataCache (void)
+{
+    const int count = 500;
+    const char *path = "restClientBench.metadata";
+    MockRestServer server;
+    char name[32];
+    for (int i = 0; i < count; ++i) {
+        epicsSnprintf(name, sizeof(name), "param%d", i);
+        server.addParam("/api/", name, "1.5");
+    }
+    server.setLatency(1e-3);
+    MockRestAPI api(server.getPort());
+    const char *ports[] = {"BENCH_META_FETCH", "BENCH_META_LOAD"};
+    double elapsed[2];
+    int failed = 0;
+
+    for (int mode = 0; mode < 2; ++mode) {
+        MockPortDriver driver(ports[mode]);
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        set.setBackgroundFetch(false);
+        for (int i = 0; i < count; ++i) {
+            epicsSnprintf(name, sizeof(name), "param%d", i);
+            set.create(name, REST_P_DOUBLE, "/api/", name);
+        }
+
+        driver.lock();
+        epicsUInt64 start = epicsMonotonicGet();
+        if (mode == 0)
+            failed += set.fetchAll() != 0;
+        else
+            failed += set.loadMetadata(path, "1.0") != 0;
+        elapsed[mode] = elapsedSince(start);
+        if (mode == 0)
+            failed += set.saveMetadata(path, "1.0") != 0;
+        driver.unlock();
+    }
+    remove(path);
+
+    printf("{\"benchmark\": \"metadataCache\", \"params\": %d, \"latencyMs\": 1, "
+           "\"fetchInitMs\": %.2f, \"cacheInitMs\": %.2f, \"failed\": %d}\n",
+           count, elapsed[0] * 1e3, elapsed[1] * 1e3, failed);
+}
+
+// Initialise 500 parameters from a server answering after 1 ms, one at a
+// time and with initialiseAll
+static void benchInitialiseAll (void)
+{
+    const int count = 500;
+    const int parallelism[] = {1, 2, DEFAULT_INIT_PARALLELISM};
+    const char *ports[] = {"BENCH_INIT_1", "BENCH_INIT_2", "BENCH_INIT_4"};
+    MockRestServer server;
+    char name[32];
+    for (int i = 0; i < count; ++i) {
+        epicsSnprintf(name, sizeof(name), "param%d", i);
+        server.addParam("/api/", name, "1.5");
+    }
+    server.setLatency(1e-3);
+    MockRestAPI api(server.getPort());
+
+    for (int mode = 0; mode < 3; ++mode) {
+        MockPortDriver driver(ports[mode]);
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        for (int i = 0; i < count; ++i) {
+            epicsSnprintf(name, sizeof(name), "param%d", i);
+            set.create(name, REST_P_DOUBLE, "/api/", name);
+        }
+
+        std::vector<std::string> failed;
+        epicsUInt64 start = epicsMonotonicGet();
+        set.initialiseAll(parallelism[mode], &failed);
+        double elapsed = elapsedSince(start);
+
+        printf("{\"benchmark\": \"initialiseAll\", \"params\": %d, \"latencyMs\": 1, "
+               "\"parallelism\": %d, \"initMs\": %.2f, \"failed\": %lu}\n",
+               count, parallelism[mode], elapsed * 1e3, (unsigned long) failed.size());
+    }
+}
+
+// Find the position of enum values, looking up every value in turn, by
+// linear search as getEnumIndex used to and through a RestStringIndex
+static void benchEnumLookup (void)
+{
+    const size_t sizes[] = {2, 32, 256};
+    const int lookups = 1000000;
+
+    for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+        std::vector<std::string> values, queries;
+        char value[64];
+        for (size_t i = 0; i < sizes[n]; ++i) {
+            epicsSnprintf(value, sizeof(value), "trigger_source_%lu", (unsigned long) i);
+            values.push_back(value);
+        }
+        // Every value and an unknown one
+        queries = values;
+        queries.push_back("trigger_source_none");
+        RestStringIndex index;
+        index.build(values);
+        long sum = 0;
+
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int l = 0; l < lookups; ++l) {
+            std::string const & query = queries[l % queries.size()];
+            size_t i;
+            for (i = 0; i < values.size(); ++i)
+                if (values[i] == query)
+                    break;
+            sum += (long) i;
+        }
+        double linear = elapsedSince(start) / lookups;
+
+        start = epicsMonotonicGet();
+        for (int l = 0; l < lookups; ++l)
+            sum += index.find(queries[l % queries.size()]);
+        double hashed = elapsedSince(start) / lookups;
+
+        printf("{\"benchmark\": \"enumLookup\", \"values\": %lu, \"linearNs\": %.1f, "
+               "\"hashedNs\": %.1f, \"checksum\": %ld}\n",
+               (unsigned long) sizes[n], linear * 1e9, hashed * 1e9, sum);
+    }
+}
+
+static double threadCpuTime (void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// CPU time of the calling thread per GET and PUT, naming the parameter by
+// subsystem and name strings or through its prepared endpoint
+static void benchEndpoint (void)
+{
+    const int repeats = 20000;
+    MockRestServer server;
+    server.addParam("/detector/api/1.8.0/config/", "count_time", "0.5");
+    MockRestAPI api(server.getPort());
+    std::string subSystem("/detector/api/1.8.0/config/"), param("count_time");
+    const rest_endpoint_t *endpoint = api.getEndpoint(subSystem, param);
+    std::string value, reply;
+    int failed = 0;
+    double cpu[4];
+
+    for (int mode = 0; mode < 4; ++mode) {
+        double start = threadCpuTime();
+        for (int r = 0; r < repeats; ++r) {
+            switch (mode) {
+            case 0: failed += api.get(subSystem, param, value); break;
+            case 1: failed += api.get(endpoint, value); break;
+            case 2: failed += api.put(subSystem, param, "0.5", &reply); break;
+            case 3: failed += api.put(endpoint, "0.5", &reply); break;
+            }
+        }
+        cpu[mode] = (threadCpuTime() - start) / repeats;
+    }
+
+    printf("{\"benchmark\": \"endpoint\", \"stringGetCpuUs\": %.2f, \"endpointGetCpuUs\": %.2f, "
+           "\"stringPutCpuUs\": %.2f, \"endpointPutCpuUs\": %.2f, \"failed\": %d}\n",
+           cpu[0] * 1e6, cpu[1] * 1e6, cpu[2] * 1e6, cpu[3] * 1e6, failed);
+}
+
+// Find 10k parameters by name and by asyn index and iterate over all of
+// them, in the set and in the std::maps it used to keep
+static void benchRegistry (void)
+{
+    const int count = 10000, repeats = 20;
+    MockRestServer server;
+    MockRestAPI api(server.getPort());
+    MockPortDriver driver("BENCH_REGISTRY");
+    RestParamSet set(&driver, &api, driver.pasynUserSelf);
+    std::map<std::string, RestParam*> byName;
+    std::map<int, RestParam*> byIndex;
+    std::vector<std::string> names(count);
+    std::vector<int> indexes(count);
+    char name[64];
+    for (int i = 0; i < count; ++i) {
+        epicsSnprintf(name, sizeof(name), "DETECTOR_CONFIG_PARAMETER_%d", i);
+        RestParam *p = set.create(name, REST_P_INT);
+        names[i] = std::string(name) + "_config";
+        indexes[i] = p->getIndex();
+        set.addToConfigMap(names[i], p);
+        byName.insert(std::make_pair(names[i], p));
+        byIndex.insert(std::make_pair(p->getIndex(), p));
+    }
+    // Looked up in a scattered order
+    std::vector<int> order(count);
+    for (int i = 0; i < count; ++i)
+        order[i] = (int) ((i * 7919L) % count);
+    unsigned long sum = 0;
+    double elapsed[6];
+
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r)
+        for (int i = 0; i < count; ++i)
+            sum += byName.find(names[order[i]])->second->getIndex();
+    elapsed[0] = elapsedSince(start) / (repeats * count);
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r)
+        for (int i = 0; i < count; ++i)
+            sum += set.getByName(names[order[i]])->getIndex();
+    elapsed[1] = elapsedSince(start) / (repeats * count);
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r)
+        for (int i = 0; i < count; ++i)
+            sum += byIndex.find(indexes[order[i]])->second->getIndex();
+    elapsed[2] = elapsedSince(start) / (repeats * count);
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r)
+        for (int i = 0; i < count; ++i)
+            sum += set.getByIndex(indexes[order[i]])->getIndex();
+    elapsed[3] = elapsedSince(start) / (repeats * count);
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r) {
+        std::map<int, RestParam*>::iterator it;
+        for (it = byIndex.begin(); it != byIndex.end(); ++it)
+            sum += it->second->getSuppressedUpdates();
+    }
+    elapsed[4] = elapsedSince(start) / repeats;
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r)
+        sum += set.getSuppressedUpdates();
+    elapsed[5] = elapsedSince(start) / repeats;
+
+    printf("{\"benchmark\": \"registry\", \"params\": %d, \"mapByNameNs\": %.1f, "
+           "\"byNameNs\": %.1f, \"mapByIndexNs\": %.1f, \"byIndexNs\": %.1f, "
+           "\"mapIterateUs\": %.2f, \"iterateUs\": %.2f, \"checksum\": %lu}\n",
+           count, elapsed[0] * 1e9, elapsed[1] * 1e9, elapsed[2] * 1e9, elapsed[3] * 1e9,
+           elapsed[4] * 1e6, elapsed[5] * 1e6, sum);
+}
+
+static void benchShadowRead (void)
+{
+    const int reads = 1000000;
+    MockRestServer server;
+    server.addParam("/api/", "gain", "4");
+    server.addParam("/api/", "exposure", "0.25");
+    server.addParam("/api/", "label", "\"detector module 3\"");
+    MockRestAPI api(server.getPort());
+    MockPortDriver driver("BENCH_SHADOW_READ");
+    RestParamSet set(&driver, &api, driver.pasynUserSelf);
+    RestParam *gain = set.create("GAIN", REST_P_INT, "/api/", "gain");
+    RestParam *exposure = set.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+    RestParam *label = set.create("LABEL", REST_P_STRING, "/api/", "label");
+    gain->setExclusive(true);
+    exposure->setExclusive(true);
+    label->setExclusive(true);
+    int intValue = 0;
+    double doubleValue = 0.0, sum = 0.0;
+    std::string stringValue;
+    double elapsed[6];
+
+    driver.lock();
+    gain->fetch();
+    exposure->fetch();
+    label->fetch();
+
+    // Through the asyn parameter library, as every get used to
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int i = 0; i < reads; ++i) {
+        driver.getIntegerParam(0, gain->getIndex(), &intValue);
+        sum += intValue;
+    }
+    elapsed[0] = elapsedSince(start) / reads;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < reads; ++i) {
+        gain->get(intValue);
+        sum += intValue;
+    }
+    elapsed[1] = elapsedSince(start) / reads;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < reads; ++i) {
+        driver.getDoubleParam(0, exposure->getIndex(), &doubleValue);
+        sum += doubleValue;
+    }
+    elapsed[2] = elapsedSince(start) / reads;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < reads; ++i) {
+        exposure->get(doubleValue);
+        sum += doubleValue;
+    }
+    elapsed[3] = elapsedSince(start) / reads;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < reads; ++i) {
+        driver.getStringParam(0, label->getIndex(), stringValue);
+        sum += stringValue.size();
+    }
+    elapsed[4] = elapsedSince(start) / reads;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < reads; ++i) {
+        label->get(stringValue);
+        sum += stringValue.size();
+    }
+    elapsed[5] = elapsedSince(start) / reads;
+    driver.unlock();
+
+    printf("{\"benchmark\": \"shadowRead\", \"reads\": %d, \"asynIntNs\": %.1f, "
+           "\"shadowIntNs\": %.1f, \"asynDoubleNs\": %.1f, \"shadowDoubleNs\": %.1f, "
+           "\"asynStringNs\": %.1f, \"shadowStringNs\": %.1f, \"checksum\": %.0f}\n",
+           reads, elapsed[0] * 1e9, elapsed[1] * 1e9, elapsed[2] * 1e9, elapsed[3] * 1e9,
+           elapsed[4] * 1e9, elapsed[5] * 1e9, sum);
+}
+
+// Shared by the threads of benchSnapshot
+typedef struct
+{
+    MockPortDriver *driver;
+    RestParamSet *set;
+    std::vector<RestParam*> params;
+    bool useSnapshot;
+    int stop;
+    unsigned long count;
+    double sum;
+    epicsEvent done;
+} snapshot_bench_t;
+
+static void snapshotBenchWriter (void *arg)
+{
+    snapshot_bench_t *bench = (snapshot_bench_t *) arg;
+    int value = 0;
+    while (!epicsAtomicGetIntT(&bench->stop)) {
+        bench->driver->lock();
+        for (size_t i = 0; i < bench->params.size(); ++i)
+            bench->params[i]->put(++value);
+        bench->driver->unlock();
+        ++bench->count;
+    }
+    bench->done.trigger();
+}
+
+static void snapshotBenchReader (void *arg)
+{
+    snapshot_bench_t *bench = (snapshot_bench_t *) arg;
+    std::vector<rest_snapshot_value_t> values;
+    int value;
+    while (!epicsAtomicGetIntT(&bench->stop)) {
+        if (bench->useSnapshot) {
+            bench->set->snapshot(bench->params, values);
+            for (size_t i = 0; i < values.size(); ++i)
+                bench->sum += values[i].intValue;
+        } else {
+            bench->driver->lock();
+            for (size_t i = 0; i < bench->params.size(); ++i) {
+                bench->params[i]->get(value);
+                bench->sum += value;
+            }
+            bench->driver->unlock();
+        }
+        ++bench->count;
+    }
+    bench->done.trigger();
+}
+
+// One writer updating 16 parameters at a time while 8 readers read all of
+// them, either under the port lock or from the snapshot buffer
+static void benchSnapshot (void)
+{
+    const int readers = 8, params = 16;
+    const double duration = 0.5;
+    const char *ports[] = {"BENCH_SNAPSHOT_LOCK", "BENCH_SNAPSHOT"};
+    const char *modes[] = {"portLock", "snapshot"};
+    char name[32];
+
+    for (int mode = 0; mode < 2; ++mode) {
+        MockRestServer server;
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver(ports[mode]);
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        std::vector<RestParam*> values;
+        for (int i = 0; i < params; ++i) {
+            epicsSnprintf(name, sizeof(name), "VALUE_%d", i);
+            values.push_back(set.create(name, REST_P_INT));
+        }
+
+        std::vector<snapshot_bench_t*> threads;
+        for (int i = 0; i <= readers; ++i) {
+            snapshot_bench_t *bench = new snapshot_bench_t;
+            bench->driver = &driver;
+            bench->set = &set;
+            bench->params = values;
+            bench->useSnapshot = mode == 1;
+            bench->stop = 0;
+            bench->count = 0;
+            bench->sum = 0.0;
+            threads.push_back(bench);
+        }
+        for (int i = 0; i <= readers; ++i)
+            epicsThreadMustCreate(i ? "benchReader" : "benchWriter", epicsThreadPriorityMedium,
+                    epicsThreadGetStackSize(epicsThreadStackSmall),
+                    i ? snapshotBenchReader : snapshotBenchWriter, threads[i]);
+
+        epicsThreadSleep(duration);
+        for (int i = 0; i <= readers; ++i)
+            epicsAtomicSetIntT(&threads[i]->stop, 1);
+        unsigned long reads = 0;
+        double sum = 0.0;
+        for (int i = 0; i <= readers; ++i) {
+            threads[i]->done.wait();
+            if (i) {
+                reads += threads[i]->count;
+                sum += threads[i]->sum;
+            }
+        }
+
+        printf("{\"benchmark\": \"snapshot\", \"mode\": \"%s\", \"params\": %d, "
+               "\"readers\": %d, \"readsPerSec\": %.0f, \"writesPerSec\": %.0f, "
+               "\"checksum\": %.0f}\n",
+               modes[mode], params, readers, reads / duration,
+               threads[0]->count / duration, sum);
+        for (int i = 0; i <= readers; ++i)
+            delete threads[i];
+    }
+}
+
+// CPU time of the calling thread per fetch and put of int and double
+// parameters, through RestParam and through TypedRestParam
+static void benchTypedParam (void)
+{
+    const int repeats = 10000;
+    MockRestServer server;
+    server.addParam("/api/", "frames", "1000");
+    server.addParam("/api/", "exposure", "0.0125");
+    MockRestAPI api(server.getPort());
+    MockPortDriver driver("BENCH_TYPED_PARAM");
+    RestParamSet set(&driver, &api, driver.pasynUserSelf);
+    RestParam *frames = set.create("FRAMES", REST_P_INT, "/api/", "frames");
+    RestParam *exposure = set.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+    TypedRestParam<int> typedFrames(&set, "TYPED_FRAMES", "/api/", "frames");
+    TypedRestParam<double> typedExposure(&set, "TYPED_EXPOSURE", "/api/", "exposure");
+    int intValue = 0, failed = 0;
+    double doubleValue = 0.0;
+    double cpu[8];
+
+    driver.lock();
+    for (int mode = 0; mode < 8; ++mode) {
+        double start = threadCpuTime();
+        for (int r = 0; r < repeats; ++r) {
+            switch (mode) {
+            case 0: failed += frames->fetch(intValue); break;
+            case 1: failed += typedFrames.fetch(intValue); break;
+            case 2: failed += exposure->fetch(doubleValue); break;
+            case 3: failed += typedExposure.fetch(doubleValue); break;
+            case 4: failed += frames->put(1000 + r % 2); break;
+            case 5: failed += typedFrames.put(1000 + r % 2); break;
+            case 6: failed += exposure->put(0.0125 * (1 + r % 2)); break;
+            case 7: failed += typedExposure.put(0.0125 * (1 + r % 2)); break;
+            }
+        }
+        cpu[mode] = (threadCpuTime() - start) / repeats;
+    }
+    driver.unlock();
+
+    printf("{\"benchmark\": \"typedParam\", \"intFetchCpuUs\": %.2f, \"typedIntFetchCpuUs\": %.2f, "
+           "\"doubleFetchCpuUs\": %.2f, \"typedDoubleFetchCpuUs\": %.2f, "
+           "\"intPutCpuUs\": %.2f, \"typedIntPutCpuUs\": %.2f, "
+           "\"doublePutCpuUs\": %.2f, \"typedDoublePutCpuUs\": %.2f, \"failed\": %d}\n",
+           cpu[0] * 1e6, cpu[1] * 1e6, cpu[2] * 1e6, cpu[3] * 1e6,
+           cpu[4] * 1e6, cpu[5] * 1e6, cpu[6] * 1e6, cpu[7] * 1e6, failed);
+}
+
+// Repeats of errors that are already known, as during a server outage,
+// with 50 distinct errors on record: formatted with stringstreams and
+// looked up in a vector as setError used to, and checked by key (told apart
+// by a discriminator, as ERROR_FOR does) before any formatting through
+// ErrorFilter
+static void benchErrorFilter (void)
+{
+    const int errors = 50, repeats = 20000;
+    const char *functionName = "baseFetch";
+    const int line = 1000;
+    std::string asynName("DETECTOR_TEMPERATURE"), name("temperature");
+    std::vector<std::string> known;
+    ErrorFilter filter;
+    unsigned long suppressed, printed = 0;
+    double elapsed[2];
+
+    for (int i = 0; i < errors; ++i) {
+        std::stringstream message;
+        message << "RestParam[" << asynName << " -> " << name << "]::" << functionName
+                << ": Underlying RestAPI get failed " << i << "\n";
+        known.push_back(message.str());
+        filter.newError(ErrorFilter::key(functionName, line, -1, i), suppressed);
+    }
+
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r) {
+        int i = r % errors;
+        std::stringstream error, index, message;
+        error << "Underlying RestAPI get failed " << i;
+        message << "RestParam[" << asynName << " -> " << name << index.str() << "]::"
+                << functionName << ": " << error.str() << "\n";
+        if (std::find(known.begin(), known.end(), message.str()) == known.end())
+            ++printed;
+    }
+    elapsed[0] = elapsedSince(start) / repeats;
+
+    start = epicsMonotonicGet();
+    for (int r = 0; r < repeats; ++r) {
+        int i = r % errors;
+        if (filter.newError(ErrorFilter::key(functionName, line, -1, i), suppressed))
+            ++printed;
+    }
+    elapsed[1] = elapsedSince(start) / repeats;
+
+    printf("{\"benchmark\": \"errorFilter\", \"errors\": %d, \"vectorNs\": %.1f, "
+           "\"filterNs\": %.1f, \"suppressed\": %lu, \"printed\": %lu}\n",
+           errors, elapsed[0] * 1e9, elapsed[1] * 1e9, filter.getSuppressed(), printed);
+}
+
+// Cost of a trace event, disabled and enabled, and client CPU per fetch
+// with tracing off and on (six events each)
+static void benchTrace (void)
+{
+    const int events = 10000000, fetches = 10000;
+    epicsUInt32 endpoint = restTraceEndpoint("bench:0/api/trace");
+    double elapsed[2], cpu[2];
+
+    for (int enabled = 0; enabled < 2; ++enabled) {
+        restTraceEnable(enabled);
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < events; ++i)
+            REST_TRACE(REST_TRACE_SEND, endpoint);
+        elapsed[enabled] = elapsedSince(start) / events;
+    }
+
+    MockRestServer server;
+    server.addParam("/api/", "temperature", "21.5");
+    MockRestAPI api(server.getPort());
+    MockPortDriver driver("BENCH_TRACE");
+    RestParamSet set(&driver, &api, driver.pasynUserSelf);
+    RestParam *temperature = set.create("TEMPERATURE", REST_P_DOUBLE, "/api/", "temperature");
+    int failed = 0;
+    driver.lock();
+    for (int enabled = 0; enabled < 2; ++enabled) {
+        restTraceEnable(enabled);
+        double start = threadCpuTime();
+        for (int i = 0; i < fetches; ++i)
+            failed += temperature->fetch();
+        cpu[enabled] = (threadCpuTime() - start) / fetches;
+    }
+    driver.unlock();
+    restTraceEnable(0);
+
+    printf("{\"benchmark\": \"trace\", \"disabledEventNs\": %.1f, \"enabledEventNs\": %.1f, "
+           "\"fetchCpuUs\": %.2f, \"tracedFetchCpuUs\": %.2f, \"failed\": %d}\n",
+           elapsed[0] * 1e9, elapsed[1] * 1e9, cpu[0] * 1e6, cpu[1] * 1e6, failed);
+}
+
+static void benchStats (void)
+{
+    const int records = 1000000, summaries = 1000, fetches = 10000;
+    RestRequestStats stats;
+    rest_request_summary_t summary;
+
+    epicsUInt64 start = epicsMonotonicGet();
+    for (int i = 0; i < records; ++i)
+        stats.record(i & 1023, 50000 + (i & 4095), 2000 + (i & 255), 100, false);
+    double record = elapsedSince(start) / records;
+
+    start = epicsMonotonicGet();
+    for (int i = 0; i < summaries; ++i) {
+        stats.record(i, i, i, 100, false);
+        stats.summarise(summary);
+    }
+    double summarise = elapsedSince(start) / summaries;
+
+    // What a driver polling its statistics would publish
+    MockRestServer server;
+    server.addParam("/api/", "temperature", "21.5");
+    MockRestAPI api(server.getPort());
+    MockPortDriver driver("BENCH_STATS");
+    RestParamSet set(&driver, &api, driver.pasynUserSelf);
+    RestParam *temperature = set.create("TEMPERATURE", REST_P_DOUBLE, "/api/", "temperature");
+    int failed = 0;
+    driver.lock();
+    for (int i = 0; i < fetches; ++i)
+        failed += temperature->fetch();
+    driver.unlock();
+    api.getEndpoint("/api/", "temperature")->stats->summarise(summary);
+
+    printf("{\"benchmark\": \"stats\", \"recordNs\": %.1f, \"summariseUs\": %.2f, "
+           "\"fetchP50Us\": %.1f, \"fetchP99Us\": %.1f, \"fetchMaxUs\": %.1f, "
+           "\"checkoutP99Us\": %.1f, \"networkP99Us\": %.1f, \"parseP99Us\": %.1f, "
+           "\"failed\": %d}\n",
+           record * 1e9, summarise * 1e6, summary.p50 * 1e6, summary.p99 * 1e6,
+           summary.max * 1e6, summary.checkoutP99 * 1e6, summary.networkP99 * 1e6,
+           summary.parseP99 * 1e6, failed);
+}
+
+// End-to-end benchmarks: RestAPI and RestParamSet against the mock server
+// in each of the ways it can answer, timing every operation
+
+typedef struct
+{
+    const char *name;
+    size_t chunkSize;       // Transfer-Encoding: chunked if not 0
+    bool connectionClose;   // Connection: close, a connection per request
+    double latency;         // Delay before each reply, s
+    int ops;
+} bench_e2e_mode_t;
+
+static const bench_e2e_mode_t e2eModes[] = {
+    {"keepAlive", 0, false, 0.0, 2000},
+    {"close", 0, true, 0.0, 2000},
+    {"chunked", 1024, false, 0.0, 2000},
+    {"latency", 0, false, 0.0005, 200},
+};
+
+static const size_t e2eModeCount = sizeof(e2eModes) / sizeof(e2eModes[0]);
+
+static void e2eConfigure (MockRestServer & server, bench_e2e_mode_t const & mode)
+{
+    server.setChunkSize(mode.chunkSize);
+    server.setConnectionClose(mode.connectionClose);
+    server.setLatency(mode.latency);
+}
+
+// A subsystem of params parameters named p<i>, each given its name in the
+// set to be listed in PUT replies
+static std::vector<RestParam*> e2eTree (MockRestServer & server, RestParamSet & set,
+                                        int params, std::string const & putReply = "")
+{
+    std::vector<RestParam*> created;
+    for (int i = 0; i < params; ++i) {
+        std::ostringstream name, value;
+        name << "p" << i;
+        value << i * 0.5;
+        server.addParam("/api/tree/", name.str(), value.str(), putReply);
+        RestParam *p = set.create("E2E_" + name.str(), REST_P_DOUBLE, "/api/tree/", name.str());
+        set.addToConfigMap(name.str(), p);
+        created.push_back(p);
+    }
+    return created;
+}
+
+static void e2eReport (const char *benchmark, bench_e2e_mode_t const & mode,
+                       RestHistogram & latency, double elapsed, int failed,
+                       double requestsPerOp = 1.0)
+{
+    double ops = (double) latency.getCount();
+    printf("{\"benchmark\": \"%s\", \"mode\": \"%s\", \"ops\": %.0f, \"opsPerSec\": %.0f, "
+           "\"requestsPerSec\": %.0f, \"p50Us\": %.1f, \"p90Us\": %.1f, \"p99Us\": %.1f, "
+           "\"p999Us\": %.1f, \"maxUs\": %.1f, \"failed\": %d}\n",
+           benchmark, mode.name, ops, ops / elapsed, ops * requestsPerOp / elapsed,
+           latency.getPercentile(50.0) * 1e-3, latency.getPercentile(90.0) * 1e-3,
+           latency.getPercentile(99.0) * 1e-3, latency.getPercentile(99.9) * 1e-3,
+           latency.getMax() * 1e-3, failed);
+}
+
+// RestAPI get through a prepared endpoint, without any parsing
+static void benchE2eGet (void)
+{
+    for (size_t m = 0; m < e2eModeCount; ++m) {
+        bench_e2e_mode_t const & mode = e2eModes[m];
+        MockRestServer server;
+        server.addParam("/api/", "temperature", "21.5");
+        e2eConfigure(server, mode);
+        MockRestAPI api(server.getPort());
+        const rest_endpoint_t *endpoint = api.getEndpoint("/api/", "temperature");
+
+        RestHistogram latency;
+        std::string value;
+        int failed = 0;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < mode.ops; ++i) {
+            epicsUInt64 opStart = epicsMonotonicGet();
+            failed += api.get(endpoint, value);
+            latency.record(epicsMonotonicGet() - opStart);
+        }
+        e2eReport("e2eGet", mode, latency, elapsedSince(start), failed);
+    }
+}
+
+// RestParam put of a double, from the port driver like a record write
+static void benchE2ePut (void)
+{
+    for (size_t m = 0; m < e2eModeCount; ++m) {
+        bench_e2e_mode_t const & mode = e2eModes[m];
+        MockRestServer server;
+        server.addParam("/api/", "setpoint", "0");
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver("BENCH_E2E_PUT");
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        RestParam *setpoint = set.create("SETPOINT", REST_P_DOUBLE, "/api/", "setpoint");
+        driver.lock();
+        setpoint->fetch();
+        driver.unlock();
+        e2eConfigure(server, mode);
+
+        RestHistogram latency;
+        int failed = 0;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < mode.ops; ++i) {
+            epicsUInt64 opStart = epicsMonotonicGet();
+            driver.lock();
+            failed += setpoint->put(i * 0.25);
+            driver.unlock();
+            latency.record(epicsMonotonicGet() - opStart);
+        }
+        e2eReport("e2ePut", mode, latency, elapsedSince(start), failed);
+    }
+}
+
+// fetchAll of a subsystem of 100 parameters, one request each
+static void benchE2eFetchAll (void)
+{
+    const int params = 100;
+    for (size_t m = 0; m < e2eModeCount; ++m) {
+        bench_e2e_mode_t const & mode = e2eModes[m];
+        MockRestServer server;
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver("BENCH_E2E_FETCH_ALL");
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        e2eTree(server, set, params);
+        driver.lock();
+        set.fetchAll();
+        driver.unlock();
+        e2eConfigure(server, mode);
+
+        RestHistogram latency;
+        int failed = 0, ops = mode.ops / 10;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < ops; ++i) {
+            epicsUInt64 opStart = epicsMonotonicGet();
+            driver.lock();
+            failed += set.fetchAll();
+            driver.unlock();
+            latency.record(epicsMonotonicGet() - opStart);
+        }
+        e2eReport("e2eFetchAll", mode, latency, elapsedSince(start), failed, params);
+    }
+}
+
+// pushAll of every value of a subsystem of 100 parameters
+static void benchE2ePushAll (void)
+{
+    const int params = 100;
+    for (size_t m = 0; m < e2eModeCount; ++m) {
+        bench_e2e_mode_t const & mode = e2eModes[m];
+        MockRestServer server;
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver("BENCH_E2E_PUSH_ALL");
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        e2eTree(server, set, params);
+        driver.lock();
+        set.fetchAll();
+        driver.unlock();
+        e2eConfigure(server, mode);
+
+        RestHistogram latency;
+        int failed = 0, ops = mode.ops / 10;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < ops; ++i) {
+            epicsUInt64 opStart = epicsMonotonicGet();
+            driver.lock();
+            failed += set.pushAll(REST_PUSH_ALL);
+            driver.unlock();
+            latency.record(epicsMonotonicGet() - opStart);
+        }
+        e2eReport("e2ePushAll", mode, latency, elapsedSince(start), failed, params);
+    }
+}
+
+// A put whose reply lists 10 parameters to refetch, fetched before it returns
+static void benchE2eCascade (void)
+{
+    const int params = 10;
+    std::ostringstream reply;
+    reply << "[";
+    for (int i = 0; i < params; ++i)
+        reply << (i ? ", " : "") << "\"p" << i << "\"";
+    reply << "]";
+
+    for (size_t m = 0; m < e2eModeCount; ++m) {
+        bench_e2e_mode_t const & mode = e2eModes[m];
+        MockRestServer server;
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver("BENCH_E2E_CASCADE");
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        set.setBackgroundFetch(false);
+        RestParam *trigger = e2eTree(server, set, params, reply.str())[0];
+        driver.lock();
+        set.fetchAll();
+        driver.unlock();
+        e2eConfigure(server, mode);
+
+        RestHistogram latency;
+        int failed = 0, ops = mode.ops / 2;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < ops; ++i) {
+            epicsUInt64 opStart = epicsMonotonicGet();
+            driver.lock();
+            failed += trigger->put(i * 0.5);
+            driver.unlock();
+            latency.record(epicsMonotonicGet() - opStart);
+        }
+        e2eReport("e2eCascade", mode, latency, elapsedSince(start), failed, 1 + params);
+    }
+}
+
+// Fetch of a 100000 element array, about 600 kB of JSON a reply
+static void benchE2eLarge (void)
+{
+    const size_t elements = 100000;
+    std::vector<std::string> values;
+    for (size_t i = 0; i < elements; ++i)
+        values.push_back(i % 2 ? "0.125" : "-12.5");
+
+    for (size_t m = 0; m < e2eModeCount; ++m) {
+        bench_e2e_mode_t const & mode = e2eModes[m];
+        MockRestServer server;
+        server.addArray("/api/", "table", values);
+        e2eConfigure(server, mode);
+        MockRestAPI api(server.getPort());
+        MockPortDriver driver("BENCH_E2E_LARGE", elements);
+        RestParamSet set(&driver, &api, driver.pasynUserSelf);
+        RestParam *table = set.create("TABLE", REST_P_DOUBLE, "/api/", "table", elements);
+
+        RestHistogram latency;
+        std::vector<double> tableValues;
+        int failed = 0, ops = mode.ops / 20;
+        epicsUInt64 start = epicsMonotonicGet();
+        for (int i = 0; i < ops; ++i) {
+            epicsUInt64 opStart = epicsMonotonicGet();
+            driver.lock();
+            std::vector<int> status = table->fetch(tableValues);
+            driver.unlock();
+            latency.record(epicsMonotonicGet() - opStart);
+            failed += status.empty() || status[0] || tableValues.size() != elements;
+        }
+        e2eReport("e2eLarge", mode, latency, elapsedSince(start), failed);
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+} bench_t;
+
+static const bench_t benchmarks[] = {
+    {"writeBehind", benchWriteBehind},
+    {"tokenize", benchTokenize},
+    {"keyLookup", benchKeyLookup},
+    {"tokenizer", benchTokenizer},
+    {"arrayDecode", benchArrayDecode},
+    {"arrayFetch", benchArrayFetch},
+    {"numberCodec", benchNumberCodec},
+    {"streamingGet", benchStreamingGet},
+    {"jsonWriter", benchJsonWriter},
+    {"metadataCache", benchMetadataCache},
+    {"initialiseAll", benchInitialiseAll},
+    {"enumLookup", benchEnumLookup},
+    {"endpoint", benchEndpoint},
+    {"registry", benchRegistry},
+    {"shadowRead", benchShadowRead},
+    {"snapshot", benchSnapshot},
+    {"typedParam", benchTypedParam},
+    {"errorFilter", benchErrorFilter},
+    {"trace", benchTrace},
+    {"stats", benchStats},
+    {"e2eGet", benchE2eGet},
+    {"e2ePut", benchE2ePut},
+    {"e2eFetchAll", benchE2eFetchAll},
+    {"e2ePushAll", benchE2ePushAll},
+    {"e2eCascade", benchE2eCascade},
+    {"e2eLarge", benchE2eLarge},
+};
+
+int main (int argc, char *argv[])
+{
+    size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+    for (size_t i = 0; i < count; ++i) {
+        bool selected = argc < 2;
+        for (int arg = 1; arg < argc && !selected; ++arg)
+            selected = !strcmp(argv[arg], benchmarks[i].name);
+        if (selected)
+            benchmarks[i].run();
+    }
+    return 0;
+}
@@ -20,6 +20,13 @@ typedef enum
     REST_ACC_WO
 } rest_access_mode_t;
 
+typedef enum
+{
+    REST_PUSH_ALL,      // Re-send every value
+    REST_PUSH_DIRTY,    // Only values the device has not confirmed
+    REST_PUSH_CHANGED   // Only values that differ from a fresh device fetch
+} rest_push_mode_t;
+
 typedef struct
 {
     bool exists;
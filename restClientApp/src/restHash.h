@@ -0,0 +1,22 @@
+#ifndef REST_HASH_H
+#define REST_HASH_H
+
+#include <stddef.h>
+#include <epicsTypes.h>
+
+#define REST_HASH_SEED 2166136261u
+
+// FNV-1a. Passing the hash of a prefix continues from it, so that
+// restHash("a.b", 3) == restHash("b", 1, restHash(".", 1, restHash("a", 1)))
+inline epicsUInt32 restHash (const char *data, size_t len,
+                             epicsUInt32 hash = REST_HASH_SEED)
+{
+    for(size_t i = 0; i < len; ++i)
+    {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif
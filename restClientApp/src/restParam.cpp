@@ -1,28 +1,44 @@
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
 #include <numeric>
+#include <new>
 #include <sstream>
-#include <iomanip>
-#include <limits>
+#include <cstdio>
 
 #include <frozen.h>
 #include <math.h>
+#include <epicsThread.h>
+#include <epicsGuard.h>
+#include <epicsAtomic.h>
+#include <epicsStdio.h>
+#include <epicsTime.h>
 #include "restParam.h"
+#include "jsonNumber.h"
+#include "restTrace.h"
 
-#define ERROR(message) \
-        { \
-            std::stringstream ss; \
-            ss << message; \
-            setError(functionName, ss.str()); \
-        }
+// Attempts at a snapshot between yields while values are being published
+#define REST_SNAPSHOT_SPINS 64
 
-#define ERROR_IDX(message, index) \
+// Errors are keyed on their function, line and index, and for ERROR_FOR on
+// a cheap discriminator too (such as the length of a bad value) to tell
+// messages from one line apart. The message is only formatted if it is
+// going to be printed
+#define ERROR(message) ERROR_IDX_FOR(message, -1, 0)
+#define ERROR_IDX(message, index) ERROR_IDX_FOR(message, index, 0)
+#define ERROR_FOR(message, discriminator) ERROR_IDX_FOR(message, -1, discriminator)
+
+#define ERROR_IDX_FOR(message, index, discriminator) \
         { \
-            std::stringstream ss; \
-            ss << message; \
-            setError(functionName, ss.str(), index); \
+            unsigned long suppressed_; \
+            if (mErrorFilter->newError(ErrorFilter::key(functionName, __LINE__, index, \
+                                                        discriminator), suppressed_, this)) { \
+                std::stringstream ss; \
+                ss << message; \
+                printError(functionName, ss.str(), index, suppressed_); \
+            } \
         }
 
 // Flow message formatters
@@ -36,22 +52,21 @@
 
 #define MAX_BUFFER_SIZE 128
 #define MAX_MESSAGE_SIZE 512
-#define MAX_JSON_TOKENS 200
 
 using std::string;
 using std::vector;
 using std::map;
 using std::pair;
 
-vector<string> RestParam::parseArray (struct json_token *tokens,
+vector<string> RestParam::parseArray (JsonTokenArena & json,
         string const & name)
 {
     vector<string> arrayValues;
     struct json_token *t;
     if(name.empty())
-        t = tokens;
+        t = json.getTokens();
     else
-        t = find_json_token(tokens, name.c_str());
+        t = json.find(name);
 
     if(t)
     {
@@ -68,13 +83,13 @@ vector<string> RestParam::parseArray (struct json_token *tokens,
     return arrayValues;
 }
 
-int RestParam::parseType (struct json_token *tokens, rest_param_type_t & type)
+int RestParam::parseType (JsonTokenArena & json, rest_param_type_t & type)
 {
     const char *functionName = "parseType";
 
     // Find value type
     std::string key = mSet->getApi()->PARAM_TYPE;
-    struct json_token *token = find_json_token(tokens, key.c_str());
+    struct json_token *token = json.find(key);
     if(token == NULL)
     {
         ERROR("Failed to find '" << key.c_str() << "' json field");
@@ -83,12 +98,12 @@ int RestParam::parseType (struct json_token *tokens, rest_param_type_t & type)
     string typeStr(token->ptr, token->len);
 
     // Check if this parameter is an enumeration
-    token = find_json_token(tokens, mSet->getApi()->PARAM_ENUM_VALUES.c_str());
+    token = json.find(mSet->getApi()->PARAM_ENUM_VALUES);
     if(token)
         typeStr = "enum";
 
     // Check if this parameter is write only (command)
-    token = find_json_token(tokens, mSet->getApi()->PARAM_ACCESS_MODE.c_str());
+    token = json.find(mSet->getApi()->PARAM_ACCESS_MODE);
     if(token && token->ptr[0] == 'w')
         typeStr = "command";
 
@@ -109,12 +124,12 @@ int RestParam::parseType (struct json_token *tokens, rest_param_type_t & type)
     return EXIT_SUCCESS;
 }
 
-int RestParam::parseAccessMode (struct json_token *tokens,
+int RestParam::parseAccessMode (JsonTokenArena & json,
         rest_access_mode_t & accessMode)
 {
     const char *functionName = "parseAccessMode";
 
-    struct json_token *t = find_json_token(tokens, mSet->getApi()->PARAM_ACCESS_MODE.c_str());
+    struct json_token *t = json.find(mSet->getApi()->PARAM_ACCESS_MODE);
     if(!t)
         return EXIT_FAILURE;
 
@@ -134,36 +149,37 @@ int RestParam::parseAccessMode (struct json_token *tokens,
     return EXIT_SUCCESS;
 }
 
-int RestParam::parseMinMax (struct json_token *tokens, string const & key,
+int RestParam::parseMinMax (JsonTokenArena & json, string const & key,
         rest_min_max_t & minMax)
 {
     const char *functionName = "parseMinMax";
 
-    struct json_token *t = find_json_token(tokens, key.c_str());
+    struct json_token *t = json.find(key);
 
     if((minMax.exists = (t != NULL)))
     {
-        struct json_token *type = find_json_token(tokens, mSet->getApi()->PARAM_TYPE.c_str());
+        struct json_token *type = json.find(mSet->getApi()->PARAM_TYPE);
         if(!type)
         {
             ERROR("Failed to find '" << mSet->getApi()->PARAM_TYPE.c_str() << "' json field");
             return EXIT_FAILURE;
         }
 
-        string value(t->ptr, t->len);
         if(type->ptr[0] == 'i' || type->ptr[0] == 'u')
         {
-            if(sscanf(value.c_str(), "%d", &minMax.valInt) != 1)
+            if(parseJsonNumber(t, minMax.valInt))
             {
-                ERROR("Failed to parse '" << value.c_str() << "' as integer");
+                ERROR_FOR("Failed to parse '" << string(t->ptr, t->len) << "' as integer",
+                          t->len);
                 return EXIT_FAILURE;
             }
         }
         else if(type->ptr[0] == 'f')
         {
-            if(sscanf(value.c_str(), "%lf", &minMax.valDouble) != 1)
+            if(parseJsonNumber(t, minMax.valDouble))
             {
-                ERROR("Failed to parse '" << value.c_str() << "' as double");
+                ERROR_FOR("Failed to parse '" << string(t->ptr, t->len) << "' as double",
+                          t->len);
                 return EXIT_FAILURE;
             }
         }
@@ -172,26 +188,55 @@ int RestParam::parseMinMax (struct json_token *tokens, string const & key,
     return EXIT_SUCCESS;
 }
 
-int RestParam::initialise(struct json_token * tokens)
+int RestParam::initialise(JsonTokenArena & json)
 {
   const char *functionName = "initialise";
 
+  if (!mRevalidate) {
+    return parseMetadata(json);
+  }
+
+  // Metadata loaded from the cache is parsed again and compared
+  rest_param_type_t cachedType = mType;
+  rest_access_mode_t cachedAccessMode = mAccessMode;
+  rest_min_max_t cachedMin = mMin, cachedMax = mMax;
+  std::vector<std::string> cachedEnumValues(mEnumValues), cachedCriticalValues(mCriticalValues);
+  if (mCachedType) {
+    mType = REST_P_UNINIT;
+  }
+  mRevalidate = false;
+
+  int status = parseMetadata(json);
+  if (status || mType != cachedType || mAccessMode != cachedAccessMode ||
+      mEnumValues != cachedEnumValues || mCriticalValues != cachedCriticalValues ||
+      !sameLimit(mMin, cachedMin) || !sameLimit(mMax, cachedMax)) {
+    FLOW("metadata differs from the cache");
+    mSet->setMetadataStale();
+  }
+  return status;
+}
+
+int RestParam::parseMetadata(JsonTokenArena & json)
+{
+  const char *functionName = "parseMetadata";
+
   mInitialised = false;
 
   if (mSet->getApi()->lookupAccessMode(mSubSystem, mAccessMode)) {
-    if (parseAccessMode(tokens, mAccessMode)) {
+    if (parseAccessMode(json, mAccessMode)) {
       mAccessMode = REST_ACC_RO;
     }
   }
 
-  if (mType == REST_P_UNINIT && parseType(tokens, mType)) {
+  if (mType == REST_P_UNINIT && parseType(json, mType)) {
     ERROR("Failed to parse parameter type");
     return EXIT_FAILURE;
   }
 
   if (mType == REST_P_ENUM) {
     if (!mCustomEnum) {
-      mEnumValues = parseArray(tokens, mSet->getApi()->PARAM_ENUM_VALUES);
+      mEnumValues = parseArray(json, mSet->getApi()->PARAM_ENUM_VALUES);
+      indexEnumValues();
       // Confirm that the number of enum elements is non zero (non empty array), else fail
       if (mEnumValues.empty()) {
         ERROR("Failed to parse enum values");
@@ -202,15 +247,16 @@ int RestParam::initialise(struct json_token * tokens)
 
   if (mStrictInitialisation) {
 
-    mCriticalValues = parseArray(tokens, mSet->getApi()->PARAM_CRITICAL_VALUES);
+    mCriticalValues = parseArray(json, mSet->getApi()->PARAM_CRITICAL_VALUES);
+    mCriticalIndex.build(mCriticalValues);
 
     if(mType == REST_P_INT || mType == REST_P_UINT || mType == REST_P_DOUBLE) {
-      if(parseMinMax(tokens, mSet->getApi()->PARAM_MIN, mMin)) {
+      if(parseMinMax(json, mSet->getApi()->PARAM_MIN, mMin)) {
         ERROR("Failed to parse min limit");
         return EXIT_FAILURE;
       }
 
-      if(parseMinMax(tokens, mSet->getApi()->PARAM_MAX, mMax)) {
+      if(parseMinMax(json, mSet->getApi()->PARAM_MAX, mMax)) {
         ERROR("Failed to parse max limit");
         return EXIT_FAILURE;
       }
@@ -221,25 +267,29 @@ int RestParam::initialise(struct json_token * tokens)
   return EXIT_SUCCESS;
 }
 
-int RestParam::parseValue (struct json_token *tokens, string & rawValue)
+bool RestParam::sameLimit (rest_min_max_t const & a, rest_min_max_t const & b)
 {
-    const char *functionName = "parseValue";
+    if (a.exists != b.exists)
+        return false;
+    if (!a.exists)
+        return true;
+    if (mType == REST_P_DOUBLE)
+        return a.valDouble == b.valDouble;
+    return a.valInt == b.valInt;
+}
 
-    std::string key;
-    if (!mSet->getApi()->PARAM_VALUE.empty()) {
-        key = mSet->getApi()->PARAM_VALUE;
-    }
-    else {
-        key = mName;
-    }
-    struct json_token *token = find_json_token(tokens, key.c_str());
+struct json_token *RestParam::findValue (JsonTokenArena & json)
+{
+    const char *functionName = "findValue";
+
+    std::string const & key = mSet->getApi()->PARAM_VALUE.empty() ?
+            mName : mSet->getApi()->PARAM_VALUE;
+    struct json_token *token = json.find(key);
     if(token == NULL)
     {
         ERROR("Failed to find '" << key.c_str() << "' json field");
-        return EXIT_FAILURE;
     }
-    rawValue = string(token->ptr, token->len);
-    return EXIT_SUCCESS;
+    return token;
 }
 
 int RestParam::parseValue (string const & rawValue, bool & value)
@@ -252,7 +302,8 @@ int RestParam::parseValue (string const & rawValue, bool & value)
         value = false;
     else
     {
-        ERROR("Failed to parse value '" << rawValue.c_str() << "' as boolean");
+        ERROR_FOR("Failed to parse value '" << rawValue.c_str() << "' as boolean",
+                  rawValue.size());
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
@@ -262,9 +313,10 @@ int RestParam::parseValue (string const & rawValue, int & value)
 {
     const char *functionName = "parseValue";
 
-    if(sscanf(rawValue.c_str(), "%d", &value) != 1)
+    if(parseNumber(rawValue, value))
     {
-        ERROR("Failed to parse value '" << rawValue.c_str() << "' as integer");
+        ERROR_FOR("Failed to parse value '" << rawValue.c_str() << "' as integer",
+                  rawValue.size());
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
@@ -274,9 +326,36 @@ int RestParam::parseValue (string const & rawValue, double & value)
 {
     const char *functionName = "parseValue";
 
-    if(sscanf(rawValue.c_str(), "%lf", &value) != 1)
+    if(parseNumber(rawValue, value))
+    {
+        ERROR_FOR("Failed to parse value '" << rawValue.c_str() << "' as double",
+                  rawValue.size());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int RestParam::parseValue (struct json_token const *token, int & value)
+{
+    const char *functionName = "parseValue";
+
+    if(parseJsonNumber(token, value))
+    {
+        ERROR_FOR("Failed to parse value '" << string(token->ptr, token->len) << "' as integer",
+                  token->len);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int RestParam::parseValue (struct json_token const *token, double & value)
+{
+    const char *functionName = "parseValue";
+
+    if(parseJsonNumber(token, value))
     {
-        ERROR("Failed to parse value '" << rawValue.c_str() << "' as double");
+        ERROR_FOR("Failed to parse value '" << string(token->ptr, token->len) << "' as double",
+                  token->len);
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
@@ -295,81 +374,239 @@ std::string RestParam::toString (int value)
     const char *functionName = "toString";
     if(mType == REST_P_ENUM){
         if ((size_t)value >= mEnumValues.size()){
-            ERROR("Value '" << value << "' is out of range; no enum value at this index");
+            ERROR_FOR("Value '" << value << "' is out of range; no enum value at this index",
+                      value);
             return "";
         }
         return toString(mEnumValues[value]);
     }
-    std::ostringstream os;
-    os << value;
-    return os.str();
+    return formatNumber(value);
 }
 
 std::string RestParam::toString (double value)
 {
-    std::ostringstream os;
-    os << std::setprecision(std::numeric_limits<long double>::digits10 + 2) << value;
-    return os.str();
+    return formatNumber(value);
 }
 
 std::string RestParam::toString (std::string const & value)
 {
-    std::ostringstream os;
-    os << "\"" << value << "\"";
-    return os.str();
+    std::string json;
+    JsonWriter(json).value(value);
+    return json;
+}
+
+std::string RestParam::toString (std::vector<std::string> const & rawValues)
+{
+    std::string list("[");
+    for (size_t index = 0; index < rawValues.size(); ++index) {
+        if (index) {
+            list += ", ";
+        }
+        list += rawValues[index];
+    }
+    list += "]";
+    return list;
+}
+
+int RestParam::clamp (int value)
+{
+    if(mMin.exists && value < mMin.valInt)
+        value = mMin.valInt;
+
+    if(mMax.exists && value > mMax.valInt)
+        value = mMax.valInt;
+
+    // Protect against trying to write negative values to an unsigned int
+    if(mType == REST_P_UINT && value < 0)
+        value = 0;
+
+    return value;
+}
+
+double RestParam::clamp (double value, int index)
+{
+    const char *functionName = "clamp";
+
+    if(mMin.exists && (value < mMin.valDouble))
+    {
+        value = mMin.valDouble;
+        ERROR_IDX("PUT value clamped to minimum: " << value, index);
+    }
+
+    if(mMax.exists && (value > mMax.valDouble))
+    {
+        value = mMax.valDouble;
+        ERROR_IDX("PUT value clamped to maximum: " << value, index);
+    }
+
+    return value;
 }
 
 int RestParam::getEnumIndex (std::string const & value, size_t & index)
 {
     const char *functionName = "getEnumIndex";
-    for(index = 0; index < mEnumValues.size(); ++index)
-        if(mEnumValues[index] == value)
-            return EXIT_SUCCESS;
+    int found = mEnumIndex.find(value);
+    if(found >= 0)
+    {
+        index = (size_t) found;
+        return EXIT_SUCCESS;
+    }
 
-    ERROR("Failed to find index of value " << value.c_str());
+    ERROR_FOR("Failed to find index of value " << value.c_str(), value.size());
     return EXIT_FAILURE;
 }
 
 bool RestParam::isCritical (std::string const & value)
 {
-    size_t i;
-    for(i = 0; i < mCriticalValues.size(); ++i)
-        if(mCriticalValues[i] == value)
-            return true;
-    return false;
+    return mCriticalIndex.find(value) >= 0;
+}
+
+bool RestParam::shadowed(int address)
+{
+    return mExclusive && address >= 0 && (size_t) address < mPublished.size() &&
+           mPublished[address].current;
 }
 
 int RestParam::getParam(int& value, int address)
 {
+    if (address < 0) address = 0;
+    if (shadowed(address)) {
+        value = mPublished[address].intValue;
+        return EXIT_SUCCESS;
+    }
     return (int) mSet->getPortDriver()->getIntegerParam(address, mAsynIndex, &value);
 }
 
 int RestParam::getParam(double& value, int address)
 {
+    if (address < 0) address = 0;
+    if (shadowed(address)) {
+        value = mPublished[address].doubleValue;
+        return EXIT_SUCCESS;
+    }
     return (int) mSet->getPortDriver()->getDoubleParam(address, mAsynIndex, &value);
 }
 
 int RestParam::getParam(std::string& value, int address)
 {
+    if (address < 0) address = 0;
+    if (shadowed(address)) {
+        value = mPublished[address].stringValue;
+        return EXIT_SUCCESS;
+    }
     return (int) mSet->getPortDriver()->getStringParam(address, mAsynIndex, value);
 }
 
 int RestParam::setParam(int value, int address)
 {
     if (address < 0) address = 0;
-    return (int) mSet->getPortDriver()->setIntegerParam(address, mAsynIndex, value);
+    int status = (int) mSet->getPortDriver()->setIntegerParam(address, mAsynIndex, value);
+    if (!status && (size_t) address < mPublished.size()) {
+        mPublished[address].valueSet = mPublished[address].current = true;
+        mPublished[address].dirty = false;
+        mPublished[address].intValue = value;
+        publishSnapshot(address);
+    }
+    REST_TRACE(REST_TRACE_SET_PARAM_END, mEndpoint ? mEndpoint->traceId : 0);
+    return status;
 }
 
 int RestParam::setParam(double value, int address)
 {
     if (address < 0) address = 0;
-    return (int) mSet->getPortDriver()->setDoubleParam(address, mAsynIndex, value);
+    int status = (int) mSet->getPortDriver()->setDoubleParam(address, mAsynIndex, value);
+    if (!status && (size_t) address < mPublished.size()) {
+        mPublished[address].valueSet = mPublished[address].current = true;
+        mPublished[address].dirty = false;
+        mPublished[address].doubleValue = value;
+        publishSnapshot(address);
+    }
+    REST_TRACE(REST_TRACE_SET_PARAM_END, mEndpoint ? mEndpoint->traceId : 0);
+    return status;
 }
 
 int RestParam::setParam(const std::string& value, int address)
 {
     if (address < 0) address = 0;
-    return (int) mSet->getPortDriver()->setStringParam(address, mAsynIndex, value);
+    int status = (int) mSet->getPortDriver()->setStringParam(address, mAsynIndex, value);
+    if (!status && (size_t) address < mPublished.size()) {
+        mPublished[address].valueSet = mPublished[address].current = true;
+        mPublished[address].dirty = false;
+        mPublished[address].stringValue = value;
+        if (mEnumValues.size()) {
+            mPublished[address].intValue = mEnumIndex.find(value);
+        }
+        publishSnapshot(address);
+    }
+    REST_TRACE(REST_TRACE_SET_PARAM_END, mEndpoint ? mEndpoint->traceId : 0);
+    return status;
+}
+
+void RestParam::publishSnapshot (int address)
+{
+    RestParamValue const & value = mPublished[address];
+    rest_snapshot_value_t & slot = mSnapshot[address];
+    size_t length;
+
+    mSet->beginPublish();
+    slot.valid = true;
+    switch(mAsynType)
+    {
+    case asynParamInt32:
+        slot.intValue = value.intValue;
+        break;
+    case asynParamFloat64:
+        slot.doubleValue = value.doubleValue;
+        break;
+    default:
+        length = std::min(value.stringValue.size(), (size_t) REST_SNAPSHOT_STRING_SIZE - 1);
+        memcpy(slot.stringValue, value.stringValue.data(), length);
+        slot.stringValue[length] = '\0';
+        slot.intValue = value.intValue;
+        break;
+    }
+    mSet->endPublish();
+}
+
+bool RestParam::confirmed(int address)
+{
+    return (size_t) address < mPublished.size() && mPublished[address].valueSet &&
+           !mPublished[address].dirty;
+}
+
+int RestParam::updateParam(int value, int address)
+{
+    if (address < 0) address = 0;
+    int last;
+    if (confirmed(address) && !getParam(last, address) &&
+        (value == last || (mDeadband && fabs((double) value - last) < mDeadband))) {
+        ++mSuppressed;
+        return EXIT_SUCCESS;
+    }
+    return setParam(value, address);
+}
+
+int RestParam::updateParam(double value, int address)
+{
+    if (address < 0) address = 0;
+    double last;
+    if (confirmed(address) && !getParam(last, address) &&
+        (value == last || (mDeadband && fabs(value - last) < mDeadband))) {
+        ++mSuppressed;
+        return EXIT_SUCCESS;
+    }
+    return setParam(value, address);
+}
+
+int RestParam::updateParam(const std::string& value, int address)
+{
+    if (address < 0) address = 0;
+    std::string last;
+    if (confirmed(address) && !getParam(last, address) && last == value) {
+        ++mSuppressed;
+        return EXIT_SUCCESS;
+    }
+    return setParam(value, address);
 }
 
 int RestParam::setParamStatus(int status, int address)
@@ -379,29 +616,75 @@ int RestParam::setParamStatus(int status, int address)
 
 }
 
+int RestParam::setConnectedStatus(int status, int address)
+{
+    bool connected = status == 0;
+    RestParamValue & published = mPublished[address];
+    if (published.statusSet) {
+        // The driver may have set the status itself unless the parameter
+        // is exclusive, so compare against asyn's
+        asynStatus state;
+        if (mExclusive) {
+            if (published.connected == connected) {
+                return EXIT_SUCCESS;
+            }
+        } else if (!mSet->getPortDriver()->getParamStatus(address, getIndex(), &state) &&
+                   state == (connected ? asynSuccess : asynDisconnected)) {
+            return EXIT_SUCCESS;
+        }
+    }
+
+    int _status = setParamStatus(status, address);
+    published.statusSet = !_status;
+    published.connected = connected;
+    return _status;
+}
+
 int RestParam::setConnectedStatus(int status)
 {
-    mConnected[0] = (bool) status == 0;
-    return setParamStatus(status);
+    return setConnectedStatus(status, 0);
 }
 
 int RestParam::setConnectedStatus(std::vector<int> status)
 {
     int _status = 0;
     for (int index = 0; (size_t) index < mArraySize; ++index) {
-        mConnected[index] = (bool) status[index] == 0;
-        _status |= setParamStatus(status[index], index);
+        _status |= setConnectedStatus(status[index], index);
     }
     return _status;
 }
 
+int RestParam::fetched(int status)
+{
+    status |= setConnectedStatus(status);
+    if (status == 0) {
+        clearErrors();
+    }
+    return status;
+}
+
+void RestParam::clearErrors()
+{
+    unsigned long suppressed = mErrorFilter->clearErrors(this);
+    if (suppressed) {
+        printError("fetch", "Recovered", -1, suppressed);
+    }
+}
+
 RestParam::RestParam(RestParamSet *set, std::string const & asynName, asynParamType asynType,
                      std::string subSystem, std::string const & name)
-    : mErrorFilter(new ErrorFilter()), mSet(set),
+    : mErrorFilter(&set->getErrorFilter()), mSet(set),
       mAsynName(asynName), mAsynType(asynType), mAsynIndex(-1),
-      mSubSystem(subSystem), mName(name), mRemote(!mName.empty()), mPushAll(true),
-      mAccessMode(REST_ACC_RW), mMin(), mMax(), mEnumValues(), mCriticalValues(), mEpsilon(0.0),
-      mCustomEnum(false)
+      mSubSystem(subSystem), mName(name), mRemote(!mName.empty()),
+      mEndpoint(mRemote ? set->getApi()->getEndpoint(mSubSystem, mName) : NULL), mPushAll(true),
+      mType(REST_P_UNINIT), mAccessMode(REST_ACC_RW), mMin(), mMax(), mEnumValues(),
+      mCriticalValues(), mEnumIndex(), mCriticalIndex(), mEpsilon(0.0), mDeadband(0.0),
+      mCustomEnum(false), mArraySize(0),
+      mInitialised(false), mStrictInitialisation(false), mRevalidate(false),
+      mCachedType(false), mPublished(1), mExclusive(false), mSnapshot(NULL), mSuppressed(0),
+      mWriteBehind(false), mWritePending(false), mWriteInFlight(false), mPendingValue(), mWriteStatus(EXIT_SUCCESS),
+      mWriteWaiters(0), mWriteDone(),
+      mPutsRequested(0), mPutsSent(0), mIntValues(), mDoubleValues()
 {
     const char *functionName = "RestParam<asynType>";
 
@@ -420,17 +703,25 @@ RestParam::RestParam(RestParamSet *set, std::string const & asynName, asynParamT
 
   bindAsynParam();
   setTimeout(DEFAULT_TIMEOUT);
+  mSnapshot = mSet->allocateSnapshot(mPublished.size());
 }
 
 RestParam::RestParam(RestParamSet * set, const std::string& asynName, rest_param_type_t restType,
                      const std::string& subSystem, const std::string& name, size_t arraySize,
                      bool strict)
-    : mErrorFilter(new ErrorFilter()), mSet(set),
+    : mErrorFilter(&set->getErrorFilter()), mSet(set),
       mAsynName(asynName), mAsynType(asynParamNotDefined), mAsynIndex(-1),
-      mSubSystem(subSystem), mName(name), mRemote(!mName.empty()), mPushAll(true), mType(restType),
-      mAccessMode(REST_ACC_RW), mMin(), mMax(), mEnumValues(), mCriticalValues(), mEpsilon(0.0),
-      mCustomEnum(false), mArraySize(arraySize), mInitialised(false), mStrictInitialisation(strict),
-      mConnected(std::vector<bool>(mArraySize, false))
+      mSubSystem(subSystem), mName(name), mRemote(!mName.empty()),
+      mEndpoint(mRemote ? set->getApi()->getEndpoint(mSubSystem, mName) : NULL), mPushAll(true),
+      mType(restType),
+      mAccessMode(REST_ACC_RW), mMin(), mMax(), mEnumValues(), mCriticalValues(), mEnumIndex(),
+      mCriticalIndex(), mEpsilon(0.0),
+      mDeadband(0.0), mCustomEnum(false), mArraySize(arraySize), mInitialised(false),
+      mStrictInitialisation(strict), mRevalidate(false), mCachedType(false),
+      mPublished(std::max(mArraySize, (size_t) 1)), mExclusive(false), mSnapshot(NULL), mSuppressed(0),
+      mWriteBehind(false), mWritePending(false), mWriteInFlight(false), mPendingValue(), mWriteStatus(EXIT_SUCCESS),
+      mWriteWaiters(0), mWriteDone(),
+      mPutsRequested(0), mPutsSent(0), mIntValues(), mDoubleValues()
 {
     const char *functionName = "RestParam<restType>";
 
@@ -454,12 +745,18 @@ RestParam::RestParam(RestParamSet * set, const std::string& asynName, rest_param
             throw std::runtime_error(mAsynName);
     }
 
-    // Check if the array size passed is zero so we can ensure mConnected has 1
-    // element to prevent a segmentation fault during fetch
-    if (mArraySize == 0) mConnected.push_back(false);
-
     bindAsynParam();
     setTimeout(DEFAULT_TIMEOUT);
+    mSnapshot = mSet->allocateSnapshot(mPublished.size());
+}
+
+// RestParamSet flushes pending writes before destroying its parameters, so a
+// value is only left here if the set couldn't send it
+RestParam::~RestParam()
+{
+    const char *functionName = "~RestParam";
+    if(mWritePending)
+        ERROR("Pending write of " << mPendingValue << " dropped");
 }
 
 asynStatus RestParam::bindAsynParam()
@@ -517,27 +814,65 @@ void RestParam::setEpsilon (double epsilon)
     mEpsilon = epsilon;
 }
 
+void RestParam::setDeadband (double deadband)
+{
+    mDeadband = deadband;
+}
+
 void RestParam::setTimeout(int timeout)
 {
   mTimeout = timeout;
 }
 
+void RestParam::setWriteBehind(bool enable)
+{
+  mWriteBehind = enable;
+}
+
 int RestParam::getIndex (void)
 {
     return mAsynIndex;
 }
 
+size_t RestParam::getArraySize (void)
+{
+    return mArraySize;
+}
+
 std::string RestParam::getName()
 {
   return mName;
 }
 
+// Rebuild the enum index and the enum indices kept with published strings
+void RestParam::indexEnumValues (void)
+{
+    mEnumIndex.build(mEnumValues);
+    if(mAsynType == asynParamOctet)
+    {
+        for(size_t i = 0; i < mPublished.size(); ++i)
+        {
+            if(mPublished[i].current)
+            {
+                mPublished[i].intValue = mEnumIndex.find(mPublished[i].stringValue);
+                publishSnapshot((int) i);
+            }
+        }
+    }
+}
+
 void RestParam::setEnumValues (vector<string> const & values)
 {
     mEnumValues = values;
+    indexEnumValues();
     mCustomEnum = true;
 }
 
+unsigned long RestParam::getSuppressedUpdates (void)
+{
+    return mSuppressed;
+}
+
 int RestParam::get(bool& value, int address)
 {
     if(mAsynType == asynParamInt32)
@@ -576,6 +911,12 @@ int RestParam::get(int& value, int address)
         getParam(value, address);
     else if(mAsynType == asynParamOctet && mEnumValues.size())
     {
+        if(shadowed(address) && mPublished[address].intValue >= 0)
+        {
+            value = mPublished[address].intValue;
+            return EXIT_SUCCESS;
+        }
+
         string tempValue;
         getParam(tempValue, address);
 
@@ -639,8 +980,20 @@ int RestParam::get(std::vector<std::string>& value)
 }
 
 int RestParam::baseFetch(string & rawValue)
+{
+    struct json_token *token;
+    if(baseFetchToken(token))
+        return EXIT_FAILURE;
+
+    if(token)
+        rawValue.assign(token->ptr, token->len);
+    return EXIT_SUCCESS;
+}
+
+int RestParam::baseFetchToken(struct json_token *& token)
 {
     const char *functionName = "baseFetch";
+    token = NULL;
     if(!mRemote)
     {
         ERROR("Can't fetch local parameter");
@@ -650,42 +1003,40 @@ int RestParam::baseFetch(string & rawValue)
     if(mAccessMode == REST_ACC_WO)
         return EXIT_SUCCESS;
 
-    string buffer;
-    mSet->getApi()->get(mSubSystem, mName, buffer, mTimeout);
-
-    // Parse JSON
-    struct json_token *tokens = new struct json_token[MAX_JSON_TOKENS];
-    int err = parse_json(buffer.c_str(), buffer.size(), tokens, MAX_JSON_TOKENS);
+    // Tokenized while it is received
+    std::string & buffer = mSet->getResponseBuffer();
+    JsonTokenArena & arena = mSet->getTokenArena();
+    mSet->getApi()->get(mEndpoint, buffer, arena, mTimeout);
+    int err = arena.end(buffer.size());
+    REST_TRACE(REST_TRACE_PARSE_END, mEndpoint->traceId);
     if(err < 0)
     {
         ERROR("Failed to parse json response:\n'" << buffer << "'");
-        delete[] tokens;
         return EXIT_FAILURE;
     }
 
-    if (!mInitialised) {
-        if (initialise(tokens)) {
+    if (!mInitialised || mRevalidate) {
+        if (initialise(arena)) {
             ERROR("Failed to initialise param from response:\n'" << buffer << "'");
-            delete[] tokens;
             return EXIT_FAILURE;
         }
     }
 
-    if(parseValue(tokens, rawValue))
+    token = findValue(arena);
+    if(!token)
     {
         ERROR("Failed to parse raw value from response:\n'" << buffer << "'");
-        delete[] tokens;
         return EXIT_FAILURE;
     }
 
-    delete[] tokens;
-    FLOW_ARGS("%s", rawValue.c_str());
+    FLOW_ARGS("%.*s", (int) token->len, token->ptr);
     return EXIT_SUCCESS;
 }
 
-int RestParam::baseFetch(std::vector<std::string>& rawValue)
+int RestParam::baseFetch(struct json_token *& array)
 {
-    const char *functionName = "baseFetch<vector>";
+    const char *functionName = "baseFetch<array>";
+    array = NULL;
     if(!mRemote)
     {
         ERROR("Can't fetch local parameter");
@@ -695,48 +1046,60 @@ int RestParam::baseFetch(std::vector<std::string>& rawValue)
     if(mAccessMode == REST_ACC_WO)
         return EXIT_SUCCESS;
 
-    std::string buffer;
-    mSet->getApi()->get(mSubSystem, mName, buffer, mTimeout);
-
-    // Parse JSON
-    struct json_token *tokens = new struct json_token[MAX_JSON_TOKENS];
-    int err = parse_json(buffer.c_str(), buffer.size(), tokens, MAX_JSON_TOKENS);
+    // Tokenized while it is received. The tokens point into the response,
+    // so it is kept by the set too
+    std::string & buffer = mSet->getResponseBuffer();
+    JsonTokenArena & arena = mSet->getTokenArena();
+    mSet->getApi()->get(mEndpoint, buffer, arena, mTimeout);
+    int err = arena.end(buffer.size());
+    REST_TRACE(REST_TRACE_PARSE_END, mEndpoint->traceId);
     if(err < 0)
     {
         ERROR("Unable to parse json response\n'" << buffer << "'");
-        delete[] tokens;
         return EXIT_FAILURE;
     }
 
-    if (!mInitialised) {
-        if (initialise(tokens)) {
+    if (!mInitialised || mRevalidate) {
+        if (initialise(arena)) {
             ERROR("Failed to initialise param from response:\n'" << buffer << "'");
-            delete[] tokens;
             return EXIT_FAILURE;
         }
     }
 
-    std::vector<std::string> valueArray = parseArray(tokens, mSet->getApi()->PARAM_VALUE);
-    if(valueArray.empty())
+    std::string const & key = mSet->getApi()->PARAM_VALUE;
+    struct json_token *t = key.empty() ? arena.getTokens() : arena.find(key);
+    if(!t || (t->type != JSON_TYPE_ARRAY && t->type != JSON_TYPE_STRING) ||
+       jsonArraySize(t) == 0)
     {
         ERROR("Failed to parse raw value array from response:\n'" << buffer << "'");
-        delete[] tokens;
         return EXIT_FAILURE;
     }
-    for (int index = 0; (size_t) index != valueArray.size(); ++index) {
-        if (valueArray[index] == "null") {
+    for (size_t index = 0; index != jsonArraySize(t); ++index) {
+        struct json_token *element = jsonArrayElement(t, index);
+        if (element->len == 4 && !memcmp(element->ptr, "null", 4)) {
             ERROR("Failed to parse raw value from array:\n'" << buffer << "'");
-            delete[] tokens;
             return EXIT_FAILURE;
         }
     }
 
-    rawValue.resize(valueArray.size(), "");
-    for (int index = 0; (size_t) index != valueArray.size(); ++index) {
-        rawValue[index] = valueArray[index];
-    }
+    array = t;
+    return EXIT_SUCCESS;
+}
+
+int RestParam::baseFetch(std::vector<std::string>& rawValue)
+{
+    struct json_token *array;
+    if(baseFetch(array))
+        return EXIT_FAILURE;
 
-    delete[] tokens;
+    if(array)
+    {
+        rawValue.resize(jsonArraySize(array));
+        for (size_t index = 0; index != rawValue.size(); ++index) {
+            struct json_token *element = jsonArrayElement(array, index);
+            rawValue[index].assign(element->ptr, element->len);
+        }
+    }
     return EXIT_SUCCESS;
 }
 
@@ -770,7 +1133,7 @@ int RestParam::fetch(bool & value)
                 return EXIT_FAILURE;
 
             value = (bool) index;
-            if(setParam((int) index))
+            if(updateParam((int) index))
             {
                 ERROR("Failed to set asyn parameter");
                 return EXIT_FAILURE;
@@ -819,7 +1182,7 @@ std::vector<int> RestParam::fetch(std::vector<bool>& value)
                     return status;
 
                 value[index] = (bool) eIndex;
-                status[index] = setParam((int) eIndex, index);
+                status[index] = updateParam((int) eIndex, index);
                 if (status[index]) {
                     ERROR("Failed to set asyn parameter");
                 }
@@ -873,7 +1236,7 @@ int RestParam::fetch(int & value)
             return EXIT_FAILURE;
         }
 
-        if(setParam(value))
+        if(updateParam(value))
         {
             ERROR("Failed to set asyn parameter");
             return EXIT_FAILURE;
@@ -890,25 +1253,27 @@ std::vector<int> RestParam::fetch(std::vector<int>& value)
 
     std::vector<int> status(mArraySize, 1);
     if (mRemote && mType != REST_P_COMMAND) {
-        std::vector<std::string> rawValue;
-        if (baseFetch(rawValue)) {
+        struct json_token *array;
+        if (baseFetch(array)) {
             ERROR("Underlying baseFetch failed");
             return status;
         }
 
         value.resize(mArraySize);
-        if (rawValue.size() != value.size()){
+        size_t size = array ? jsonArraySize(array) : 0;
+        if (size != value.size()){
             ERROR("Expected array size ["
             << value.size()
             << "] does not match returned array size ["
-            << rawValue.size()
+            << size
             << "]");
             return status;
         }
-        for (int index = 0; (size_t) index != rawValue.size(); ++index) {
+        for (int index = 0; (size_t) index != size; ++index) {
+            struct json_token *element = jsonArrayElement(array, index);
             if (mType == REST_P_ENUM) {
                 size_t eIndex;
-                if (getEnumIndex(rawValue[index], eIndex)) {
+                if (getEnumIndex(string(element->ptr, element->len), eIndex)) {
                     return status;
                 }
 
@@ -916,13 +1281,13 @@ std::vector<int> RestParam::fetch(std::vector<int>& value)
             }
             else if (mType == REST_P_BOOL) {
                 bool tempValue;
-                if (parseValue(rawValue[index], tempValue)) {
+                if (parseValue(string(element->ptr, element->len), tempValue)) {
                     return status;
                 }
                 value[index] = (int) tempValue;
             }
             else if (mType == REST_P_INT || mType == REST_P_UINT) {
-                if (parseValue(rawValue[index], value[index]))
+                if (parseValue(element, value[index]))
                     return status;
             }
             else {
@@ -930,7 +1295,7 @@ std::vector<int> RestParam::fetch(std::vector<int>& value)
                 return status;
             }
 
-            status[index] = setParam(value[index], index);
+            status[index] = updateParam(value[index], index);
             if (status[index]) {
                 ERROR_IDX("Failed to set asyn parameter", index);
             }
@@ -961,7 +1326,7 @@ int RestParam::fetch(double & value)
         if(parseValue(rawValue, value))
             return EXIT_FAILURE;
 
-        if(setParam(value))
+        if(updateParam(value))
         {
             ERROR("Failed to set asyn parameter");
             return EXIT_FAILURE;
@@ -984,24 +1349,25 @@ std::vector<int> RestParam::fetch(std::vector<double>& value)
             return status;
         }
 
-        std::vector<std::string> rawValue;
-        if(baseFetch(rawValue)) {
+        struct json_token *array;
+        if(baseFetch(array)) {
             ERROR("Underlying baseFetch failed");
             return status;
         }
-        if (rawValue.size() != value.size()){
+        size_t size = array ? jsonArraySize(array) : 0;
+        if (size != value.size()){
             ERROR("Expected array size ["
             << value.size()
             << "] does not match returned array size ["
-            << rawValue.size()
+            << size
             << "]");
             return status;
         }
 
-        for (size_t index = 0; index != rawValue.size(); ++index) {
-            status[index] = parseValue(rawValue[index], value[index]);
+        for (size_t index = 0; index != size; ++index) {
+            status[index] = parseValue(jsonArrayElement(array, index), value[index]);
             if (status[index] == 0){
-              status[index] = setParam(value[index], (int) index);
+              status[index] = updateParam(value[index], (int) index);
               if (status[index]) {
                 ERROR_IDX("Failed to set asyn parameter", (int) index);
               }
@@ -1031,7 +1397,7 @@ int RestParam::fetch(string & value)
 
         // TODO: check if it is critical
 
-        if(setParam(value))
+        if(updateParam(value))
         {
             ERROR("Failed to set asyn parameter");
             return EXIT_FAILURE;
@@ -1067,7 +1433,7 @@ std::vector<int> RestParam::fetch(std::vector<std::string>& value)
         }
 
         for (size_t index = 0; index != value.size(); ++index) {
-            status[index] = setParam(value[index], (int) index);
+            status[index] = updateParam(value[index], (int) index);
             if (status[index]) {
                 ERROR_IDX("Failed to set asyn parameter", (int) index);
             }
@@ -1085,13 +1451,11 @@ int RestParam::fetch()
       std::vector<int> fetch_status;
       switch (mAsynType) {
         case asynParamInt32: {
-          std::vector<int> dummy;
-          fetch_status = fetch(dummy);
+          fetch_status = fetch(mIntValues);
           break;
         }
         case asynParamFloat64: {
-          std::vector<double> dummy;
-          fetch_status = fetch(dummy);
+          fetch_status = fetch(mDoubleValues);
           break;
         }
         case asynParamOctet: {
@@ -1103,6 +1467,9 @@ int RestParam::fetch()
       }
       status |= std::accumulate(fetch_status.begin(), fetch_status.end(), 0);
       status |= setConnectedStatus(fetch_status);
+      if (status == 0) {
+        clearErrors();
+      }
     } else {
       switch (mAsynType) {
         case asynParamInt32: {
@@ -1122,19 +1489,15 @@ int RestParam::fetch()
         }
         default:break;
       }
-      status |= setConnectedStatus(status);
-    }
-    if (status == 0) {
-      mErrorFilter->clearErrors();
+      status = fetched(status);
     }
   }
   return status;
 }
 
-int RestParam::push()
+int RestParam::pushValue()
 {
   int status = 0;
-  bool boolValue;
   int intValue;
   double doubleValue;
   std::string stringValue;
@@ -1142,58 +1505,152 @@ int RestParam::push()
   switch (mType)
   {
     case REST_P_BOOL:
-      if (mArraySize){
-        for (size_t index = 0; index < mArraySize; index++){
-          status |= getParam(intValue, index);
-          boolValue = (bool)intValue;
-          status |= this->put(boolValue, index);
-        }
-      } else {
-        status |= getParam(intValue);
-        boolValue = (bool)intValue;
-        status |= this->put(boolValue);
-      }
+      status |= getParam(intValue);
+      status |= this->put((bool)intValue);
       break;
     case REST_P_UINT: case REST_P_INT: case REST_P_ENUM:
-      if (mArraySize){
-        for (size_t index = 0; index < mArraySize; index++){
-          status |= getParam(intValue, index);
-          status |= this->put(intValue, index);
-        }
-      } else {
-        status |= getParam(intValue);
-        status |= this->put(intValue);
-      }
+      status |= getParam(intValue);
+      status |= this->put(intValue);
       break;
     case REST_P_DOUBLE:
-      if (mArraySize){
-        for (size_t index = 0; index < mArraySize; index++){
-          status |= getParam(doubleValue, index);
-          status |= this->put(doubleValue, index);
-        }
-      } else {
-        status |= getParam(doubleValue);
-        status |= this->put(doubleValue);
-      }
+      status |= getParam(doubleValue);
+      status |= this->put(doubleValue);
       break;
     case REST_P_STRING:
-      if (mArraySize){
-        for (size_t index = 0; index < mArraySize; index++){
-          status |= getParam(stringValue, index);
-          status |= this->put(stringValue, index);
-        }
-      } else {
-        status |= getParam(stringValue);
-        status |= this->put(stringValue);
+      status |= getParam(stringValue);
+      status |= this->put(stringValue);
+      break;
+    default:
+      // Do not push anything
+      break;
+  }
+  return status;
+}
+
+bool RestParam::matchesDevice(std::string const & rawValue, int address)
+{
+  int intValue, deviceInt;
+  double doubleValue, deviceDouble;
+  bool deviceBool;
+  size_t enumIndex;
+  std::string stringValue;
+
+  switch (mType)
+  {
+    case REST_P_BOOL:
+      return !parseValue(rawValue, deviceBool) && !getParam(intValue, address) &&
+             (bool)intValue == deviceBool;
+    case REST_P_UINT: case REST_P_INT:
+      return !parseValue(rawValue, deviceInt) && !getParam(intValue, address) &&
+             intValue == deviceInt;
+    case REST_P_DOUBLE:
+      return !parseValue(rawValue, deviceDouble) && !getParam(doubleValue, address) &&
+             (doubleValue == deviceDouble || fabs(doubleValue - deviceDouble) < mEpsilon);
+    case REST_P_ENUM:
+      if (mAsynType == asynParamInt32) {
+        return !getEnumIndex(rawValue, enumIndex) && !getParam(intValue, address) &&
+               (size_t)intValue == enumIndex;
       }
+      return !getParam(stringValue, address) && stringValue == rawValue;
+    case REST_P_STRING:
+      return !getParam(stringValue, address) && stringValue == rawValue;
+    default:
+      // Nothing to push
+      return true;
+  }
+}
+
+int RestParam::pushArray()
+{
+  int status = 0;
+  std::vector<int> putStatus;
+
+  switch (mType)
+  {
+    case REST_P_BOOL: {
+      std::vector<bool> boolValue;
+      status |= get(boolValue);
+      putStatus = this->put(boolValue);
+      break;
+    }
+    case REST_P_UINT: case REST_P_INT: case REST_P_ENUM: {
+      std::vector<int> intValue;
+      status |= get(intValue);
+      putStatus = this->put(intValue);
+      break;
+    }
+    case REST_P_DOUBLE: {
+      std::vector<double> doubleValue;
+      status |= get(doubleValue);
+      putStatus = this->put(doubleValue);
+      break;
+    }
+    case REST_P_STRING: {
+      std::vector<std::string> stringValue;
+      status |= get(stringValue);
+      putStatus = this->put(stringValue);
       break;
+    }
     default:
       // Do not push anything
       break;
   }
+
+  for (size_t index = 0; index < putStatus.size(); ++index) {
+    status |= putStatus[index];
+  }
   return status;
 }
 
+int RestParam::pushChanged()
+{
+  const char *functionName = "pushChanged";
+
+  if (mArraySize) {
+    std::vector<std::string> rawValue;
+    if (baseFetch(rawValue) || rawValue.size() != mArraySize) {
+      ERROR("Failed to fetch device values to compare against");
+      return EXIT_FAILURE;
+    }
+    bool changed = false;
+    for (size_t index = 0; index < mArraySize && !changed; index++) {
+      changed = !matchesDevice(rawValue[index], index);
+    }
+    if (changed) {
+      return pushArray();
+    }
+  } else {
+    std::string rawValue;
+    if (baseFetch(rawValue)) {
+      ERROR("Failed to fetch device value to compare against");
+      return EXIT_FAILURE;
+    }
+    if (!matchesDevice(rawValue)) {
+      return pushValue();
+    }
+  }
+
+  for (size_t index = 0; index < mPublished.size(); index++) {
+    mPublished[index].dirty = false;
+  }
+  return EXIT_SUCCESS;
+}
+
+int RestParam::push(rest_push_mode_t mode)
+{
+  // Write only parameters can't be compared, fall back to dirty tracking
+  if (mode == REST_PUSH_CHANGED && mAccessMode != REST_ACC_WO) {
+    return pushChanged();
+  }
+
+  if (mode != REST_PUSH_ALL && !isDirty()) {
+    return EXIT_SUCCESS;
+  }
+
+  // Arrays are always sent whole, in a single request
+  return mArraySize ? pushArray() : pushValue();
+}
+
 int RestParam::basePut(const std::string & rawValue, int index)
 {
     const char *functionName = "basePut";
@@ -1204,39 +1661,157 @@ int RestParam::basePut(const std::string & rawValue, int index)
         return EXIT_FAILURE;
     }
 
-    std::stringstream endpoint;
+    // Single elements are rarely put, their endpoints aren't kept
+    int status;
+    std::string reply;
     if (index < 0) {
-        endpoint << mName;
+        status = mSet->getApi()->put(mEndpoint, rawValue, &reply, mTimeout);
     }
     else {
+        std::stringstream endpoint;
         endpoint << mName << "/" << index;
+        status = mSet->getApi()->put(mSubSystem, endpoint.str(), rawValue, &reply, mTimeout);
     }
 
-    std::string reply;
-    if(mSet->getApi()->put(mSubSystem, endpoint.str(), rawValue, &reply, mTimeout))
+    if(status)
     {
+        // The device may or may not have applied the value
+        markDirty(index);
         ERROR_IDX("Underlying RestAPI put failed", index);
         return EXIT_FAILURE;
     }
 
-    // Parse JSON
-    if(!reply.empty())
-    {
-        struct json_token *tokens = new struct json_token[MAX_JSON_TOKENS];
-        int err = parse_json(reply.c_str(), reply.size(), tokens, MAX_JSON_TOKENS);
-        if(err < 0)
-        {
-            ERROR("Unable to parse json response\n'" << reply << "'");
-            delete[] tokens;
-            return EXIT_FAILURE;
-        }
+    return handlePutReply(reply);
+}
 
-        mSet->fetchParams(parseArray(tokens));
-        delete[] tokens;
+// The reply to a PUT lists the parameters the write modified
+int RestParam::handlePutReply(std::string const & reply)
+{
+    const char *functionName = "handlePutReply";
+    if(reply.empty())
+        return EXIT_SUCCESS;
+
+    // The tokens are not used past parseArray, queueFetch may reuse the arena
+    JsonTokenArena & arena = mSet->getTokenArena();
+    if(arena.parse(reply) < 0)
+    {
+        ERROR("Unable to parse json response\n'" << reply << "'");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> modified = parseArray(arena);
+    mSet->queueFetch(modified);
+    return EXIT_SUCCESS;
+}
+
+bool RestParam::canWriteBehind(int index)
+{
+    return mWriteBehind && index < 0 &&
+           (mType == REST_P_INT || mType == REST_P_UINT || mType == REST_P_DOUBLE);
+}
+
+// The put only queues the value: how the write went is published later, as
+// the asyn status of the parameter
+int RestParam::queueWrite(std::string const & rawValue)
+{
+    ++mPutsRequested;
+    mPendingValue = rawValue;
+    if(!mWritePending) {
+        mWritePending = true;
+        mSet->queueWrite(this);
     }
     return EXIT_SUCCESS;
 }
 
+int RestParam::flushWrite()
+{
+    const char *functionName = "flushWrite";
+    asynPortDriver *portDriver = mSet->getPortDriver();
+
+    // Another thread is sending; its status is the one to report unless a
+    // newer value was queued meanwhile. Each waiter passes the wakeup on
+    while(mWriteInFlight)
+    {
+        ++mWriteWaiters;
+        portDriver->unlock();
+        mWriteDone.wait();
+        portDriver->lock();
+        --mWriteWaiters;
+        if(!mWriteInFlight && mWriteWaiters)
+            mWriteDone.trigger();
+    }
+
+    if(!mWritePending)
+        return mWriteStatus;
+
+    if(mAccessMode == REST_ACC_RO)
+    {
+        mWritePending = false;
+        ERROR("Can't write to read-only parameter");
+        mWriteStatus = EXIT_FAILURE;
+        return publishWriteStatus();
+    }
+
+    std::string value(mPendingValue);
+    mWritePending = false;
+    mWriteInFlight = true;
+    ++mPutsSent;
+
+    std::string reply;
+    portDriver->unlock();
+    int status = mSet->getApi()->put(mEndpoint, value, &reply, mTimeout);
+    portDriver->lock();
+    mWriteInFlight = false;
+    if(mWriteWaiters)
+        mWriteDone.trigger();
+
+    if(status)
+    {
+        markDirty();
+        ERROR("Underlying RestAPI put failed");
+        mWriteStatus = EXIT_FAILURE;
+    }
+    else if(handlePutReply(reply))
+    {
+        mWriteStatus = EXIT_FAILURE;
+    }
+    else if(mType == REST_P_DOUBLE)
+    {
+        double doubleValue;
+        mWriteStatus = parseValue(value, doubleValue) || setParam(doubleValue);
+    }
+    else
+    {
+        int intValue;
+        mWriteStatus = parseValue(value, intValue) || setParam(intValue);
+    }
+
+    return publishWriteStatus();
+}
+
+// The caller of the put has long returned, so the outcome of the write is
+// published as the asyn status of the parameter: asynError if the write
+// failed, which the next successful fetch or write clears, asynSuccess
+// otherwise. Callbacks are left to the caller (the worker calls them)
+int RestParam::publishWriteStatus()
+{
+    asynStatus state = mWriteStatus ? asynError : asynSuccess;
+    mSet->getPortDriver()->setParamStatus(0, mAsynIndex, state);
+    // No longer the connection status last published by a fetch
+    mPublished[0].statusSet = false;
+    return mWriteStatus;
+}
+
+unsigned long RestParam::getPutsRequested()
+{
+    return mPutsRequested;
+}
+
+unsigned long RestParam::getPutsSent()
+{
+    return mPutsSent;
+}
+
 void RestParam::disablePushAll()
 {
   mPushAll = false;
@@ -1247,6 +1822,218 @@ bool RestParam::canPushAll()
   return mPushAll;
 }
 
+bool RestParam::isInitialised()
+{
+    return mInitialised;
+}
+
+bool RestParam::needsInitialising()
+{
+    // Write only parameters are never fetched, so never initialised
+    return mRemote && !mInitialised && mAccessMode != REST_ACC_WO;
+}
+
+// Each parameter is saved as
+// {"name": <asyn name>, "type": <rest_param_type_t>, "access": <rest_access_mode_t>,
+//  "enum": [...], "critical": [...], "min": <number>, "max": <number>}
+// with the enum and critical values written exactly as the device sent them
+static void writeRawStrings (JsonWriter & writer, const char *key, vector<string> const & values)
+{
+    writer.key(key);
+    writer.beginArray();
+    for (size_t index = 0; index < values.size(); ++index)
+        writer.rawString(values[index]);
+    writer.endArray();
+}
+
+void RestParam::saveMetadata(JsonWriter & writer)
+{
+    if (!mRemote || !mInitialised)
+        return;
+
+    writer.beginObject();
+    writer.key("name");
+    writer.value(mAsynName);
+    writer.key("type");
+    writer.value((int) mType);
+    writer.key("access");
+    writer.value((int) mAccessMode);
+    if (mType == REST_P_ENUM && !mCustomEnum)
+        writeRawStrings(writer, "enum", mEnumValues);
+    if (mStrictInitialisation) {
+        writeRawStrings(writer, "critical", mCriticalValues);
+        rest_min_max_t const *limits[] = {&mMin, &mMax};
+        const char *keys[] = {"min", "max"};
+        for (int limit = 0; limit < 2; ++limit) {
+            if (!limits[limit]->exists)
+                continue;
+            writer.key(keys[limit]);
+            if (mType == REST_P_DOUBLE)
+                writer.value(limits[limit]->valDouble);
+            else
+                writer.value(limits[limit]->valInt);
+        }
+    }
+    writer.endObject();
+}
+
+// Value of key in an object token, NULL if it has no such member
+static struct json_token *findMember (struct json_token *object, const char *key)
+{
+    size_t len = strlen(key);
+    struct json_token *member = object + 1, *end = object + 1 + object->num_desc;
+    while (member < end) {
+        struct json_token *value = member + 1;
+        if ((size_t) member->len == len && !memcmp(member->ptr, key, len))
+            return value;
+        member = value + 1;
+        if (value->type == JSON_TYPE_OBJECT || value->type == JSON_TYPE_ARRAY)
+            member += value->num_desc;
+    }
+    return NULL;
+}
+
+static vector<string> readRawStrings (struct json_token *array)
+{
+    vector<string> values;
+    if (array && array->type == JSON_TYPE_ARRAY) {
+        values.resize(jsonArraySize(array));
+        for (size_t index = 0; index < values.size(); ++index) {
+            struct json_token *element = jsonArrayElement(array, index);
+            values[index].assign(element->ptr, element->len);
+        }
+    }
+    return values;
+}
+
+int RestParam::requestMetadata(std::string & response, JsonTokenArena & arena)
+{
+    const char *functionName = "requestMetadata";
+
+    mSet->getApi()->get(mEndpoint, response, arena, mTimeout);
+    if(arena.end(response.size()) < 0)
+    {
+        ERROR("Failed to parse json response:\n'" << response << "'");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int RestParam::applyMetadata(std::string const & response, JsonTokenArena & arena)
+{
+    const char *functionName = "applyMetadata";
+
+    if(initialise(arena))
+    {
+        ERROR("Failed to initialise param from response:\n'" << response << "'");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int RestParam::loadMetadata(struct json_token *object)
+{
+    const char *functionName = "loadMetadata";
+    int cachedType, cachedAccessMode;
+
+    // Already initialised from the device
+    if (mInitialised)
+        return EXIT_SUCCESS;
+
+    // Nothing changes unless all of it is valid
+    struct json_token *typeToken = findMember(object, "type");
+    struct json_token *accessToken = findMember(object, "access");
+    if (!typeToken || parseJsonNumber(typeToken, cachedType) ||
+        cachedType <= REST_P_UNINIT || cachedType > REST_P_COMMAND ||
+        !accessToken || parseJsonNumber(accessToken, cachedAccessMode) ||
+        cachedAccessMode < REST_ACC_RO || cachedAccessMode > REST_ACC_WO)
+    {
+        ERROR("Invalid cached type or access mode");
+        return EXIT_FAILURE;
+    }
+    rest_param_type_t type = mType == REST_P_UNINIT ? (rest_param_type_t) cachedType : mType;
+
+    vector<string> enumValues(mEnumValues);
+    if (type == REST_P_ENUM && !mCustomEnum) {
+        enumValues = readRawStrings(findMember(object, "enum"));
+        if (enumValues.empty()) {
+            ERROR("No cached enum values");
+            return EXIT_FAILURE;
+        }
+    }
+
+    rest_min_max_t limits[2] = {mMin, mMax};
+    if (mStrictInitialisation) {
+        const char *keys[] = {"min", "max"};
+        for (int limit = 0; limit < 2; ++limit) {
+            struct json_token *t = findMember(object, keys[limit]);
+            limits[limit].exists = t != NULL;
+            if (t && (type == REST_P_DOUBLE ? parseJsonNumber(t, limits[limit].valDouble) :
+                                              parseJsonNumber(t, limits[limit].valInt))) {
+                ERROR("Invalid cached " << keys[limit] << " limit");
+                return EXIT_FAILURE;
+            }
+        }
+        mCriticalValues = readRawStrings(findMember(object, "critical"));
+        mCriticalIndex.build(mCriticalValues);
+    }
+
+    mCachedType = mType == REST_P_UNINIT;
+    mType = type;
+    mAccessMode = (rest_access_mode_t) cachedAccessMode;
+    mEnumValues.swap(enumValues);
+    indexEnumValues();
+    mMin = limits[0];
+    mMax = limits[1];
+    mInitialised = mRevalidate = true;
+    return EXIT_SUCCESS;
+}
+
+void RestParam::markDirty(int address)
+{
+  if (address < 0) {
+    for (size_t index = 0; index < mPublished.size(); ++index) {
+      mPublished[index].dirty = true;
+      mPublished[index].current = false;
+    }
+  } else if ((size_t) address < mPublished.size()) {
+    mPublished[address].dirty = true;
+    mPublished[address].current = false;
+  }
+}
+
+// Until the device confirms the put, which publishes the value and clears
+// it. Unlike markDirty, the asyn value is left as it is
+void RestParam::setDirty(int address)
+{
+  if (address < 0) {
+    for (size_t index = 0; index < mPublished.size(); ++index)
+      mPublished[index].dirty = true;
+  } else if ((size_t) address < mPublished.size()) {
+    mPublished[address].dirty = true;
+  }
+}
+
+void RestParam::setExclusive(bool exclusive)
+{
+  mExclusive = exclusive;
+}
+
+const rest_snapshot_value_t *RestParam::getSnapshot (void)
+{
+    return mSnapshot;
+}
+
+bool RestParam::isDirty()
+{
+  for (size_t index = 0; index < mPublished.size(); ++index) {
+    if (mPublished[index].dirty) {
+      return true;
+    }
+  }
+  return false;
+}
+
 int RestParam::put(bool value, int index)
 {
     const char *functionName = "put<bool>";
@@ -1273,10 +2060,14 @@ int RestParam::put(bool value, int index)
         }
 
         // XOR with mReversedEnum
+        setDirty(index);
         status = basePut(toString(value), index);
     }
     else
+    {
+        setDirty(index);
         status = basePut(toString(value), index);
+    }
 
     if(status){
         return EXIT_FAILURE;
@@ -1291,36 +2082,86 @@ int RestParam::put(bool value, int index)
     return EXIT_SUCCESS;
 }
 
-int RestParam::put(int value, int index)
+int RestParam::beginPut(const char *functionName, int index, unsigned types)
 {
-    const char *functionName = "put<int>";
-    int status;
-    FLOW_ARGS("%d", value);
-    if(mRemote)
+    if (!mInitialised && fetch()) {
+        return EXIT_FAILURE;
+    }
+
+    if(!(types & REST_P_MASK(mType)))
     {
-        if (!mInitialised && fetch()) {
-            return EXIT_FAILURE;
-        }
+        ERROR("Unexpected type for param " << mType);
+        return EXIT_FAILURE;
+    }
 
-        if(mType != REST_P_BOOL && mType != REST_P_INT &&
-           mType != REST_P_UINT && mType != REST_P_ENUM &&
-           mType != REST_P_COMMAND)
+    setDirty(index);
+    return EXIT_SUCCESS;
+}
+
+int RestParam::beginPut(const char *functionName, int & value, int index, unsigned types,
+                        bool & done)
+{
+    done = false;
+    if(!mRemote)
+        return EXIT_SUCCESS;
+
+    if(beginPut(functionName, index, types))
+        return EXIT_FAILURE;
+
+    value = clamp(value);
+    if(canWriteBehind(index))
+    {
+        done = true;
+        return queueWrite(toString(value));
+    }
+    return EXIT_SUCCESS;
+}
+
+int RestParam::beginPut(const char *functionName, double & value, int index, unsigned types,
+                        bool & done)
+{
+    done = false;
+    if(mEpsilon)
+    {
+        double currentValue;
+        getParam(currentValue, index);
+        if(fabs(currentValue - value) < mEpsilon)
         {
-            ERROR("Unexpected type for int param " << mType);
-            return EXIT_FAILURE;
+            done = true;
+            return EXIT_SUCCESS;
         }
+    }
 
-        // Clamp value
-        if(mMin.exists && value < mMin.valInt)
-            value = mMin.valInt;
+    if(!mRemote)
+        return EXIT_SUCCESS;
 
-        if(mMax.exists && value > mMax.valInt)
-            value = mMax.valInt;
+    if(beginPut(functionName, index, types))
+        return EXIT_FAILURE;
 
-        // Protect against trying to write negative values to an unsigned int
-        if(mType == REST_P_UINT && value < 0)
-            value = 0;
+    value = clamp(value, index);
+    if(canWriteBehind(index))
+    {
+        done = true;
+        return queueWrite(toString(value));
+    }
+    return EXIT_SUCCESS;
+}
 
+int RestParam::put(int value, int index)
+{
+    const char *functionName = "put<int>";
+    int status;
+    bool done;
+    FLOW_ARGS("%d", value);
+    status = beginPut(functionName, value, index,
+                      REST_P_MASK(REST_P_BOOL) | REST_P_MASK(REST_P_INT) |
+                      REST_P_MASK(REST_P_UINT) | REST_P_MASK(REST_P_ENUM) |
+                      REST_P_MASK(REST_P_COMMAND), done);
+    if(status || done)
+        return status;
+
+    if(mRemote)
+    {
         if(mType == REST_P_BOOL)
             status = basePut(toString((bool)value), index);
         else
@@ -1349,41 +2190,14 @@ int RestParam::put(int value, int index)
 int RestParam::put(double value, int index)
 {
     const char *functionName = "put<double>";
+    bool done;
     FLOW_ARGS("%lf", value);
-    if(mEpsilon)
-    {
-        double currentValue;
-        getParam(currentValue, index);
-        if(fabs(currentValue - value) < mEpsilon)
-            return EXIT_SUCCESS;
-    }
-
-    if(mRemote)
-    {
-        if (!mInitialised && fetch()) {
-            return EXIT_FAILURE;
-        }
-
-        if(mType != REST_P_DOUBLE)
-            return EXIT_FAILURE;
-
-        // Clamp value
-        if(mMin.exists && (value < mMin.valDouble))
-        {
-            value = mMin.valDouble;
-            ERROR_IDX("PUT value clamped to minimum: " << value, index);
-        }
-
-        if(mMax.exists && (value > mMax.valDouble))
-        {
-            value = mMax.valDouble;
-            ERROR_IDX("PUT value clamped to maximum: " << value, index);
-        }
+    int status = beginPut(functionName, value, index, REST_P_MASK(REST_P_DOUBLE), done);
+    if(status || done)
+        return status;
 
-        if(basePut(toString(value), index)){
-            return EXIT_FAILURE;
-        }
-    }
+    if(mRemote && basePut(toString(value), index))
+        return EXIT_FAILURE;
 
     if(setParam(value, index))
     {
@@ -1416,6 +2230,7 @@ int RestParam::put(const std::string& value, int index)
         return EXIT_FAILURE;
     }
 
+    setDirty(index);
     if(basePut(toString(value), index)) {
         return EXIT_FAILURE;
     }
@@ -1441,50 +2256,325 @@ int RestParam::put(const char * value, int index)
     return put(string(value), index);
 }
 
-void RestParam::setError(const char* functionName, std::string error, int index)
+int RestParam::basePut(std::vector<std::string> const & rawValues)
 {
-    std::stringstream indexSS;
-    if (index >= 0) {
-        indexSS << "[" << index << "]";
+    const char *functionName = "basePut<vector>";
+
+    if (rawValues.size() != mArraySize) {
+        ERROR("Expected array size ["
+              << mArraySize
+              << "] does not match given array size ["
+              << rawValues.size()
+              << "]");
+        return EXIT_FAILURE;
+    }
+    return basePut(toString(rawValues));
+}
+
+std::vector<int> RestParam::put(std::vector<bool> const & value)
+{
+    std::vector<int> intValue(value.begin(), value.end());
+    return put(intValue);
+}
+
+std::vector<int> RestParam::put(std::vector<int> const & value)
+{
+    const char *functionName = "put<vector<int>>";
+    std::vector<int> status(value.size(), EXIT_FAILURE);
+    std::vector<int> clamped(value);
+
+    if(mRemote)
+    {
+        if (!mInitialised && fetch()) {
+            return status;
+        }
+
+        if(mType != REST_P_BOOL && mType != REST_P_INT &&
+           mType != REST_P_UINT && mType != REST_P_ENUM)
+        {
+            ERROR("Unexpected type for int param " << mType);
+            return status;
+        }
+
+        std::vector<std::string> rawValues(clamped.size());
+        for (size_t index = 0; index < clamped.size(); ++index) {
+            clamped[index] = clamp(clamped[index]);
+            if(mType == REST_P_BOOL)
+                rawValues[index] = toString((bool)clamped[index]);
+            else if((rawValues[index] = toString(clamped[index])).empty())
+                return status;
+        }
+
+        setDirty(-1);
+        if(basePut(rawValues))
+        {
+            ERROR("Underlying basePut failed");
+            return status;
+        }
+    }
+
+    for (size_t index = 0; index < clamped.size(); ++index) {
+        if(mAsynType == asynParamInt32)
+            status[index] = setParam(clamped[index], (int) index);
+        else
+            status[index] = setParam(mEnumValues[clamped[index]], (int) index);
+
+        if(status[index])
+            ERROR_IDX("Failed to set asyn parameter", (int) index);
+    }
+    return status;
+}
+
+std::vector<int> RestParam::put(std::vector<double> const & value)
+{
+    const char *functionName = "put<vector<double>>";
+    std::vector<int> status(value.size(), EXIT_FAILURE);
+    std::vector<double> clamped(value);
+
+    if(mRemote)
+    {
+        if (!mInitialised && fetch()) {
+            return status;
+        }
+
+        if(mType != REST_P_DOUBLE)
+            return status;
+
+        std::vector<std::string> rawValues(clamped.size());
+        for (size_t index = 0; index < clamped.size(); ++index) {
+            clamped[index] = clamp(clamped[index], (int) index);
+            rawValues[index] = toString(clamped[index]);
+        }
+
+        setDirty(-1);
+        if(basePut(rawValues))
+            return status;
     }
-    std::stringstream errorMessage;
-    errorMessage << "RestParam[" << mAsynName << " -> " << mName << indexSS.str() << "]::"
-                 << functionName << ": " << error << "\n";
 
-    if (mErrorFilter->newError(errorMessage.str())) {
-        asynPrint(mSet->getUser(), ASYN_TRACE_ERROR, errorMessage.str().c_str());
+    for (size_t index = 0; index < clamped.size(); ++index) {
+        status[index] = setParam(clamped[index], (int) index);
+        if(status[index])
+            ERROR_IDX("Failed to set asyn parameter", (int) index);
     }
+    return status;
 }
 
+std::vector<int> RestParam::put(std::vector<std::string> const & value)
+{
+    const char *functionName = "put<vector<string>>";
+    std::vector<int> status(value.size(), EXIT_FAILURE);
+    std::vector<size_t> eIndex(value.size());
+
+    if(mRemote)
+    {
+        if (!mInitialised && fetch()) {
+            return status;
+        }
+
+        if(mType != REST_P_STRING && mType != REST_P_ENUM) {
+            return status;
+        }
+
+        std::vector<std::string> rawValues(value.size());
+        for (size_t index = 0; index < value.size(); ++index) {
+            if(mType == REST_P_ENUM && getEnumIndex(value[index], eIndex[index])) {
+                return status;
+            }
+            rawValues[index] = toString(value[index]);
+        }
+
+        setDirty(-1);
+        if(basePut(rawValues)) {
+            return status;
+        }
+    }
+
+    for (size_t index = 0; index < value.size(); ++index) {
+        if(mRemote && mAsynType == asynParamInt32)
+            status[index] = setParam((int)eIndex[index], (int) index);
+        else
+            status[index] = setParam(value[index], (int) index);
+
+        if(status[index])
+            ERROR_IDX("Failed to set asyn parameter", (int) index);
+    }
+    return status;
+}
+
+void RestParam::setError(const char* functionName, std::string const & error, int index)
+{
+    unsigned long suppressed;
+    if (mErrorFilter->newError(ErrorFilter::key(functionName, error, index), suppressed, this)) {
+        printError(functionName, error, index, suppressed);
+    }
+}
+
+void RestParam::printError(const char* functionName, std::string const & error, int index,
+                           unsigned long suppressed)
+{
+    char number[48];
+    std::string message("RestParam[");
+    message.append(mAsynName).append(" -> ").append(mName);
+    if (index >= 0) {
+        epicsSnprintf(number, sizeof(number), "[%d]", index);
+        message.append(number);
+    }
+    message.append("]::").append(functionName).append(": ").append(error);
+    if (suppressed) {
+        epicsSnprintf(number, sizeof(number), " (%lu repeats suppressed)", suppressed);
+        message.append(number);
+    }
+    message.append("\n");
+    asynPrint(mSet->getUser(), ASYN_TRACE_ERROR, "%s", message.c_str());
+}
+
+
+static void workerTaskC (void *set)
+{
+    ((RestParamSet *) set)->workerTask();
+}
 
 RestParamSet::RestParamSet (asynPortDriver *portDriver, RestAPI *api,
         asynUser *user)
-: mPortDriver(portDriver), mApi(api), mUser(user), mConfigMap(), mAsynMap()
+: mPortDriver(portDriver), mApi(api), mUser(user), mBlocks(), mBlockUsed(REST_PARAM_BLOCK),
+  mParams(), mByIndex(), mNamed(), mNames(), mTokenArena(), mResponse(), mFetchQueue(), mWriteQueue(), mFetchQueued(), mWorkLock(), mWorkEvent(),
+  mWorkExited(), mBackgroundFetch(true), mWorkExiting(false),
+  mWorkStarted(false), mCached(), mMetadataStale(false),
+  mSnapshotSequence(0), mSnapshotBlocks(), mSnapshotNext(NULL), mSnapshotFree(0),
+  mStats(), mErrorFilter(ERROR_FILTER_INTERVAL, REST_PARAM_ERROR_SLOTS)
 {}
 
-RestParam *RestParamSet::create(std::string const & asynName, asynParamType asynType,
-                                std::string subSystem, std::string const & name)
+RestParamSet::~RestParamSet ()
+{
+    bool started;
+    {
+        epicsGuard<epicsMutex> guard(mWorkLock);
+        mWorkExiting = true;
+        started = mWorkStarted;
+    }
+    if(started)
+    {
+        mWorkEvent.trigger();
+        mWorkExited.wait();
+    }
+
+    // Coalesced values still waiting for the worker are sent, not dropped
+    flushWrites();
+
+    vector<RestParam*>::iterator it;
+    for(it = mParams.begin(); it != mParams.end(); ++it)
+        (*it)->~RestParam();
+    vector<char*>::iterator block;
+    for(block = mBlocks.begin(); block != mBlocks.end(); ++block)
+        delete[] *block;
+    vector<rest_snapshot_value_t*>::iterator slots;
+    for(slots = mSnapshotBlocks.begin(); slots != mSnapshotBlocks.end(); ++slots)
+        delete[] *slots;
+}
+
+// Storage for the next parameter, only taken by add() once it is
+// constructed: a constructor that throws leaves it for the next
+void *RestParamSet::allocate (void)
 {
-    RestParam *p = new RestParam(this, asynName, asynType, subSystem, name);
+    if(mBlockUsed == REST_PARAM_BLOCK)
+    {
+        mBlocks.push_back(new char[REST_PARAM_BLOCK * sizeof(RestParam)]);
+        mBlockUsed = 0;
+    }
+    return mBlocks.back() + mBlockUsed * sizeof(RestParam);
+}
+
+RestParam *RestParamSet::add (RestParam *p)
+{
+    ++mBlockUsed;
+
+    size_t index = (size_t) p->getIndex();
+    if(index >= mByIndex.size())
+        mByIndex.resize(index + 1, NULL);
+    mByIndex[index] = p;
 
-    mAsynMap.insert(std::make_pair(p->getIndex(), p));
+    // Parameters are mostly created in asyn index order
+    if(mParams.empty() || mParams.back()->getIndex() < p->getIndex())
+        mParams.push_back(p);
+    else
+    {
+        vector<RestParam*>::iterator it = mParams.begin();
+        while((*it)->getIndex() < p->getIndex())
+            ++it;
+        mParams.insert(it, p);
+    }
     return p;
 }
 
+rest_snapshot_value_t *RestParamSet::allocateSnapshot (size_t count)
+{
+    if(count > mSnapshotFree)
+    {
+        mSnapshotFree = std::max(count, (size_t) REST_SNAPSHOT_BLOCK);
+        mSnapshotBlocks.push_back(new rest_snapshot_value_t[mSnapshotFree]());
+        mSnapshotNext = mSnapshotBlocks.back();
+    }
+    rest_snapshot_value_t *slots = mSnapshotNext;
+    mSnapshotNext += count;
+    mSnapshotFree -= count;
+    return slots;
+}
+
+// Publishers are serialised by the port driver lock
+void RestParamSet::beginPublish (void)
+{
+    epicsAtomicIncrSizeT(&mSnapshotSequence);
+    epicsAtomicWriteMemoryBarrier();
+}
+
+void RestParamSet::endPublish (void)
+{
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicIncrSizeT(&mSnapshotSequence);
+}
+
+void RestParamSet::snapshot (vector<RestParam*> const & params,
+                             vector<rest_snapshot_value_t> & values)
+{
+    values.resize(params.size());
+    for(int attempt = 1; ; ++attempt)
+    {
+        size_t sequence = epicsAtomicGetSizeT(&mSnapshotSequence);
+        if(!(sequence & 1))
+        {
+            epicsAtomicReadMemoryBarrier();
+            for(size_t i = 0; i < params.size(); ++i)
+                values[i] = params[i]->getSnapshot()[0];
+            epicsAtomicReadMemoryBarrier();
+            if(epicsAtomicGetSizeT(&mSnapshotSequence) == sequence)
+                return;
+        }
+        // Let a publisher that was preempted mid-value finish
+        if(attempt % REST_SNAPSHOT_SPINS == 0)
+            epicsThreadSleep(0.0);
+    }
+}
+
+RestParam *RestParamSet::create(std::string const & asynName, asynParamType asynType,
+                                std::string subSystem, std::string const & name)
+{
+    return add(new (allocate()) RestParam(this, asynName, asynType, subSystem, name));
+}
+
 RestParam * RestParamSet::create(const std::string& asynName, rest_param_type_t restType,
                                  const std::string& subSystem, std::string const & name,
                                  size_t arraySize, bool strict)
 {
-  RestParam * p = new RestParam(this, asynName, restType, subSystem, name, arraySize, strict);
-
-  mAsynMap.insert(std::make_pair(p->getIndex(), p));
-  return p;
+  return add(new (allocate()) RestParam(this, asynName, restType, subSystem, name, arraySize,
+                                       strict));
 }
 
 void RestParamSet::addToConfigMap(std::string const & name, RestParam *p)
 {
-    if(!name.empty()) {
-        mConfigMap.insert(std::make_pair(name, p));
+    // The first parameter given a name keeps it
+    if(!name.empty() && mNames.find(name) < 0) {
+        mNames.add(name);
+        mNamed.push_back(p);
     }
 }
 
@@ -1498,21 +2588,29 @@ RestAPI *RestParamSet::getApi (void)
     return mApi;
 }
 
+JsonTokenArena & RestParamSet::getTokenArena (void)
+{
+    return mTokenArena;
+}
+
+std::string & RestParamSet::getResponseBuffer (void)
+{
+    return mResponse;
+}
+
 RestParam *RestParamSet::getByName (string const & name)
 {
-    rest_param_map_t::iterator item(mConfigMap.find(name));
+    int position = mNames.find(name);
 
-    if(item != mConfigMap.end())
-        return item->second;
+    if(position >= 0)
+        return mNamed[position];
     return NULL;
 }
 
 RestParam *RestParamSet::getByIndex (int index)
 {
-    rest_asyn_map_t::iterator item(mAsynMap.find(index));
-
-    if(item != mAsynMap.end())
-        return item->second;
+    if(index >= 0 && (size_t) index < mByIndex.size())
+        return mByIndex[index];
     return NULL;
 }
 
@@ -1525,26 +2623,452 @@ int RestParamSet::fetchAll (void)
 {
     int status = EXIT_SUCCESS;
 
-    rest_asyn_map_t::iterator it;
-    for(it = mAsynMap.begin(); it != mAsynMap.end(); ++it)
-        status |= it->second->fetch();
+    vector<RestParam*>::iterator it;
+    for(it = mParams.begin(); it != mParams.end(); ++it)
+        status |= (*it)->fetch();
 
     return status;
 }
 
-int RestParamSet::pushAll (void)
+int RestParamSet::pushAll (rest_push_mode_t mode)
 {
     int status = EXIT_SUCCESS;
 
-    rest_asyn_map_t::iterator it;
-    for(it = mAsynMap.begin(); it != mAsynMap.end(); ++it){
-      if (it->second->canPushAll()){
-        status |= it->second->push();
+    vector<RestParam*>::iterator it;
+    for(it = mParams.begin(); it != mParams.end(); ++it){
+      if ((*it)->canPushAll()){
+        status |= (*it)->push(mode);
       }
     }
     return status;
 }
 
+int RestParamSet::createStats (string const & prefix, string const & subSystem,
+                               string const & name)
+{
+    rest_stats_params_t params;
+    params.stats = name.empty() ? &mApi->getHostStats() :
+                                  mApi->getEndpoint(subSystem, name)->stats;
+    params.p50 = create(prefix + "_P50", REST_P_DOUBLE);
+    params.p99 = create(prefix + "_P99", REST_P_DOUBLE);
+    params.max = create(prefix + "_MAX", REST_P_DOUBLE);
+    params.rate = create(prefix + "_RATE", REST_P_DOUBLE);
+    // Totals are Float64, exact up to 2^53, where an Int32 would wrap
+    params.requests = create(prefix + "_REQUESTS", REST_P_DOUBLE);
+    params.errors = create(prefix + "_ERRORS", REST_P_DOUBLE);
+    params.bytes = create(prefix + "_BYTES", REST_P_DOUBLE);
+    params.checkoutP99 = create(prefix + "_CHECKOUT_P99", REST_P_DOUBLE);
+    params.networkP99 = create(prefix + "_NETWORK_P99", REST_P_DOUBLE);
+    params.parseP99 = create(prefix + "_PARSE_P99", REST_P_DOUBLE);
+    params.lastRequests = 0;
+    params.lastUpdate = epicsMonotonicGet();
+    mStats.push_back(params);
+    return EXIT_SUCCESS;
+}
+
+int RestParamSet::updateStats (void)
+{
+    int status = EXIT_SUCCESS;
+    epicsUInt64 now = epicsMonotonicGet();
+
+    vector<rest_stats_params_t>::iterator it;
+    for(it = mStats.begin(); it != mStats.end(); ++it)
+    {
+        rest_request_summary_t summary;
+        it->stats->summarise(summary);
+        double elapsed = (now - it->lastUpdate) * 1e-9;
+        double rate = elapsed > 0.0 ? (summary.requests - it->lastRequests) / elapsed : 0.0;
+        it->lastRequests = summary.requests;
+        it->lastUpdate = now;
+
+        status |= it->p50->put(summary.p50);
+        status |= it->p99->put(summary.p99);
+        status |= it->max->put(summary.max);
+        status |= it->rate->put(rate);
+        status |= it->requests->put((double) summary.requests);
+        status |= it->errors->put((double) summary.errors);
+        status |= it->bytes->put((double) summary.bytes);
+        status |= it->checkoutP99->put(summary.checkoutP99);
+        status |= it->networkP99->put(summary.networkP99);
+        status |= it->parseP99->put(summary.parseP99);
+    }
+    flushErrors();
+    return status;
+}
+
+ErrorFilter & RestParamSet::getErrorFilter (void)
+{
+    return mErrorFilter;
+}
+
+void RestParamSet::flushErrors (void)
+{
+    const char *functionName = "flushErrors";
+    unsigned long suppressed = mErrorFilter.flush();
+    if(suppressed)
+        asynPrint(mUser, ASYN_TRACE_ERROR, "RestParamSet::%s: %lu error repeats suppressed\n",
+                  functionName, suppressed);
+}
+
+unsigned long RestParamSet::getSuppressedUpdates (void)
+{
+    unsigned long suppressed = 0;
+
+    vector<RestParam*>::iterator it;
+    for(it = mParams.begin(); it != mParams.end(); ++it)
+        suppressed += (*it)->getSuppressedUpdates();
+
+    return suppressed;
+}
+
+void RestParamSet::queueFetch (vector<string> const & params)
+{
+    vector<RestParam*> found;
+    vector<string>::const_iterator param;
+    for(param = params.begin(); param != params.end(); ++param)
+    {
+        RestParam *p = getByName(*param);
+        if(p)
+            found.push_back(p);
+    }
+    queueFetch(found);
+}
+
+void RestParamSet::queueFetch (vector<RestParam*> const & params)
+{
+    bool queued = false;
+    {
+        epicsGuard<epicsMutex> guard(mWorkLock);
+        vector<RestParam*>::const_iterator p;
+        for(p = params.begin(); p != params.end(); ++p)
+        {
+            if(mFetchQueued.insert(*p).second)
+            {
+                mFetchQueue.push_back(*p);
+                queued = true;
+            }
+        }
+    }
+
+    if(!queued)
+        return;
+
+    if(mBackgroundFetch)
+    {
+        startWorker();
+        mWorkEvent.trigger();
+    }
+    else
+        flushFetchQueue();
+}
+
+int RestParamSet::flushFetchQueue (void)
+{
+    int status = EXIT_SUCCESS;
+
+    for(;;)
+    {
+        RestParam *p;
+        {
+            epicsGuard<epicsMutex> guard(mWorkLock);
+            if(mFetchQueue.empty())
+                break;
+            p = mFetchQueue.front();
+            mFetchQueue.pop_front();
+            mFetchQueued.erase(p);
+        }
+
+        // The port lock is recursive, so this is safe from driver threads
+        // that already hold it
+        mPortDriver->lock();
+        status |= p->fetch();
+        size_t addresses = std::max(p->getArraySize(), (size_t) 1);
+        for(size_t address = 0; address < addresses; ++address)
+            mPortDriver->callParamCallbacks((int) address);
+        mPortDriver->unlock();
+    }
+
+    return status;
+}
+
+void RestParamSet::setBackgroundFetch (bool enable)
+{
+    mBackgroundFetch = enable;
+    if(!enable)
+        flushFetchQueue();
+}
+
+// Work shared by the threads of RestParamSet::initialiseAll
+typedef struct
+{
+    RestParamSet *set;
+    vector<RestParam*> params;
+    size_t next;
+    int running;
+    vector<string> failed;
+    epicsMutex lock;
+    epicsEvent done;
+} rest_init_job_t;
+
+static void initialiseTask (rest_init_job_t *job)
+{
+    string response;
+    JsonTokenArena arena;
+    asynPortDriver *driver = job->set->getPortDriver();
+
+    for(;;)
+    {
+        RestParam *p;
+        {
+            epicsGuard<epicsMutex> guard(job->lock);
+            if(job->next == job->params.size())
+                break;
+            p = job->params[job->next++];
+        }
+
+        int status = p->requestMetadata(response, arena);
+        if(!status)
+        {
+            driver->lock();
+            status = p->applyMetadata(response, arena);
+            driver->unlock();
+        }
+
+        if(status)
+        {
+            epicsGuard<epicsMutex> guard(job->lock);
+            job->failed.push_back(p->getName());
+        }
+    }
+
+    bool last;
+    {
+        epicsGuard<epicsMutex> guard(job->lock);
+        last = --job->running == 0;
+    }
+    if(last)
+        job->done.trigger();
+}
+
+static void initialiseTaskC (void *job)
+{
+    initialiseTask((rest_init_job_t *) job);
+}
+
+int RestParamSet::initialiseAll (int parallelism, vector<string> *failed)
+{
+    const char *functionName = "initialiseAll";
+    rest_init_job_t job;
+    job.set = this;
+    job.next = 0;
+
+    mPortDriver->lock();
+    vector<RestParam*>::iterator it;
+    for(it = mParams.begin(); it != mParams.end(); ++it)
+    {
+        if((*it)->needsInitialising())
+            job.params.push_back(*it);
+    }
+    mPortDriver->unlock();
+
+    int sockets = (int) mApi->getNumSockets() - 1;
+    parallelism = std::min(parallelism, std::max(sockets, 1));
+    parallelism = std::max(std::min(parallelism, (int) job.params.size()), 1);
+
+    // The calling thread is one of the workers
+    job.running = parallelism;
+    for(int thread = 1; thread < parallelism; ++thread)
+        epicsThreadMustCreate("restInit", epicsThreadPriorityMedium,
+                epicsThreadGetStackSize(epicsThreadStackMedium),
+                (EPICSTHREADFUNC) initialiseTaskC, &job);
+    initialiseTask(&job);
+    job.done.wait();
+
+    vector<string>::iterator name;
+    for(name = job.failed.begin(); name != job.failed.end(); ++name)
+        asynPrint(mUser, ASYN_TRACE_ERROR, "RestParamSet::%s: failed to initialise %s\n",
+                functionName, name->c_str());
+
+    if(failed)
+        failed->insert(failed->end(), job.failed.begin(), job.failed.end());
+    return job.failed.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int RestParamSet::saveMetadata (string const & path, string const & version)
+{
+    const char *functionName = "saveMetadata";
+    string json;
+    JsonWriter writer(json);
+
+    writer.beginObject();
+    writer.key("version");
+    writer.value(version);
+    writer.key("params");
+    writer.beginArray();
+    vector<RestParam*>::iterator it;
+    for(it = mParams.begin(); it != mParams.end(); ++it)
+        (*it)->saveMetadata(writer);
+    writer.endArray();
+    writer.endObject();
+    json += '\n';
+
+    // Written aside and renamed, so that a cache is never left half written
+    string temporary(path + ".tmp");
+    FILE *file = fopen(temporary.c_str(), "w");
+    if(!file)
+    {
+        asynPrint(mUser, ASYN_TRACE_ERROR, "RestParamSet::%s: failed to open %s\n",
+                functionName, temporary.c_str());
+        return EXIT_FAILURE;
+    }
+    bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    if(fclose(file) || !written || rename(temporary.c_str(), path.c_str()))
+    {
+        asynPrint(mUser, ASYN_TRACE_ERROR, "RestParamSet::%s: failed to write %s\n",
+                functionName, path.c_str());
+        remove(temporary.c_str());
+        return EXIT_FAILURE;
+    }
+
+    mMetadataStale = false;
+    return EXIT_SUCCESS;
+}
+
+int RestParamSet::loadMetadata (string const & path, string const & version)
+{
+    const char *functionName = "loadMetadata";
+    FILE *file = fopen(path.c_str(), "r");
+    if(!file)
+    {
+        asynPrint(mUser, ASYN_TRACE_FLOW, "RestParamSet::%s: no cache at %s\n",
+                functionName, path.c_str());
+        return EXIT_FAILURE;
+    }
+    string json;
+    char buffer[4096];
+    size_t count;
+    while((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        json.append(buffer, count);
+    fclose(file);
+
+    JsonTokenArena arena;
+    string expected;
+    JsonWriter::escape(expected, version.data(), version.size());
+    struct json_token *saved, *params;
+    if(arena.parse(json) < 0 || !(saved = arena.find("version")) ||
+       !(params = arena.find("params")) || params->type != JSON_TYPE_ARRAY)
+    {
+        asynPrint(mUser, ASYN_TRACE_ERROR, "RestParamSet::%s: invalid cache %s\n",
+                functionName, path.c_str());
+        return EXIT_FAILURE;
+    }
+    if(string(saved->ptr, saved->len) != expected)
+    {
+        asynPrint(mUser, ASYN_TRACE_FLOW,
+                "RestParamSet::%s: cache %s is for server version %s, not %s\n",
+                functionName, path.c_str(), string(saved->ptr, saved->len).c_str(),
+                version.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Parameters the driver no longer creates are ignored
+    struct json_token *object = params + 1, *end = params + 1 + params->num_desc;
+    for(; object < end; object += 1 + object->num_desc)
+    {
+        struct json_token *name = object->type == JSON_TYPE_OBJECT ?
+                findMember(object, "name") : NULL;
+        int index;
+        RestParam *p;
+        if(!name || mPortDriver->findParam(string(name->ptr, name->len).c_str(), &index) ||
+           !(p = getByIndex(index)) || p->isInitialised())
+            continue;
+        if(!p->loadMetadata(object))
+            mCached.push_back(p);
+    }
+    return EXIT_SUCCESS;
+}
+
+void RestParamSet::revalidateMetadata (void)
+{
+    vector<RestParam*> cached;
+    cached.swap(mCached);
+    queueFetch(cached);
+}
+
+bool RestParamSet::isMetadataStale (void)
+{
+    return mMetadataStale;
+}
+
+void RestParamSet::setMetadataStale (void)
+{
+    mMetadataStale = true;
+}
+
+void RestParamSet::queueWrite (RestParam *param)
+{
+    {
+        epicsGuard<epicsMutex> guard(mWorkLock);
+        mWriteQueue.push_back(param);
+    }
+    startWorker();
+    mWorkEvent.trigger();
+}
+
+int RestParamSet::flushWrites (void)
+{
+    int status = EXIT_SUCCESS;
+
+    for(;;)
+    {
+        RestParam *p;
+        {
+            epicsGuard<epicsMutex> guard(mWorkLock);
+            if(mWriteQueue.empty())
+                break;
+            p = mWriteQueue.front();
+            mWriteQueue.pop_front();
+        }
+
+        mPortDriver->lock();
+        status |= p->flushWrite();
+        mPortDriver->callParamCallbacks();
+        mPortDriver->unlock();
+    }
+
+    return status;
+}
+
+// The worker is only needed for background fetches and write-behind, so it
+// is started by the first of them
+void RestParamSet::startWorker (void)
+{
+    epicsGuard<epicsMutex> guard(mWorkLock);
+    if(mWorkStarted || mWorkExiting)
+        return;
+    epicsThreadMustCreate("restWorker", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            (EPICSTHREADFUNC) workerTaskC, this);
+    mWorkStarted = true;
+}
+
+void RestParamSet::workerTask (void)
+{
+    for(;;)
+    {
+        mWorkEvent.wait();
+        {
+            epicsGuard<epicsMutex> guard(mWorkLock);
+            if(mWorkExiting)
+                break;
+        }
+        // Writes first, their replies may queue more fetches
+        flushWrites();
+        flushFetchQueue();
+    }
+    mWorkExited.trigger();
+}
+
 int RestParamSet::fetchParams (vector<string> const & params)
 {
     int status = EXIT_SUCCESS;
@@ -4,20 +4,69 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <deque>
 #include <asynPortDriver.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
 #include <frozen.h>
 #include <stdlib.h>
 
 #include "restDefinitions.h"
 #include "restApi.h"
 #include "errorFilter.h"
+#include "jsonTokenArena.h"
+#include "jsonWriter.h"
+#include "restStringIndex.h"
+
+#define DEFAULT_INIT_PARALLELISM 4
+#define REST_PARAM_BLOCK 64
+#define REST_SNAPSHOT_BLOCK 256
+#define REST_SNAPSHOT_STRING_SIZE 40
+// Bit of a rest_param_type_t in a mask of the types a put accepts
+#define REST_P_MASK(type) (1u << (type))
+// Errors the parameters of a set remember at once
+#define REST_PARAM_ERROR_SLOTS 1024
 
 class RestParamSet;
 
+// Last value and connection status published to the asyn parameter library
+// at one address, used to skip updates that would not change anything.
+// dirty is set while the asyn value, or a value being put, has not been
+// confirmed by the device. current is set while the value is also the asyn
+// parameter's, so that an exclusive parameter can read it back without going
+// through the parameter library; markDirty clears it. For enums kept as
+// strings, intValue is the enum index (or -1).
+struct RestParamValue
+{
+    bool valueSet, statusSet, connected, dirty, current;
+    int intValue;
+    double doubleValue;
+    std::string stringValue;
+
+    RestParamValue() : valueSet(false), statusSet(false), connected(false), dirty(true),
+                       current(false), intValue(0), doubleValue(0.0), stringValue() {}
+};
+
+// A parameter value as published to RestParamSet's snapshot buffer. Strings
+// longer than REST_SNAPSHOT_STRING_SIZE - 1 characters are truncated
+typedef struct
+{
+    bool valid;
+    int intValue;
+    double doubleValue;
+    char stringValue[REST_SNAPSHOT_STRING_SIZE];
+} rest_snapshot_value_t;
+
 class RestParam
 {
+    // The typed front end (typedRestParam.h) works on the internals directly
+    template <typename T> friend class TypedRestParam;
+    // Parameters live in the storage of their set, which destroys them
+    friend class RestParamSet;
 
 private:
+    // The set's, shared by its parameters
     ErrorFilter* mErrorFilter;
     RestParamSet *mSet;
     std::string mAsynName;
@@ -26,44 +75,83 @@ private:
     std::string mSubSystem;
     std::string mName;
     bool mRemote;
+    // Prepared requests for mSubSystem + mName, NULL for local parameters
+    const rest_endpoint_t *mEndpoint;
     bool mPushAll;
 
     rest_param_type_t mType;
     rest_access_mode_t mAccessMode;
     rest_min_max_t mMin, mMax;
     std::vector <std::string> mEnumValues, mCriticalValues;
-    double mEpsilon;
+    RestStringIndex mEnumIndex, mCriticalIndex;
+    double mEpsilon, mDeadband;
     int mTimeout;
     bool mCustomEnum;
     size_t mArraySize;
 
     bool mInitialised, mStrictInitialisation;
-    std::vector<bool> mConnected;
+    // Initialised from the metadata cache and not yet checked against the
+    // device; mCachedType if the type came from the cache too
+    bool mRevalidate, mCachedType;
+    std::vector<RestParamValue> mPublished;
+    bool mExclusive;
+    rest_snapshot_value_t *mSnapshot;
+    unsigned long mSuppressed;
+
+    // Write-behind: only the latest value put while a write is queued or in
+    // flight is sent. Guarded by the port driver lock, like the rest; the lock
+    // is released while a write is in flight so that puts keep coalescing.
+    // Flushes that find a write in flight wait for mWriteDone
+    bool mWriteBehind, mWritePending, mWriteInFlight;
+    std::string mPendingValue;
+    int mWriteStatus, mWriteWaiters;
+    epicsEvent mWriteDone;
+    unsigned long mPutsRequested, mPutsSent;
+
+    // Values of array parameters fetched without a destination, reused
+    std::vector<int> mIntValues;
+    std::vector<double> mDoubleValues;
 
     asynStatus bindAsynParam();
 
-    std::vector<std::string> parseArray (struct json_token *tokens,
+    std::vector<std::string> parseArray (JsonTokenArena & json,
             std::string const & name = "");
-    int parseType (struct json_token *tokens, rest_param_type_t & type);
-    int parseAccessMode (struct json_token *tokens,
+    int parseType (JsonTokenArena & json, rest_param_type_t & type);
+    int parseAccessMode (JsonTokenArena & json,
             rest_access_mode_t & accessMode);
-    int parseMinMax (struct json_token *tokens, std::string const & key,
+    int parseMinMax (JsonTokenArena & json, std::string const & key,
             rest_min_max_t & minMax);
-    int initialise(struct json_token * tokens);
+    int initialise(JsonTokenArena & json);
+    int parseMetadata(JsonTokenArena & json);
+    bool sameLimit (rest_min_max_t const & a, rest_min_max_t const & b);
+    void indexEnumValues (void);
+    void publishSnapshot (int address);
 
-    int parseValue (struct json_token *tokens, std::string & rawValue);
+    struct json_token *findValue (JsonTokenArena & json);
     int parseValue (std::string const & rawValue, bool & value);
     int parseValue (std::string const & rawValue, int & value);
     int parseValue (std::string const & rawValue, double & value);
+    int parseValue (struct json_token const *token, int & value);
+    int parseValue (struct json_token const *token, double & value);
 
     std::string toString (bool value);
     std::string toString (int value);
     std::string toString (double value);
     std::string toString (std::string const & value);
+    std::string toString (std::vector<std::string> const & rawValues);
+
+    int clamp (int value);
+    double clamp (double value, int index = -1);
 
     int getEnumIndex (std::string const & value, size_t & index);
     bool isCritical (std::string const & value);
 
+    // From mPublished while it is current and the parameter is exclusive,
+    // otherwise from the asyn parameter
+    bool shadowed (int address);
+    // Published and not written since, so a fetch can be compared against it
+    bool confirmed (int address);
+    void setDirty (int address);
     int getParam(int& value,               int address = 0);
     int getParam(double& value,            int address = 0);
     int getParam(std::string& value,       int address = 0);
@@ -72,15 +160,60 @@ private:
     int setParam(double value,             int address = 0);
     int setParam(const std::string& value, int address = 0);
 
+    // Set the asyn parameter only if the value differs from the one asyn
+    // holds (outside of the deadband for numeric values). That is the last
+    // one published for exclusive parameters, which the driver cannot set
+    int updateParam(int value,                int address = 0);
+    int updateParam(double value,             int address = 0);
+    int updateParam(const std::string& value, int address = 0);
+
+    int setConnectedStatus(int status, int address);
     int setConnectedStatus(int status);
     int setConnectedStatus(std::vector<int> status);
     int setParamStatus(int status, int address = 0);
+    // Connection status and error filter update at the end of a scalar fetch
+    int fetched(int status);
+    // Forget the errors seen, reporting the repeats still suppressed
+    void clearErrors();
 
     int baseFetch (std::string & rawValue);
+    // The value token of the response, valid until the next response is
+    // parsed. NULL for write only parameters
+    int baseFetchToken (struct json_token *& token);
     int baseFetch(std::vector<std::string>& rawValue);
+    // The array (or single string) token of the value, valid until the next
+    // response is parsed. NULL for write only parameters
+    int baseFetch(struct json_token *& array);
     int basePut (std::string const & rawValue, int index = -1);
-
-    void setError(const char* functionName, std::string error, int index = -1);
+    int basePut (std::vector<std::string> const & rawValues);
+    int handlePutReply (std::string const & reply);
+
+    // The steps of a scalar put before its request, shared by RestParam's
+    // puts and TypedRestParam's. The first initialises the parameter if
+    // needed, checks its type is in types (a mask of REST_P_MASK bits) and
+    // flags the address dirty. The numeric ones first skip a double within
+    // epsilon of the asyn value, then clamp the value and queue it if it is
+    // written behind. done is set if nothing is left to do then, otherwise
+    // the caller sends the value (if remote) and publishes it
+    int beginPut (const char *functionName, int index, unsigned types);
+    int beginPut (const char *functionName, int & value, int index, unsigned types,
+                  bool & done);
+    int beginPut (const char *functionName, double & value, int index, unsigned types,
+                  bool & done);
+    bool canWriteBehind (int index);
+    int queueWrite (std::string const & rawValue);
+    int publishWriteStatus ();
+
+    bool matchesDevice (std::string const & rawValue, int address = 0);
+    int pushValue ();
+    int pushArray ();
+    int pushChanged ();
+
+    // Print the error unless the filter suppresses it. ERROR and ERROR_IDX
+    // filter on the line and the formatted message, then printError
+    void setError(const char* functionName, std::string const & error, int index = -1);
+    void printError(const char* functionName, std::string const & error, int index,
+                    unsigned long suppressed);
 
 public:
     // Asyn type constructor
@@ -91,12 +224,20 @@ public:
               const std::string& subSystem = "", const std::string& name = "",
               size_t arraySize = 0, bool strict = false);
 
+private:
+    ~RestParam();
+
+public:
     void setCommand();
     void setEpsilon (double epsilon);
+    void setDeadband (double deadband);
     void setTimeout(int timeout);
+    void setWriteBehind(bool enable);
     int getIndex (void);
+    size_t getArraySize (void);
     std::string getName();
     void setEnumValues (std::vector<std::string> const & values);
+    unsigned long getSuppressedUpdates (void);
 
     // Get the underlying asyn parameter value
     int get(bool& value,                      int address = 0);
@@ -123,8 +264,53 @@ public:
     void disablePushAll();
     bool canPushAll();
 
-    // Re-send the current value to the device
-    int push();
+    // Metadata cache (see RestParamSet::saveMetadata). saveMetadata writes
+    // nothing for local or uninitialised parameters
+    bool isInitialised();
+    void saveMetadata(JsonWriter & writer);
+    int loadMetadata(struct json_token *object);
+
+    // Bulk initialisation (see RestParamSet::initialiseAll): request the
+    // metadata into the caller's buffers without holding the port lock,
+    // then initialise from them with it held
+    bool needsInitialising();
+    int requestMetadata(std::string & response, JsonTokenArena & arena);
+    int applyMetadata(std::string const & response, JsonTokenArena & arena);
+
+    // With write-behind enabled, scalar numeric puts only queue the value and
+    // return EXIT_SUCCESS. The RestParamSet worker sends the latest queued
+    // value once any earlier write has completed, then publishes the value
+    // to asyn along with the outcome of the write as the parameter status:
+    // asynSuccess, or asynError if the device rejected the value or could
+    // not be reached. It calls the parameter callbacks after each write.
+    // flushWrite sends the pending value, if any, waiting for a write in
+    // flight first, publishes the outcome the same way and returns it as a
+    // status. Call it with the port driver lock held; the lock is released
+    // while waiting and while the request is sent, so that other threads
+    // keep putting, and taken again before it returns
+    int flushWrite();
+    unsigned long getPutsRequested();
+    unsigned long getPutsSent();
+
+    // Flag the asyn value as not confirmed by the device, e.g. after the
+    // driver has written the asyn parameter directly. Negative address = all
+    void markDirty(int address = -1);
+    // Declare that the asyn parameter is only ever written through this
+    // RestParam: not by the driver's set*Param calls, nor by asynPortDriver's
+    // default write* handlers. Gets, pushes and device comparisons then read
+    // the value it last published instead of the parameter library. Off by
+    // default, so that values written behind its back are always seen
+    void setExclusive(bool exclusive);
+    bool isDirty();
+
+    // This parameter's slots in the snapshot buffer of its set, one per
+    // address. Only consistent when read through RestParamSet::snapshot
+    const rest_snapshot_value_t *getSnapshot (void);
+
+    // Re-send the current value to the device, either all of it, only the
+    // elements that are dirty or only the elements that differ from what the
+    // device currently reports
+    int push(rest_push_mode_t mode = REST_PUSH_ALL);
 
     // Put the value both to the device (if it is connected to a device
     // parameter) and to the underlying asyn parameter if successful. Update
@@ -134,11 +320,28 @@ public:
     int put (double value,              int index = -1);
     int put (std::string const & value, int index = -1);
     int put (const char *value,         int index = -1);
+
+    // Put a whole array in a single request and update every asyn address.
+    // Returns the status of each element
+    std::vector<int> put (std::vector<bool> const & value);
+    std::vector<int> put (std::vector<int> const & value);
+    std::vector<int> put (std::vector<double> const & value);
+    std::vector<int> put (std::vector<std::string> const & value);
 };
 
 typedef std::map<std::string, RestParam*> rest_param_map_t;
 typedef std::map<int, RestParam*> rest_asyn_map_t;
 
+// The parameters a RestParamSet publishes the request statistics of an
+// endpoint (or of the whole host) to, and the totals at the last update
+typedef struct
+{
+    RestRequestStats *stats;
+    RestParam *p50, *p99, *max, *rate, *requests, *errors, *bytes;
+    RestParam *checkoutP99, *networkP99, *parseP99;
+    epicsUInt64 lastRequests, lastUpdate;
+} rest_stats_params_t;
+
 class RestParamSet
 {
 private:
@@ -146,12 +349,56 @@ private:
     RestAPI *mApi;
     asynUser *mUser;
 
-    rest_param_map_t mConfigMap;
-    rest_asyn_map_t mAsynMap;
+    // Parameters are constructed in blocks of REST_PARAM_BLOCK, in creation
+    // order, and never move. mParams lists them by asyn index, the order
+    // they are iterated in; mByIndex maps an asyn index to its parameter
+    // (or NULL). mNames indexes the names given to addToConfigMap, each at
+    // the position of its parameter in mNamed
+    std::vector<char*> mBlocks;
+    size_t mBlockUsed;
+    std::vector<RestParam*> mParams, mByIndex, mNamed;
+    RestStringIndex mNames;
+
+    void *allocate (void);
+    RestParam *add (RestParam *p);
+
+    // Reused by every parameter to tokenize responses, under the port lock
+    JsonTokenArena mTokenArena;
+    std::string mResponse;
+
+    // Parameters invalidated by PUT replies, waiting to be fetched, and
+    // parameters with a write-behind value waiting to be sent
+    std::deque<RestParam*> mFetchQueue, mWriteQueue;
+    std::set<RestParam*> mFetchQueued;
+    epicsMutex mWorkLock;
+    epicsEvent mWorkEvent, mWorkExited;
+    bool mBackgroundFetch, mWorkExiting, mWorkStarted;
+
+    void startWorker (void);
+
+    std::vector<RestParam*> mCached;
+    bool mMetadataStale;
+
+    // Seqlock over the snapshot slots of every parameter: odd while a value is
+    // being published. Slots are allocated in blocks that never move
+    size_t mSnapshotSequence;
+    std::vector<rest_snapshot_value_t*> mSnapshotBlocks;
+    rest_snapshot_value_t *mSnapshotNext;
+    size_t mSnapshotFree;
+
+    std::vector<rest_stats_params_t> mStats;
+
+    // Shared by every parameter, which tells its own errors apart
+    ErrorFilter mErrorFilter;
+
+    void queueFetch (std::vector<RestParam*> const & params);
 
 public:
     RestParamSet (asynPortDriver *portDriver, RestAPI *api, asynUser *user);
+    ~RestParamSet ();
 
+    // Parameters are owned by the set: they are destroyed with it and must
+    // not be deleted by the driver
     // Asyn type create
     RestParam * create(std::string const & asynName, asynParamType asynType,
                        std::string subSystem = "", std::string const & name = "");
@@ -164,12 +411,91 @@ public:
 
     asynPortDriver *getPortDriver (void);
     RestAPI *getApi (void);
+    JsonTokenArena & getTokenArena (void);
+    std::string & getResponseBuffer (void);
     RestParam *getByName (std::string const & name);
     RestParam *getByIndex (int index);
     asynUser *getUser (void);
     int fetchAll (void);
-    int pushAll (void);
+    // Push every parameter that can be, e.g. to restore a device that was
+    // restarted. REST_PUSH_DIRTY and REST_PUSH_CHANGED only send the values
+    // the device has not confirmed, or that differ from what it reports
+    int pushAll (rest_push_mode_t mode = REST_PUSH_ALL);
+    unsigned long getSuppressedUpdates (void);
 
     int fetchParams (std::vector<std::string> const & params);
+
+    // Queue parameters to be fetched, ignoring any that are already queued.
+    // With background fetching enabled (the default) the queue is drained by
+    // the worker thread, which locks the port driver around each fetch and
+    // calls the parameter callbacks. Otherwise it is drained immediately.
+    void queueFetch (std::vector<std::string> const & params);
+    // Fetch everything queued so far in the calling thread
+    int flushFetchQueue (void);
+    void setBackgroundFetch (bool enable);
+
+    // Initialise every remote parameter that is not yet, requesting up to
+    // parallelism of them at once (bounded by the sockets of the RestAPI,
+    // keeping one free for the driver). Names of the parameters that failed
+    // are appended to failed, if given. Call without the port driver locked;
+    // it is taken to initialise each parameter once its response is in
+    int initialiseAll (int parallelism = DEFAULT_INIT_PARALLELISM,
+                       std::vector<std::string> *failed = NULL);
+
+    // Parameter metadata (type, access mode, enum values, limits and critical
+    // values) can be saved once parameters are initialised, then loaded at
+    // the next startup to initialise them without a request each. A cache
+    // saved for another server version is not loaded. Call with the port
+    // driver locked, like fetches
+    int saveMetadata (std::string const & path, std::string const & version);
+    int loadMetadata (std::string const & path, std::string const & version);
+    // Queue every parameter loaded from the cache to be fetched, which
+    // checks its metadata against the device's. isMetadataStale is true once
+    // any differed, or failed to initialise, and the cache should be saved again
+    void revalidateMetadata (void);
+    bool isMetadataStale (void);
+    void setMetadataStale (void);
+
+    // Copy the value of each parameter (at address 0) from the snapshot
+    // buffer, without taking the port driver lock: as they all were at one
+    // point between two published values. Every value a parameter sets in
+    // the asyn parameter library is published, under the port driver lock,
+    // without waiting for readers; a reader retries if one was published
+    // while it copied. values is resized to match params
+    void snapshot (std::vector<RestParam*> const & params,
+                   std::vector<rest_snapshot_value_t> & values);
+    // Only for RestParam: count slots that stay put, and the write side of
+    // the seqlock around publishing to them
+    rest_snapshot_value_t *allocateSnapshot (size_t count);
+    void beginPublish (void);
+    void endPublish (void);
+
+    // Publish the request statistics of subSystem + name (or of every request
+    // to the host, if name is empty) to local parameters named prefix and
+    // _P50, _P99, _MAX (latencies, s), _RATE (requests/s), _REQUESTS, _ERRORS,
+    // _BYTES (totals, as doubles), _CHECKOUT_P99, _NETWORK_P99 and _PARSE_P99.
+    // Only updateStats writes them
+    int createStats (std::string const & prefix, std::string const & subSystem = "",
+                     std::string const & name = "");
+    // Publish every statistic created, latencies and rate over the requests
+    // since the previous update, then flush errors. Call with the port
+    // driver locked, like fetches
+    int updateStats (void);
+
+    // Only for RestParam: the error filter of every parameter
+    ErrorFilter & getErrorFilter (void);
+    // Report the error repeats suppressed by parameters that would otherwise
+    // go unreported until they fetch successfully (see ErrorFilter::flush).
+    // Called by updateStats; drivers without statistics can call it from
+    // their poll instead
+    void flushErrors (void);
+
+    // Queue a parameter with a pending write-behind value for the worker
+    void queueWrite (RestParam *param);
+    // Send every pending write-behind value in the calling thread
+    int flushWrites (void);
+
+    // Worker thread body, only public to be reachable from the thread entry
+    void workerTask (void);
 };
 #endif
@@ -0,0 +1,1077 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "restParam.h"
+#include "typedRestParam.h"
+#include "errorFilter.h"
+#include "restTrace.h"
+#include "mockRestServer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+
+
+BOOST_AUTO_TEST_SUITE(RestParamUnitTests);
+
+// Mock server with an API, a port driver (named after the test, with
+// Addresses addresses) and a parameter set to run tests against
+template <int Addresses = 1>
+struct MockRestFixture
+{
+  std::string portName;
+  MockRestServer server;
+  MockRestAPI api;
+  MockPortDriver driver;
+  RestParamSet set;
+
+  MockRestFixture ()
+    : portName("TEST_" + std::string(boost::unit_test::framework::current_test_case().p_name)),
+      server(), api(server.getPort()), driver(portName.c_str(), Addresses),
+      set(&driver, &api, driver.pasynUserSelf)
+  {}
+};
+
+// Port driver whose parameter library rejects integers at one address
+class RejectingPortDriver : public MockPortDriver
+{
+public:
+  int rejectedAddress;
+
+  RejectingPortDriver (const char *portName, int maxAddr)
+    : MockPortDriver(portName, maxAddr), rejectedAddress(-1)
+  {}
+
+  using MockPortDriver::setIntegerParam;
+  asynStatus setIntegerParam (int list, int index, int value)
+  {
+    if (list == rejectedAddress) {
+      return asynError;
+    }
+    return MockPortDriver::setIntegerParam(list, index, value);
+  }
+};
+
+typedef struct
+{
+  MockPortDriver *driver;
+  RestParam *first, *second;
+  int count;
+  epicsEvent done;
+} snapshot_writer_t;
+
+static void snapshotWriter (void *arg)
+{
+  snapshot_writer_t *writer = (snapshot_writer_t *) arg;
+  for (int i = 1; i <= writer->count; ++i) {
+    writer->driver->lock();
+    writer->first->put(i);
+    writer->second->put(i);
+    writer->driver->unlock();
+  }
+  writer->done.trigger();
+}
+
+BOOST_FIXTURE_TEST_CASE(DeadbandTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "exposure", "1.5");
+  server.addParam("/api/", "frames", "3");
+  RestParam *exposure = set.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+  RestParam *frames = set.create("FRAMES", REST_P_INT, "/api/", "frames");
+  exposure->setDeadband(0.1);
+
+  // Unchanged values are not published again
+  double value;
+  driver.lock();
+  BOOST_CHECK_EQUAL(set.fetchAll(), 0);
+  unsigned long suppressed = set.getSuppressedUpdates();
+  BOOST_CHECK_EQUAL(set.fetchAll(), 0);
+  BOOST_CHECK_EQUAL(set.getSuppressedUpdates() - suppressed, 2u);
+  BOOST_CHECK_EQUAL(frames->getSuppressedUpdates(), 1u);
+
+  // Nor are changes inside the deadband
+  suppressed = exposure->getSuppressedUpdates();
+  server.setValue("/api/exposure", "1.55");
+  BOOST_CHECK_EQUAL(exposure->fetch(), 0);
+  BOOST_CHECK_EQUAL(exposure->getSuppressedUpdates() - suppressed, 1u);
+  exposure->get(value);
+  BOOST_CHECK_EQUAL(value, 1.5);
+
+  // Changes outside of it are
+  server.setValue("/api/exposure", "1.7");
+  BOOST_CHECK_EQUAL(exposure->fetch(), 0);
+  BOOST_CHECK_EQUAL(exposure->getSuppressedUpdates() - suppressed, 1u);
+  exposure->get(value);
+  BOOST_CHECK_EQUAL(value, 1.7);
+
+  // Values put are always published, then compared against
+  BOOST_CHECK_EQUAL(exposure->put(2.0), 0);
+  exposure->get(value);
+  BOOST_CHECK_EQUAL(value, 2.0);
+  server.setValue("/api/exposure", "1.95");
+  BOOST_CHECK_EQUAL(exposure->fetch(), 0);
+  exposure->get(value);
+  BOOST_CHECK_EQUAL(value, 2.0);
+  BOOST_CHECK_EQUAL(exposure->getSuppressedUpdates() - suppressed, 2u);
+
+  // A value or status the driver set itself is replaced by the next fetch
+  int count;
+  asynStatus state;
+  driver.setIntegerParam(0, frames->getIndex(), 5);
+  driver.setParamStatus(0, frames->getIndex(), asynError);
+  suppressed = frames->getSuppressedUpdates();
+  BOOST_CHECK_EQUAL(frames->fetch(), 0);
+  frames->get(count);
+  BOOST_CHECK_EQUAL(count, 3);
+  driver.getParamStatus(0, frames->getIndex(), &state);
+  BOOST_CHECK_EQUAL(state, asynSuccess);
+  BOOST_CHECK_EQUAL(frames->getSuppressedUpdates(), suppressed);
+  driver.unlock();
+};
+
+BOOST_FIXTURE_TEST_CASE(PushModeTest, MockRestFixture<4>)
+{
+  server.addParam("/api/", "exposure", "1.5");
+  server.addParam("/api/", "gain", "3");
+  server.addArray("/api/", "thresholds", std::vector<std::string>(4, "10"));
+  RestParam *exposure = set.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+  set.create("GAIN", REST_P_INT, "/api/", "gain");
+  RestParam *thresholds = set.create("THRESHOLDS", REST_P_INT, "/api/", "thresholds", 4);
+
+  driver.lock();
+  BOOST_CHECK_EQUAL(set.fetchAll(), 0);
+  BOOST_CHECK(!thresholds->isDirty());
+
+  // Nothing to send once the device confirmed every value
+  unsigned long puts = server.getPuts();
+  BOOST_CHECK_EQUAL(set.pushAll(REST_PUSH_DIRTY), 0);
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 0u);
+
+  // Only the parameter the driver wrote behind the set's back
+  driver.setIntegerParam(2, thresholds->getIndex(), 42);
+  thresholds->markDirty(2);
+  BOOST_CHECK(thresholds->isDirty());
+  puts = server.getPuts();
+  BOOST_CHECK_EQUAL(set.pushAll(REST_PUSH_DIRTY), 0);
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 1u);
+  BOOST_CHECK_EQUAL(server.getValue("/api/thresholds", 2), "42");
+  BOOST_CHECK(!thresholds->isDirty());
+
+  // Only the parameters that differ from the device, as after a restart
+  server.setValue("/api/gain", "0");
+  server.setValue("/api/thresholds", "0", 1);
+  puts = server.getPuts();
+  BOOST_CHECK_EQUAL(set.pushAll(REST_PUSH_CHANGED), 0);
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 2u);
+  BOOST_CHECK_EQUAL(server.getValue("/api/gain"), "3");
+  BOOST_CHECK_EQUAL(server.getValue("/api/thresholds", 1), "10");
+  BOOST_CHECK_EQUAL(server.getValue("/api/exposure"), "1.5");
+
+  // Every parameter, by default
+  puts = server.getPuts();
+  BOOST_CHECK_EQUAL(set.pushAll(), 0);
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 3u);
+
+  // Puts are clean once the device confirms them
+  BOOST_CHECK_EQUAL(exposure->put(2.0), 0);
+  BOOST_CHECK(!exposure->isDirty());
+  puts = server.getPuts();
+  BOOST_CHECK_EQUAL(set.pushAll(REST_PUSH_DIRTY), 0);
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 0u);
+  driver.unlock();
+};
+
+BOOST_FIXTURE_TEST_CASE(VectorPutTest, MockRestFixture<64>)
+{
+  server.addArray("/api/", "thresholds", std::vector<std::string>(64, "10"));
+  server.addArray("/api/", "gains", std::vector<std::string>(3, "0.5"));
+  RestParam *thresholds = set.create("THRESHOLDS", REST_P_INT, "/api/", "thresholds", 64);
+  RestParam *gains = set.create("GAINS", REST_P_DOUBLE, "/api/", "gains", 3);
+
+  driver.lock();
+  BOOST_CHECK_EQUAL(set.fetchAll(), 0);
+
+  // The whole array in one request
+  std::vector<int> values(64);
+  for (int i = 0; i < 64; ++i) {
+    values[i] = i;
+  }
+  unsigned long puts = server.getPuts();
+  std::vector<int> status = thresholds->put(values);
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 1u);
+  BOOST_REQUIRE_EQUAL(status.size(), 64u);
+  char expected[16];
+  for (int i = 0; i < 64; ++i) {
+    epicsSnprintf(expected, sizeof(expected), "%d", i);
+    BOOST_CHECK_EQUAL(status[i], 0);
+    BOOST_CHECK_EQUAL(server.getValue("/api/thresholds", i), expected);
+  }
+  std::vector<int> published;
+  thresholds->get(published);
+  BOOST_CHECK_EQUAL(published[63], 63);
+
+  std::vector<double> gainValues(3, 0.25);
+  gainValues[2] = 0.125;
+  status = gains->put(gainValues);
+  BOOST_CHECK_EQUAL(status[0] + status[1] + status[2], 0);
+  BOOST_CHECK_EQUAL(server.getValue("/api/gains", 1), "0.25");
+  BOOST_CHECK_EQUAL(server.getValue("/api/gains", 2), "0.125");
+  driver.unlock();
+
+  // An element the parameter library rejects fails on its own, once the
+  // device has taken every element
+  RejectingPortDriver rejecting("TEST_VECTOR_PUT_REJECT", 64);
+  RestParamSet rejectingSet(&rejecting, &api, rejecting.pasynUserSelf);
+  RestParam *rejected = rejectingSet.create("THRESHOLDS", REST_P_INT, "/api/", "thresholds", 64);
+  rejecting.lock();
+  BOOST_CHECK_EQUAL(rejected->fetch(), 0);
+  rejecting.rejectedAddress = 5;
+  values[5] = 105;
+  puts = server.getPuts();
+  status = rejected->put(values);
+  rejecting.unlock();
+  BOOST_CHECK_EQUAL(server.getPuts() - puts, 1u);
+  BOOST_CHECK_EQUAL(server.getValue("/api/thresholds", 5), "105");
+  BOOST_REQUIRE_EQUAL(status.size(), 64u);
+  BOOST_CHECK_NE(status[5], 0);
+  BOOST_CHECK_EQUAL(status[4] + status[6], 0);
+};
+
+BOOST_FIXTURE_TEST_CASE(FetchQueueTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "exposure", "1.5", "[\"frames\"]");
+  server.addParam("/api/", "frames", "3");
+  RestParam *exposure = set.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+  RestParam *frames = set.create("FRAMES", REST_P_INT, "/api/", "frames");
+  set.addToConfigMap("frames", frames);
+
+  driver.lock();
+  BOOST_CHECK_EQUAL(set.fetchAll(), 0);
+  driver.unlock();
+
+  // A parameter queued twice is fetched once
+  std::vector<std::string> names(2, "frames");
+  set.setBackgroundFetch(false);
+  unsigned long gets = server.getGets();
+  set.queueFetch(names);
+  BOOST_CHECK_EQUAL(server.getGets() - gets, 1u);
+
+  // Parameters listed in a PUT reply are fetched by the worker
+  int value = 0;
+  set.setBackgroundFetch(true);
+  server.setValue("/api/frames", "9");
+  driver.lock();
+  BOOST_CHECK_EQUAL(exposure->put(2.0), 0);
+  driver.unlock();
+  for (int i = 0; i < 100 && value != 9; ++i) {
+    epicsThreadSleep(0.01);
+    driver.lock();
+    frames->get(value);
+    driver.unlock();
+  }
+  BOOST_CHECK_EQUAL(value, 9);
+};
+
+BOOST_FIXTURE_TEST_CASE(WriteBehindTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "exposure", "1.5");
+  RestParam *exposure = set.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+  exposure->setWriteBehind(true);
+
+  driver.lock();
+  BOOST_CHECK_EQUAL(exposure->fetch(), 0);
+  driver.unlock();
+
+  // Puts made while a write is in flight are coalesced into the latest
+  server.setLatency(0.02);
+  driver.lock();
+  for (int i = 1; i <= 10; ++i) {
+    BOOST_CHECK_EQUAL(exposure->put(1.5 + i), 0);
+  }
+  BOOST_CHECK_EQUAL(exposure->flushWrite(), 0);
+  double value;
+  exposure->get(value);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(value, 11.5);
+  BOOST_CHECK_EQUAL(server.getValue("/api/exposure"), "11.5");
+  BOOST_CHECK_EQUAL(exposure->getPutsRequested(), 10u);
+  BOOST_CHECK(exposure->getPutsSent() < 10u);
+  BOOST_CHECK(!exposure->isDirty());
+
+  // Puts return once queued; how the write went is the parameter status
+  asynStatus state;
+  server.setRawResponse("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+  driver.lock();
+  BOOST_CHECK_EQUAL(exposure->put(30.0), 0);
+  BOOST_CHECK_NE(exposure->flushWrite(), 0);
+  driver.getParamStatus(0, exposure->getIndex(), &state);
+  BOOST_CHECK_EQUAL(state, asynError);
+  BOOST_CHECK(exposure->isDirty());
+  server.setRawResponse("");
+  BOOST_CHECK_EQUAL(exposure->put(31.0), 0);
+  BOOST_CHECK_EQUAL(exposure->flushWrite(), 0);
+  driver.getParamStatus(0, exposure->getIndex(), &state);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(state, asynSuccess);
+  BOOST_CHECK_EQUAL(server.getValue("/api/exposure"), "31");
+
+  // A value still pending is sent when the set goes
+  {
+    MockPortDriver pendingDriver("TEST_WRITE_BEHIND_PENDING");
+    RestParamSet pendingSet(&pendingDriver, &api, pendingDriver.pasynUserSelf);
+    RestParam *pending = pendingSet.create("EXPOSURE", REST_P_DOUBLE, "/api/", "exposure");
+    pending->setWriteBehind(true);
+    pendingDriver.lock();
+    BOOST_CHECK_EQUAL(pending->fetch(), 0);
+    BOOST_CHECK_EQUAL(pending->put(20.0), 0);
+    pendingDriver.unlock();
+  }
+  BOOST_CHECK_EQUAL(server.getValue("/api/exposure"), "20");
+};
+
+BOOST_FIXTURE_TEST_CASE(TokenArenaReuseTest, MockRestFixture<16>)
+{
+  server.addParam("/api/", "temperature", "21.5");
+  server.addArray("/api/", "thresholds", std::vector<std::string>(16, "3"));
+
+  RestParam *temperature = set.create("TEMPERATURE", REST_P_DOUBLE, "/api/", "temperature");
+  RestParam *thresholds = set.create("THRESHOLDS", REST_P_INT, "/api/", "thresholds", 16);
+
+  driver.lock();
+  BOOST_CHECK_EQUAL(temperature->fetch(), 0);
+  BOOST_CHECK_EQUAL(thresholds->fetch(), 0);
+
+  // Steady state fetches reuse the same tokens
+  unsigned long allocations = set.getTokenArena().getAllocations();
+  for (int i = 0; i < 100; ++i) {
+    BOOST_CHECK_EQUAL(temperature->fetch(), 0);
+    BOOST_CHECK_EQUAL(thresholds->fetch(), 0);
+  }
+  driver.unlock();
+
+  BOOST_CHECK_EQUAL(set.getTokenArena().getAllocations(), allocations);
+};
+
+BOOST_FIXTURE_TEST_CASE(LargeArrayFetchTest, MockRestFixture<1000>)
+{
+  // More elements than the arena starts with tokens for
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(i % 2 ? "1" : "0");
+  }
+  server.addArray("/api/", "mask", values);
+
+  RestParam *mask = set.create("MASK", REST_P_INT, "/api/", "mask", 1000);
+
+  std::vector<int> value;
+  driver.lock();
+  std::vector<int> status = mask->fetch(value);
+  driver.unlock();
+
+  BOOST_REQUIRE_EQUAL(status.size(), 1000u);
+  BOOST_REQUIRE_EQUAL(value.size(), 1000u);
+  BOOST_CHECK_EQUAL(status[999], 0);
+  BOOST_CHECK_EQUAL(value[999], 1);
+  BOOST_CHECK(set.getTokenArena().getCapacity() > 1000);
+};
+
+BOOST_FIXTURE_TEST_CASE(DoubleArrayFetchTest, MockRestFixture<3>)
+{
+  std::vector<std::string> values;
+  values.push_back("1.5");
+  values.push_back("-2e3");
+  values.push_back("7");
+  server.addArray("/api/", "gains", values);
+
+  RestParam *gains = set.create("GAINS", REST_P_DOUBLE, "/api/", "gains", 3);
+
+  std::vector<double> value;
+  driver.lock();
+  std::vector<int> status = gains->fetch(value);
+  driver.unlock();
+
+  BOOST_REQUIRE_EQUAL(value.size(), 3u);
+  BOOST_CHECK_EQUAL(status[0] + status[1] + status[2], 0);
+  BOOST_CHECK_EQUAL(value[0], 1.5);
+  BOOST_CHECK_EQUAL(value[1], -2000.0);
+  BOOST_CHECK_EQUAL(value[2], 7.0);
+
+  double published;
+  driver.lock();
+  gains->get(published, 1);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(published, -2000.0);
+};
+
+BOOST_FIXTURE_TEST_CASE(LargeResponseTest, MockRestFixture<50000>)
+{
+  // Far more than fits in one read
+  const int size = 50000;
+  std::vector<std::string> values;
+  for (int i = 0; i < size; ++i) {
+    values.push_back(i % 3 ? "0.25" : "-1e-3");
+  }
+  server.addArray("/api/", "waveform", values);
+
+  RestParam *waveform = set.create("WAVEFORM", REST_P_DOUBLE, "/api/", "waveform", size);
+
+  std::vector<double> value;
+  driver.lock();
+  std::vector<int> status = waveform->fetch(value);
+  driver.unlock();
+
+  BOOST_REQUIRE_EQUAL(value.size(), (size_t) size);
+  BOOST_CHECK_EQUAL(status[size - 1], 0);
+  BOOST_CHECK_EQUAL(value[size - 1], 0.25);
+  BOOST_CHECK_EQUAL(value[size - 2], -1e-3);
+};
+
+BOOST_FIXTURE_TEST_CASE(MetadataCacheTest, MockRestFixture<>)
+{
+  const char *path = "restParamTest.metadata";
+  server.addParam("/api/", "temperature", "21.5");
+  server.addParam("/api/", "count", "3");
+
+  // Saved by another driver, loaded by the fixture's
+  {
+    MockPortDriver saveDriver("TEST_METADATA_SAVE");
+    RestParamSet saveSet(&saveDriver, &api, saveDriver.pasynUserSelf);
+    saveSet.create("TEMPERATURE", REST_P_DOUBLE, "/api/", "temperature");
+    saveSet.create("COUNT", REST_P_INT, "/api/", "count");
+    saveDriver.lock();
+    BOOST_CHECK_EQUAL(saveSet.fetchAll(), 0);
+    BOOST_CHECK_EQUAL(saveSet.saveMetadata(path, "1.0"), 0);
+    saveDriver.unlock();
+  }
+
+  set.setBackgroundFetch(false);
+  RestParam *temperature = set.create("TEMPERATURE", REST_P_DOUBLE, "/api/", "temperature");
+  RestParam *count = set.create("COUNT", REST_P_INT, "/api/", "count");
+
+  // Another server version's metadata is not used
+  driver.lock();
+  BOOST_CHECK_NE(set.loadMetadata(path, "1.1"), 0);
+  BOOST_CHECK(!temperature->isInitialised());
+
+  // Initialised without a request
+  unsigned long gets = server.getGets();
+  BOOST_CHECK_EQUAL(set.loadMetadata(path, "1.0"), 0);
+  BOOST_CHECK(temperature->isInitialised());
+  BOOST_CHECK(count->isInitialised());
+  BOOST_CHECK_EQUAL(temperature->put(22.5), 0);
+  BOOST_CHECK_EQUAL(server.getGets(), gets);
+  driver.unlock();
+
+  // Then checked against the device
+  set.revalidateMetadata();
+  BOOST_CHECK_EQUAL(server.getGets(), gets + 2);
+  BOOST_CHECK(!set.isMetadataStale());
+
+  remove(path);
+};
+
+BOOST_FIXTURE_TEST_CASE(InitialiseAllTest, MockRestFixture<>)
+{
+  const int count = 12;
+  char name[32];
+  for (int i = 0; i < count; ++i) {
+    epicsSnprintf(name, sizeof(name), "param%d", i);
+    server.addParam("/api/", name, "1");
+  }
+  server.setLatency(0.01);
+
+  std::vector<RestParam*> params;
+  for (int i = 0; i < count; ++i) {
+    epicsSnprintf(name, sizeof(name), "param%d", i);
+    params.push_back(set.create(name, REST_P_INT, "/api/", name));
+  }
+  set.create("MISSING", REST_P_INT, "/api/", "missing");
+  RestParam *command = set.create("COMMAND", REST_P_COMMAND, "/api/", "command");
+  command->setCommand();
+
+  std::vector<std::string> failed;
+  BOOST_CHECK_NE(set.initialiseAll(4, &failed), 0);
+  BOOST_REQUIRE_EQUAL(failed.size(), 1u);
+  BOOST_CHECK_EQUAL(failed[0], "missing");
+  for (int i = 0; i < count; ++i) {
+    BOOST_CHECK(params[i]->isInitialised());
+  }
+  // One request each, none for the write only parameter
+  BOOST_CHECK_EQUAL(server.getGets(), (unsigned long) count + 1);
+
+  // Writes no longer fetch first
+  driver.lock();
+  BOOST_CHECK_EQUAL(params[0]->put(5), 0);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(server.getGets(), (unsigned long) count + 1);
+};
+
+BOOST_AUTO_TEST_CASE(StringIndexTest)
+{
+  std::vector<std::string> values;
+  char value[32];
+  for (int i = 0; i < 100; ++i) {
+    epicsSnprintf(value, sizeof(value), "mode %d", i);
+    values.push_back(value);
+  }
+  values.push_back("mode 7");
+  values.push_back("");
+
+  RestStringIndex index;
+  BOOST_CHECK_EQUAL(index.find("mode 1"), -1);
+  index.build(values);
+  for (int i = 0; i < 100; ++i) {
+    BOOST_CHECK_EQUAL(index.find(values[i]), i);
+  }
+  // The first of duplicates, as a linear search
+  BOOST_CHECK_EQUAL(index.find("mode 7"), 7);
+  BOOST_CHECK_EQUAL(index.find(""), 101);
+  BOOST_CHECK_EQUAL(index.find("mode 100"), -1);
+  BOOST_CHECK_EQUAL(index.find("mode", 4), -1);
+
+  index.build(std::vector<std::string>());
+  BOOST_CHECK_EQUAL(index.find("mode 1"), -1);
+
+  // Growing one value at a time, through the switch to hashing
+  for (int i = 0; i < 100; ++i) {
+    BOOST_CHECK_EQUAL(index.add(values[i]), i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    BOOST_REQUIRE_EQUAL(index.find(values[i]), i);
+  }
+  BOOST_CHECK_EQUAL(index.add("mode 7"), 100);
+  BOOST_CHECK_EQUAL(index.find("mode 7"), 7);
+};
+
+BOOST_FIXTURE_TEST_CASE(EnumFetchTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "trigger", "\"source 20\"");
+
+  RestParam *trigger = set.create("TRIGGER", REST_P_ENUM, "/api/", "trigger");
+  std::vector<std::string> values;
+  char value[32];
+  for (int i = 0; i < 32; ++i) {
+    epicsSnprintf(value, sizeof(value), "source %d", i);
+    values.push_back(value);
+  }
+  trigger->setEnumValues(values);
+
+  int index;
+  driver.lock();
+  BOOST_CHECK_EQUAL(trigger->fetch(index), 0);
+  BOOST_CHECK_EQUAL(index, 20);
+  BOOST_CHECK_EQUAL(trigger->put(3), 0);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(server.getValue("/api/trigger"), "\"source 3\"");
+};
+
+BOOST_FIXTURE_TEST_CASE(EndpointTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "temperature", "21.5");
+
+  const rest_endpoint_t *endpoint = api.getEndpoint("/api/", "temperature");
+  BOOST_CHECK(api.getEndpoint("/api/", "temperature") == endpoint);
+  BOOST_CHECK(api.getEndpoint("/api/", "humidity") != endpoint);
+
+  std::string value;
+  BOOST_CHECK_EQUAL(api.get(endpoint, value), 0);
+  std::string expected;
+  BOOST_CHECK_EQUAL(api.get("/api/", "temperature", expected), 0);
+  BOOST_CHECK_EQUAL(value, expected);
+
+  BOOST_CHECK_EQUAL(api.put(endpoint, "22.5"), 0);
+  BOOST_CHECK_EQUAL(server.getValue("/api/temperature"), "22.5");
+};
+
+BOOST_FIXTURE_TEST_CASE(RegistryTest, MockRestFixture<>)
+{
+  // Bound to an asyn parameter created before the ones after it
+  int early;
+  driver.createParam("EARLY", asynParamInt32, &early);
+
+  std::vector<RestParam*> params;
+  char name[32];
+  for (int i = 0; i < 200; ++i) {
+    epicsSnprintf(name, sizeof(name), "PARAM_%d", i);
+    params.push_back(set.create(name, REST_P_INT));
+    set.addToConfigMap(std::string(name) + "_config", params.back());
+  }
+  RestParam *late = set.create("EARLY", REST_P_INT);
+  set.addToConfigMap("PARAM_0_config", late);
+
+  BOOST_CHECK(set.getByIndex(early) == late);
+  for (int i = 0; i < 200; ++i) {
+    epicsSnprintf(name, sizeof(name), "PARAM_%d_config", i);
+    BOOST_REQUIRE(set.getByName(name) == params[i]);
+    BOOST_REQUIRE(set.getByIndex(params[i]->getIndex()) == params[i]);
+  }
+  BOOST_CHECK(set.getByName("PARAM_200_config") == NULL);
+  BOOST_CHECK(set.getByIndex(-1) == NULL);
+  BOOST_CHECK(set.getByIndex(100000) == NULL);
+
+  // Asyn parameters can't be bound twice, and the failure leaves the set as it was
+  BOOST_CHECK_THROW(set.create("PARAM_3", REST_P_INT), std::runtime_error);
+  RestParam *next = set.create("NEXT", REST_P_INT);
+  BOOST_CHECK(set.getByIndex(next->getIndex()) == next);
+  BOOST_CHECK_EQUAL(set.getSuppressedUpdates(), 0u);
+};
+
+BOOST_FIXTURE_TEST_CASE(ShadowValueTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "gain", "4");
+  server.addParam("/api/", "label", "\"north\"");
+
+  RestParam *gain = set.create("GAIN", REST_P_INT, "/api/", "gain");
+  RestParam *label = set.create("LABEL", REST_P_STRING, "/api/", "label");
+
+  int intValue = 0, asynInt = 0;
+  std::string stringValue, asynString;
+  driver.lock();
+  BOOST_CHECK_EQUAL(gain->fetch(), 0);
+  BOOST_CHECK_EQUAL(label->fetch(), 0);
+  BOOST_CHECK_EQUAL(gain->get(intValue), 0);
+  BOOST_CHECK_EQUAL(label->get(stringValue), 0);
+  driver.getIntegerParam(0, gain->getIndex(), &asynInt);
+  driver.getStringParam(0, label->getIndex(), asynString);
+  BOOST_CHECK_EQUAL(intValue, 4);
+  BOOST_CHECK_EQUAL(intValue, asynInt);
+  BOOST_CHECK_EQUAL(stringValue, "north");
+  BOOST_CHECK_EQUAL(stringValue, asynString);
+
+  // Puts update the shadow copy along with the asyn parameter
+  BOOST_CHECK_EQUAL(gain->put(7), 0);
+  BOOST_CHECK_EQUAL(gain->get(intValue), 0);
+  driver.getIntegerParam(0, gain->getIndex(), &asynInt);
+  BOOST_CHECK_EQUAL(intValue, 7);
+  BOOST_CHECK_EQUAL(asynInt, 7);
+
+  // Written behind the parameter's back and marked dirty
+  driver.setIntegerParam(0, gain->getIndex(), 9);
+  gain->markDirty();
+  BOOST_CHECK_EQUAL(gain->get(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 9);
+  driver.setStringParam(0, label->getIndex(), "south");
+  label->markDirty(0);
+  BOOST_CHECK_EQUAL(label->get(stringValue), 0);
+  BOOST_CHECK_EQUAL(stringValue, "south");
+
+  // Written behind its back without markDirty: still seen
+  BOOST_CHECK_EQUAL(gain->fetch(), 0);
+  driver.setIntegerParam(0, gain->getIndex(), 11);
+  BOOST_CHECK_EQUAL(gain->get(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 11);
+
+  // Exclusive parameters read the shadow copy, the driver having promised
+  // not to write them directly
+  gain->setExclusive(true);
+  BOOST_CHECK_EQUAL(gain->put(12), 0);
+  BOOST_CHECK_EQUAL(gain->get(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 12);
+  driver.unlock();
+};
+
+BOOST_FIXTURE_TEST_CASE(SnapshotTest, MockRestFixture<>)
+{
+  std::vector<RestParam*> params;
+  params.push_back(set.create("COUNT", REST_P_INT));
+  params.push_back(set.create("RATE", REST_P_DOUBLE));
+  params.push_back(set.create("STATE", REST_P_STRING));
+  params.push_back(set.create("UNSET", REST_P_INT));
+
+  driver.lock();
+  BOOST_CHECK_EQUAL(params[0]->put(3), 0);
+  BOOST_CHECK_EQUAL(params[1]->put(2.5), 0);
+  BOOST_CHECK_EQUAL(params[2]->put(std::string(60, 'x')), 0);
+  driver.unlock();
+
+  std::vector<rest_snapshot_value_t> values;
+  set.snapshot(params, values);
+  BOOST_REQUIRE_EQUAL(values.size(), 4u);
+  BOOST_CHECK(values[0].valid);
+  BOOST_CHECK_EQUAL(values[0].intValue, 3);
+  BOOST_CHECK_EQUAL(values[1].doubleValue, 2.5);
+  BOOST_CHECK_EQUAL(std::string(values[2].stringValue),
+                    std::string(REST_SNAPSHOT_STRING_SIZE - 1, 'x'));
+  BOOST_CHECK(!values[3].valid);
+
+  // COUNT is published just before SECOND each time, so every snapshot
+  // finds them equal or COUNT one ahead
+  snapshot_writer_t writer;
+  writer.driver = &driver;
+  writer.first = params[0];
+  writer.second = set.create("SECOND", REST_P_INT);
+  writer.count = 20000;
+  std::vector<RestParam*> pair;
+  pair.push_back(writer.first);
+  pair.push_back(writer.second);
+  epicsThreadMustCreate("snapshotWriter", epicsThreadPriorityMedium,
+                        epicsThreadGetStackSize(epicsThreadStackSmall),
+                        snapshotWriter, &writer);
+  bool consistent = true;
+  do {
+    set.snapshot(pair, values);
+    int ahead = values[0].intValue - values[1].intValue;
+    consistent = consistent && (!values[1].valid || ahead == 0 || ahead == 1);
+  } while (!writer.done.tryWait());
+  BOOST_CHECK(consistent);
+  set.snapshot(pair, values);
+  BOOST_CHECK_EQUAL(values[0].intValue, writer.count);
+  BOOST_CHECK_EQUAL(values[1].intValue, writer.count);
+};
+
+BOOST_FIXTURE_TEST_CASE(TypedParamTest, MockRestFixture<>)
+{
+  server.addParam("/api/", "frames", "5");
+  server.addParam("/api/", "exposure", "2.5");
+  server.addParam("/api/", "armed", "true");
+  server.addParam("/api/", "label", "\"abc\"");
+
+  TypedRestParam<int> frames(&set, "FRAMES", "/api/", "frames");
+  TypedRestParam<double> exposure(&set, "EXPOSURE", "/api/", "exposure");
+  TypedRestParam<bool> armed(&set, "ARMED", "/api/", "armed");
+  TypedRestParam<std::string> label(&set, "LABEL", "/api/", "label");
+  TypedRestParam<int> local(&set, "LOCAL");
+
+  int intValue = 0;
+  double doubleValue = 0.0;
+  bool boolValue = false;
+  std::string stringValue;
+  driver.lock();
+  BOOST_CHECK_EQUAL(frames.fetch(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 5);
+  BOOST_CHECK_EQUAL(exposure.fetch(doubleValue), 0);
+  BOOST_CHECK_EQUAL(doubleValue, 2.5);
+  BOOST_CHECK_EQUAL(armed.fetch(boolValue), 0);
+  BOOST_CHECK(boolValue);
+  BOOST_CHECK_EQUAL(label.fetch(stringValue), 0);
+  BOOST_CHECK_EQUAL(stringValue, "abc");
+
+  // Formatted as RestParam formats them
+  BOOST_CHECK_EQUAL(frames.put(8), 0);
+  BOOST_CHECK_EQUAL(exposure.put(0.1), 0);
+  BOOST_CHECK_EQUAL(armed.put(false), 0);
+  BOOST_CHECK_EQUAL(label.put("a\"b"), 0);
+  BOOST_CHECK_EQUAL(local.put(3), 0);
+
+  BOOST_CHECK_EQUAL(frames.get(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 8);
+  BOOST_CHECK_EQUAL(armed.get(boolValue), 0);
+  BOOST_CHECK(!boolValue);
+  BOOST_CHECK_EQUAL(armed.getParam()->get(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 0);
+  BOOST_CHECK_EQUAL(label.getParam()->get(stringValue), 0);
+  BOOST_CHECK_EQUAL(stringValue, "a\"b");
+  BOOST_CHECK_EQUAL(local.get(intValue), 0);
+  BOOST_CHECK_EQUAL(intValue, 3);
+  BOOST_CHECK(set.getByIndex(frames.getIndex()) == frames.getParam());
+  driver.unlock();
+
+  BOOST_CHECK_EQUAL(server.getValue("/api/frames"), "8");
+  BOOST_CHECK_EQUAL(server.getValue("/api/exposure"), "0.1");
+  BOOST_CHECK_EQUAL(server.getValue("/api/armed"), "false");
+  BOOST_CHECK_EQUAL(server.getValue("/api/label"), "\"a\\\"b\"");
+
+  // Like RestParam::put, a double within epsilon of the asyn value is skipped
+  exposure.getParam()->setEpsilon(0.01);
+  server.setValue("/api/exposure", "0.5");
+  driver.lock();
+  BOOST_CHECK_EQUAL(exposure.put(0.105), 0);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(server.getValue("/api/exposure"), "0.5");
+
+  // Fetch failures disconnect the parameter, like RestParam::fetch()
+  asynStatus paramStatus;
+  server.setValue("/api/frames", "\"many\"");
+  driver.lock();
+  BOOST_CHECK_NE(frames.fetch(), 0);
+  driver.getParamStatus(0, frames.getIndex(), &paramStatus);
+  BOOST_CHECK_EQUAL(paramStatus, asynDisconnected);
+  server.setValue("/api/frames", "9");
+  BOOST_CHECK_EQUAL(frames.fetch(intValue), 0);
+  driver.getParamStatus(0, frames.getIndex(), &paramStatus);
+  BOOST_CHECK_EQUAL(paramStatus, asynSuccess);
+  driver.unlock();
+  BOOST_CHECK_EQUAL(intValue, 9);
+};
+
+BOOST_AUTO_TEST_CASE(ErrorFilterTest)
+{
+  ErrorFilter filter(0.05);
+  unsigned long suppressed = 1;
+  epicsUInt32 key = ErrorFilter::key("fetch", 100);
+  BOOST_CHECK(filter.newError(key, suppressed));
+  BOOST_CHECK_EQUAL(suppressed, 0u);
+  for (int i = 0; i < 10; ++i) {
+    BOOST_CHECK(!filter.newError(key, suppressed));
+  }
+  BOOST_CHECK_EQUAL(filter.getSuppressed(), 10u);
+  BOOST_CHECK(filter.newError(ErrorFilter::key("fetch", 100, 3), suppressed));
+  BOOST_CHECK(filter.newError(ErrorFilter::key("fetch", 101), suppressed));
+
+  // Reported again with the count once the interval has passed
+  epicsThreadSleep(0.06);
+  BOOST_CHECK(filter.newError(key, suppressed));
+  BOOST_CHECK_EQUAL(suppressed, 10u);
+  BOOST_CHECK(!filter.newError(key, suppressed));
+
+  // More keys than slots: every new one is printed
+  for (int line = 0; line < 4 * ERROR_FILTER_SLOTS; ++line) {
+    BOOST_REQUIRE(filter.newError(ErrorFilter::key("put", line), suppressed));
+  }
+
+  filter.clearErrors();
+  BOOST_CHECK(filter.newError(key, suppressed));
+  BOOST_CHECK_EQUAL(suppressed, 0u);
+  BOOST_CHECK(filter.newError("RestAPI::connect: failed"));
+  BOOST_CHECK(!filter.newError("RestAPI::connect: failed"));
+
+  // Different messages from one line are filtered apart
+  BOOST_CHECK(filter.newError(ErrorFilter::key("fetch", 100, -1, 1), suppressed));
+  BOOST_CHECK(filter.newError(ErrorFilter::key("fetch", 100, -1, 2), suppressed));
+  BOOST_CHECK(!filter.newError(ErrorFilter::key("fetch", 100, -1, 1), suppressed));
+
+  // Clearing hands back the repeats not yet reported
+  BOOST_CHECK(!filter.newError(key, suppressed));
+  BOOST_CHECK_EQUAL(filter.clearErrors(), 3u);
+  BOOST_CHECK_EQUAL(filter.clearErrors(), 0u);
+
+  // Owners sharing a filter raise the same error apart, and clearing one
+  // keeps the errors of the others wherever they probed to
+  int owners[100];
+  ErrorFilter shared(0.05, 100);
+  for (int i = 0; i < 100; ++i) {
+    BOOST_REQUIRE(shared.newError(key, suppressed, &owners[i]));
+  }
+  BOOST_CHECK(!shared.newError(key, suppressed, &owners[0]));
+  BOOST_CHECK_EQUAL(shared.clearErrors(&owners[0]), 1u);
+  BOOST_CHECK(shared.newError(key, suppressed, &owners[0]));
+  for (int i = 1; i < 100; ++i) {
+    BOOST_CHECK(!shared.newError(key, suppressed, &owners[i]));
+  }
+
+  // Repeats of errors that stopped are flushed once the interval has passed
+  BOOST_CHECK_EQUAL(shared.flush(), 0u);
+  epicsThreadSleep(0.06);
+  BOOST_CHECK_EQUAL(shared.flush(), 99u);
+  BOOST_CHECK_EQUAL(shared.flush(), 0u);
+  BOOST_CHECK_EQUAL(shared.clearErrors(&owners[1]), 0u);
+};
+
+typedef struct
+{
+  epicsUInt32 endpoint;
+  epicsEvent done;
+} trace_thread_t;
+
+static void traceThread (void *arg)
+{
+  trace_thread_t *thread = (trace_thread_t *) arg;
+  restTraceRecord(REST_TRACE_REQUEST_START, thread->endpoint);
+  thread->done.trigger();
+}
+
+BOOST_FIXTURE_TEST_CASE(TraceTest, MockRestFixture<>)
+{
+  const char *path = "restParamTest.trace";
+  const char *events[] = {"requestStart", "socketCheckout", "send", "firstByte",
+                          "parseEnd", "setParamEnd"};
+  server.addParam("/api/", "pressure", "1.25");
+
+  RestParam *pressure = set.create("PRESSURE", REST_P_DOUBLE, "/api/", "pressure");
+
+  restTraceEnable(1);
+  driver.lock();
+  BOOST_CHECK_EQUAL(pressure->fetch(), 0);
+  driver.unlock();
+  restTraceEnable(0);
+  BOOST_REQUIRE_EQUAL(restTraceDump(path), 0);
+
+  // Every event of the fetch, in order, tagged with its endpoint
+  std::ifstream dump(path);
+  std::string line;
+  size_t next = 0;
+  while (std::getline(dump, line)) {
+    if (next < 6 && line.find(std::string(" ") + events[next] + " ") != std::string::npos &&
+        line.find("/api/pressure") != std::string::npos) {
+      ++next;
+    }
+  }
+  BOOST_CHECK_EQUAL(next, 6u);
+  remove(path);
+};
+
+BOOST_AUTO_TEST_CASE(TraceRingReuseTest)
+{
+  // A thread that exits hands its ring on, so threads started one after
+  // another are all traced however many there are
+  const char *path = "restParamTestReuse.trace";
+  static trace_thread_t thread;
+  restTraceEnable(1);
+  for (int i = 0; i < 2 * REST_TRACE_MAX_RINGS; ++i) {
+    thread.endpoint = restTraceEndpoint(i + 1 < 2 * REST_TRACE_MAX_RINGS ? "/reuse/each" :
+                                                                           "/reuse/last");
+    epicsThreadCreate("traceThread", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackSmall), traceThread, &thread);
+    thread.done.wait();
+  }
+  restTraceEnable(0);
+  BOOST_REQUIRE_EQUAL(restTraceDump(path), 0);
+
+  std::ifstream dump(path);
+  std::string line;
+  bool last = false;
+  while (std::getline(dump, line)) {
+    last = last || line.find("/reuse/last") != std::string::npos;
+  }
+  BOOST_CHECK(last);
+  remove(path);
+};
+
+BOOST_FIXTURE_TEST_CASE(StatsTest, MockRestFixture<>)
+{
+  // Exact below 8, then never more than 1/8 above the value
+  RestHistogram histogram;
+  epicsUInt64 values[] = {0, 7, 8, 9, 100, 1000, 123456789, 0xFFFFFFFFFFFFFFFFULL};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    size_t bucket = RestHistogram::bucketOf(values[i]);
+    BOOST_REQUIRE(bucket < REST_HISTOGRAM_BUCKETS);
+    BOOST_CHECK(RestHistogram::bucketMax(bucket) >= values[i]);
+    BOOST_CHECK(RestHistogram::bucketMax(bucket) - values[i] <= values[i] / 8);
+  }
+  for (epicsUInt64 v = 1; v <= 1000; ++v) {
+    histogram.record(v * 1000);
+  }
+  BOOST_CHECK_EQUAL(histogram.getCount(), 1000u);
+  BOOST_CHECK_EQUAL(histogram.getMax(), 1000000u);
+  BOOST_CHECK(histogram.getPercentile(50.0) >= 500000u);
+  BOOST_CHECK(histogram.getPercentile(50.0) <= 500000u + 500000u / 8);
+  BOOST_CHECK_EQUAL(histogram.getPercentile(100.0), 1000000u);
+
+  server.addParam("/api/", "pressure", "1.25");
+  server.setLatency(0.002);
+
+  RestParam *pressure = set.create("PRESSURE", REST_P_DOUBLE, "/api/", "pressure");
+  BOOST_REQUIRE_EQUAL(set.createStats("PRESSURE_STATS", "/api/", "pressure"), 0);
+  BOOST_REQUIRE_EQUAL(set.createStats("HOST_STATS"), 0);
+
+  driver.lock();
+  for (int i = 0; i < 5; ++i) {
+    BOOST_CHECK_EQUAL(pressure->fetch(), 0);
+  }
+  std::string value;
+  BOOST_CHECK_EQUAL(api.get("/api/", "missing", value), 1);
+  BOOST_CHECK_EQUAL(set.updateStats(), 0);
+
+  // The host saw the failed request too, the endpoint only its own
+  double requests, errors, p50, max, bytes, network;
+  int index = -1;
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_REQUESTS", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &requests);
+  BOOST_CHECK_EQUAL(requests, 5.0);
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_P50", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &p50);
+  BOOST_CHECK(p50 >= 0.002);
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_MAX", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &max);
+  BOOST_CHECK(max >= p50);
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_NETWORK_P99", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &network);
+  BOOST_CHECK(network >= 0.002);
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_BYTES", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &bytes);
+  BOOST_CHECK(bytes > 0.0);
+  BOOST_REQUIRE_EQUAL(driver.findParam("HOST_STATS_REQUESTS", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &requests);
+  BOOST_CHECK_EQUAL(requests, 6.0);
+  BOOST_REQUIRE_EQUAL(driver.findParam("HOST_STATS_ERRORS", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &errors);
+  BOOST_CHECK_EQUAL(errors, 1.0);
+
+  // Latencies start over at each update, totals don't
+  BOOST_CHECK_EQUAL(set.updateStats(), 0);
+  driver.unlock();
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_P50", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &p50);
+  BOOST_CHECK_EQUAL(p50, 0.0);
+  BOOST_REQUIRE_EQUAL(driver.findParam("PRESSURE_STATS_REQUESTS", &index), asynSuccess);
+  driver.getDoubleParam(0, index, &requests);
+  BOOST_CHECK_EQUAL(requests, 5.0);
+};
+
+BOOST_FIXTURE_TEST_CASE(MockServerTest, MockRestFixture<5000>)
+{
+  BOOST_REQUIRE_EQUAL(server.addTree("{\"/api/status/\": {\"temperature\": 21.5, "
+                                     "\"state\": \"idle\"}, "
+                                     "\"/api/config/\": {\"gains\": [1, 2, 3]}}"), 0);
+  BOOST_CHECK_EQUAL(server.getValue("/api/status/state"), "\"idle\"");
+  BOOST_CHECK_EQUAL(server.getValue("/api/config/gains", 2), "3");
+  BOOST_CHECK_EQUAL(server.addTree("[1, 2]"), 1);
+
+  std::vector<std::string> values;
+  for (int i = 0; i < 5000; ++i) {
+    values.push_back(i % 2 ? "1.25" : "-3");
+  }
+  server.addArray("/api/config/", "table", values);
+
+  RestParam *temperature = set.create("TEMPERATURE", REST_P_DOUBLE, "/api/status/", "temperature");
+  RestParam *state = set.create("STATE", REST_P_STRING, "/api/status/", "state");
+  RestParam *table = set.create("TABLE", REST_P_DOUBLE, "/api/config/", "table", 5000);
+
+  // Chunked replies, in chunks smaller than a token and larger than a read
+  size_t chunkSizes[] = {7, 100000};
+  for (size_t c = 0; c < 2; ++c) {
+    server.setChunkSize(chunkSizes[c]);
+    double value;
+    std::string text;
+    std::vector<double> tableValues;
+    driver.lock();
+    BOOST_CHECK_EQUAL(temperature->fetch(value), 0);
+    BOOST_CHECK_EQUAL(state->fetch(text), 0);
+    std::vector<int> status = table->fetch(tableValues);
+    driver.unlock();
+    BOOST_CHECK_EQUAL(value, 21.5);
+    BOOST_CHECK_EQUAL(text, "idle");
+    BOOST_REQUIRE_EQUAL(tableValues.size(), 5000u);
+    BOOST_CHECK_EQUAL(status[4999], 0);
+    BOOST_CHECK_EQUAL(tableValues[4998], -3.0);
+    BOOST_CHECK_EQUAL(tableValues[4999], 1.25);
+  }
+  server.setChunkSize(0);
+
+  // A new connection for each request after the first, which closes the
+  // one that was open
+  server.setConnectionClose(true);
+  unsigned long connections = server.getConnections();
+  driver.lock();
+  for (int i = 0; i < 3; ++i) {
+    BOOST_CHECK_EQUAL(temperature->put(20.0 + i), 0);
+  }
+  driver.unlock();
+  BOOST_CHECK_EQUAL(server.getConnections() - connections, 2u);
+  BOOST_CHECK_EQUAL(server.getValue("/api/status/temperature"), "22");
+  server.setConnectionClose(false);
+
+  // Oversized and malformed replies fail the request, and the next one
+  // gets through
+  const char *badResponses[] = {
+    "HTTP/1.1 200 OK\r\nContent-Length: 99999999999\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nffffffffffffffffffffff\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5000000\r\n",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\n1234\r\n0\r\n\r\n"
+  };
+  for (size_t r = 0; r < sizeof(badResponses) / sizeof(badResponses[0]); ++r) {
+    double value;
+    server.setRawResponse(badResponses[r]);
+    driver.lock();
+    BOOST_CHECK_NE(temperature->fetch(value), 0);
+    server.setRawResponse("");
+    BOOST_CHECK_EQUAL(temperature->fetch(value), 0);
+    driver.unlock();
+    BOOST_CHECK_EQUAL(value, 22.0);
+  }
+};
+
+BOOST_AUTO_TEST_SUITE_END();
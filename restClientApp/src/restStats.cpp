@@ -0,0 +1,127 @@
+#include <string.h>
+#include <epicsGuard.h>
+
+#include "restStats.h"
+
+static inline int mostSignificantBit (epicsUInt64 x)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(x);
+#else
+    int n = 0;
+    while(x >>= 1)
+        ++n;
+    return n;
+#endif
+}
+
+RestHistogram::RestHistogram ()
+{
+    reset();
+}
+
+size_t RestHistogram::bucketOf (epicsUInt64 value)
+{
+    if(value < REST_HISTOGRAM_SUB_BUCKETS)
+        return (size_t) value;
+
+    int msb = mostSignificantBit(value);
+    int shift = msb - REST_HISTOGRAM_SUB_BITS;
+    size_t sub = (size_t) (value >> shift) & (REST_HISTOGRAM_SUB_BUCKETS - 1);
+    return (size_t) (shift + 1) * REST_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+epicsUInt64 RestHistogram::bucketMax (size_t bucket)
+{
+    if(bucket < REST_HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    int shift = (int) (bucket / REST_HISTOGRAM_SUB_BUCKETS) - 1;
+    epicsUInt64 sub = bucket % REST_HISTOGRAM_SUB_BUCKETS;
+    epicsUInt64 lower = (REST_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return lower + (((epicsUInt64) 1 << shift) - 1);
+}
+
+void RestHistogram::record (epicsUInt64 value)
+{
+    ++mBuckets[bucketOf(value)];
+    ++mCount;
+    if(value > mMax)
+        mMax = value;
+}
+
+void RestHistogram::reset (void)
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = mMax = 0;
+}
+
+epicsUInt64 RestHistogram::getCount (void)
+{
+    return mCount;
+}
+
+epicsUInt64 RestHistogram::getMax (void)
+{
+    return mMax;
+}
+
+epicsUInt64 RestHistogram::getPercentile (double percentile)
+{
+    if(!mCount)
+        return 0;
+
+    // The rank-th smallest value, counting from 1
+    epicsUInt64 rank = (epicsUInt64) (percentile / 100.0 * mCount + 0.5);
+    if(rank < 1)
+        rank = 1;
+    if(rank > mCount)
+        rank = mCount;
+
+    epicsUInt64 seen = 0;
+    for(size_t bucket = 0; bucket < REST_HISTOGRAM_BUCKETS; ++bucket)
+    {
+        seen += mBuckets[bucket];
+        if(seen >= rank)
+            return bucketMax(bucket) < mMax ? bucketMax(bucket) : mMax;
+    }
+    return mMax;
+}
+
+RestRequestStats::RestRequestStats ()
+    : mLock(), mTotal(), mCheckout(), mNetwork(), mParse(),
+      mRequests(0), mErrors(0), mBytes(0)
+{}
+
+void RestRequestStats::record (epicsUInt64 checkout, epicsUInt64 network, epicsUInt64 parse,
+                               size_t bytes, bool error)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    mTotal.record(checkout + network + parse);
+    mCheckout.record(checkout);
+    mNetwork.record(network);
+    mParse.record(parse);
+    ++mRequests;
+    mBytes += bytes;
+    if(error)
+        ++mErrors;
+}
+
+void RestRequestStats::summarise (rest_request_summary_t & summary)
+{
+    epicsGuard<epicsMutex> guard(mLock);
+    summary.requests = mRequests;
+    summary.errors = mErrors;
+    summary.bytes = mBytes;
+    summary.p50 = mTotal.getPercentile(50.0) * 1e-9;
+    summary.p99 = mTotal.getPercentile(99.0) * 1e-9;
+    summary.max = mTotal.getMax() * 1e-9;
+    summary.checkoutP99 = mCheckout.getPercentile(99.0) * 1e-9;
+    summary.networkP99 = mNetwork.getPercentile(99.0) * 1e-9;
+    summary.parseP99 = mParse.getPercentile(99.0) * 1e-9;
+
+    mTotal.reset();
+    mCheckout.reset();
+    mNetwork.reset();
+    mParse.reset();
+}
@@ -0,0 +1,67 @@
+#ifndef REST_STATS_H
+#define REST_STATS_H
+
+#include <stddef.h>
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+// Log-linear buckets: values below 2^REST_HISTOGRAM_SUB_BITS are counted
+// exactly, larger ones in 2^REST_HISTOGRAM_SUB_BITS buckets per power of 2,
+// so that a bucket is never wider than 1/8 of the values it holds
+#define REST_HISTOGRAM_SUB_BITS 3
+#define REST_HISTOGRAM_SUB_BUCKETS (1 << REST_HISTOGRAM_SUB_BITS)
+#define REST_HISTOGRAM_BUCKETS ((64 - REST_HISTOGRAM_SUB_BITS + 1) * REST_HISTOGRAM_SUB_BUCKETS)
+
+// HDR style histogram of 64 bit values (latencies in ns) with a fixed
+// number of buckets and a fixed relative precision. Not thread safe
+class RestHistogram
+{
+public:
+    RestHistogram ();
+
+    void record (epicsUInt64 value);
+    void reset (void);
+
+    epicsUInt64 getCount (void);
+    epicsUInt64 getMax (void);
+    // The upper bound of the bucket holding the value at percentile (0-100),
+    // 0 if nothing was recorded
+    epicsUInt64 getPercentile (double percentile);
+
+    static size_t bucketOf (epicsUInt64 value);
+    static epicsUInt64 bucketMax (size_t bucket);
+
+private:
+    epicsUInt32 mBuckets[REST_HISTOGRAM_BUCKETS];
+    epicsUInt64 mCount, mMax;
+};
+
+// Latencies and totals of the requests to an endpoint or to a whole host,
+// in seconds. Histograms cover the requests since the previous summary
+typedef struct
+{
+    epicsUInt64 requests, errors, bytes;
+    double p50, p99, max;
+    double checkoutP99, networkP99, parseP99;
+} rest_request_summary_t;
+
+// Requests recorded by RestAPI: waiting for a socket (checkout), sending and
+// receiving (network) and parsing the header and tokenizing the content
+// (parse). Thread safe
+class RestRequestStats
+{
+public:
+    RestRequestStats ();
+
+    void record (epicsUInt64 checkout, epicsUInt64 network, epicsUInt64 parse,
+                 size_t bytes, bool error);
+    // Summarise, then start the histograms over
+    void summarise (rest_request_summary_t & summary);
+
+private:
+    epicsMutex mLock;
+    RestHistogram mTotal, mCheckout, mNetwork, mParse;
+    epicsUInt64 mRequests, mErrors, mBytes;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "restStringIndex.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "restHash.h"
+
+// Short lists are quicker to search than to hash
+#define MIN_INDEXED_VALUES 8
+
+RestStringIndex::RestStringIndex ()
+    : mValues(), mHashes(), mSlots()
+{}
+
+void RestStringIndex::build (std::vector<std::string> const & values)
+{
+    mValues = values;
+    mHashes.resize(values.size());
+    mSlots.clear();
+    if(values.size() < MIN_INDEXED_VALUES)
+        return;
+
+    // At most half full
+    size_t slots = 4;
+    while(slots < 2 * values.size())
+        slots *= 2;
+    mSlots.assign(slots, -1);
+
+    for(size_t value = 0; value < values.size(); ++value)
+    {
+        mHashes[value] = restHash(values[value].data(), values[value].size());
+        insert((int) value);
+    }
+}
+
+int RestStringIndex::add (std::string const & value)
+{
+    mValues.push_back(value);
+    mHashes.push_back(restHash(value.data(), value.size()));
+    int position = (int) mValues.size() - 1;
+
+    // Rehashed into twice the slots when it would be more than half full
+    if(mValues.size() >= MIN_INDEXED_VALUES && 2 * mValues.size() > mSlots.size())
+    {
+        size_t slots = std::max((size_t) 4, mSlots.size());
+        while(slots < 2 * mValues.size())
+            slots *= 2;
+        mSlots.assign(slots, -1);
+        for(int index = 0; index <= position; ++index)
+            insert(index);
+    }
+    else if(!mSlots.empty())
+        insert(position);
+    return position;
+}
+
+void RestStringIndex::insert (int value)
+{
+    size_t mask = mSlots.size() - 1;
+    size_t slot = mHashes[value] & mask;
+    // Duplicates keep the first position, as a linear search would find
+    while(mSlots[slot] >= 0 && mValues[mSlots[slot]] != mValues[value])
+        slot = (slot + 1) & mask;
+    if(mSlots[slot] < 0)
+        mSlots[slot] = value;
+}
+
+int RestStringIndex::find (const char *value, size_t len) const
+{
+    if(mSlots.empty())
+    {
+        for(size_t index = 0; index < mValues.size(); ++index)
+            if(mValues[index].size() == len && !memcmp(mValues[index].data(), value, len))
+                return (int) index;
+        return -1;
+    }
+
+    epicsUInt32 hash = restHash(value, len);
+    size_t mask = mSlots.size() - 1;
+    for(size_t slot = hash & mask; mSlots[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        int index = mSlots[slot];
+        if(mHashes[index] == hash && mValues[index].size() == len &&
+           !memcmp(mValues[index].data(), value, len))
+            return index;
+    }
+    return -1;
+}
+
+int RestStringIndex::find (std::string const & value) const
+{
+    return find(value.data(), value.size());
+}
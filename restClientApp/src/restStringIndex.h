@@ -0,0 +1,34 @@
+#ifndef REST_STRING_INDEX_H
+#define REST_STRING_INDEX_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <epicsTypes.h>
+
+// Positions of the values of a list of strings (enum or critical values),
+// found by hash instead of comparing against each in turn (short lists are
+// still searched in turn, which is quicker). Rebuild it whenever the list
+// changes.
+class RestStringIndex
+{
+public:
+    RestStringIndex ();
+
+    void build (std::vector<std::string> const & values);
+    // Append a value to the list, returning its position
+    int add (std::string const & value);
+
+    // Position of the first value equal to value, -1 if there is none
+    int find (const char *value, size_t len) const;
+    int find (std::string const & value) const;
+
+private:
+    std::vector<std::string> mValues;
+    std::vector<epicsUInt32> mHashes;
+    std::vector<int> mSlots;
+
+    void insert (int value);
+};
+
+#endif
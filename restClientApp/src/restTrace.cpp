@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsTime.h>
+#include <epicsAtExit.h>
+#include <iocsh.h>
+
+#include "restTrace.h"
+
+#include <epicsExport.h>
+
+// Written only by its thread. head counts every event recorded, published
+// after the record it completes, so that a dump can tell which records it
+// copied may have been overwritten meanwhile
+typedef struct rest_trace_ring
+{
+    char thread[32];
+    size_t head;
+    rest_trace_record_t records[REST_TRACE_RING_SIZE];
+} rest_trace_ring_t;
+
+static const char *eventNames[REST_TRACE_EVENTS] = {
+    "requestStart", "socketCheckout", "send", "firstByte", "parseEnd", "setParamEnd"
+};
+
+int restTraceEnabled = 0;
+
+static epicsThreadOnceId traceOnce = EPICS_THREAD_ONCE_INIT;
+static epicsThreadPrivateId traceRingKey;
+static epicsMutex *traceLock;
+// Guarded by traceLock
+static std::vector<rest_trace_ring_t*> *traceRings;
+// Rings of exited threads, still dumped until another thread takes them
+static std::vector<rest_trace_ring_t*> *traceFreeRings;
+static std::map<std::string, epicsUInt32> *traceEndpointIds;
+static std::vector<std::string> *traceEndpointNames;
+// Given to threads beyond REST_TRACE_MAX_RINGS, which then record nothing
+static rest_trace_ring_t noRing;
+
+static void traceInit (void *)
+{
+    traceRingKey = epicsThreadPrivateCreate();
+    traceLock = new epicsMutex();
+    traceRings = new std::vector<rest_trace_ring_t*>();
+    traceFreeRings = new std::vector<rest_trace_ring_t*>();
+    traceEndpointIds = new std::map<std::string, epicsUInt32>();
+    traceEndpointNames = new std::vector<std::string>(1, "-");
+}
+
+static void releaseRing (void *ring)
+{
+    epicsGuard<epicsMutex> guard(*traceLock);
+    traceFreeRings->push_back((rest_trace_ring_t *) ring);
+}
+
+static rest_trace_ring_t *newRing (void)
+{
+    rest_trace_ring_t *ring = &noRing;
+    {
+        epicsGuard<epicsMutex> guard(*traceLock);
+        if (!traceFreeRings->empty()) {
+            ring = traceFreeRings->back();
+            traceFreeRings->pop_back();
+        } else if (traceRings->size() < REST_TRACE_MAX_RINGS) {
+            ring = new rest_trace_ring_t;
+            traceRings->push_back(ring);
+        } else {
+            fprintf(stderr, "restTrace: all %d rings in use, events of thread %s are dropped\n",
+                    REST_TRACE_MAX_RINGS, epicsThreadGetNameSelf());
+        }
+
+        if (ring != &noRing) {
+            strncpy(ring->thread, epicsThreadGetNameSelf(), sizeof(ring->thread) - 1);
+            ring->thread[sizeof(ring->thread) - 1] = '\0';
+            ring->head = 0;
+        }
+    }
+    if (ring != &noRing)
+        epicsAtThreadExit(releaseRing, ring);
+    epicsThreadPrivateSet(traceRingKey, ring);
+    return ring;
+}
+
+void restTraceRecord (rest_trace_event_t event, epicsUInt32 endpoint)
+{
+    rest_trace_ring_t *ring = (rest_trace_ring_t *) epicsThreadPrivateGet(traceRingKey);
+    if (!ring)
+        ring = newRing();
+    if (ring == &noRing)
+        return;
+
+    size_t head = ring->head;
+    rest_trace_record_t & record = ring->records[head & (REST_TRACE_RING_SIZE - 1)];
+    record.time = epicsMonotonicGet();
+    record.endpoint = endpoint;
+    record.event = (epicsUInt32) event;
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&ring->head, head + 1);
+}
+
+void restTraceEnable (int enable)
+{
+    epicsThreadOnce(&traceOnce, traceInit, NULL);
+    epicsAtomicSetIntT(&restTraceEnabled, enable ? 1 : 0);
+}
+
+epicsUInt32 restTraceEndpoint (std::string const & name)
+{
+    epicsThreadOnce(&traceOnce, traceInit, NULL);
+    epicsGuard<epicsMutex> guard(*traceLock);
+    std::map<std::string, epicsUInt32>::iterator it = traceEndpointIds->find(name);
+    if (it != traceEndpointIds->end())
+        return it->second;
+
+    epicsUInt32 id = (epicsUInt32) traceEndpointNames->size();
+    traceEndpointNames->push_back(name);
+    traceEndpointIds->insert(std::make_pair(name, id));
+    return id;
+}
+
+int restTraceDump (const char *path)
+{
+    epicsThreadOnce(&traceOnce, traceInit, NULL);
+    FILE *file = stdout;
+    if (path && *path) {
+        file = fopen(path, "w");
+        if (!file) {
+            fprintf(stderr, "restTraceDump: can't open %s\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The rings keep recording while they are copied
+    std::vector<rest_trace_record_t> records(REST_TRACE_RING_SIZE);
+    epicsGuard<epicsMutex> guard(*traceLock);
+    for (size_t r = 0; r < traceRings->size(); ++r) {
+        rest_trace_ring_t *ring = (*traceRings)[r];
+        size_t head = epicsAtomicGetSizeT(&ring->head);
+        epicsAtomicReadMemoryBarrier();
+        size_t start = head > REST_TRACE_RING_SIZE ? head - REST_TRACE_RING_SIZE : 0;
+        for (size_t i = start; i < head; ++i)
+            records[i - start] = ring->records[i & (REST_TRACE_RING_SIZE - 1)];
+        epicsAtomicReadMemoryBarrier();
+
+        // Records the thread went on to overwrite meanwhile are dropped
+        size_t after = epicsAtomicGetSizeT(&ring->head);
+        size_t valid = after > start + REST_TRACE_RING_SIZE ? after - REST_TRACE_RING_SIZE : start;
+        for (size_t i = valid; i < head; ++i) {
+            rest_trace_record_t const & record = records[i - start];
+            const char *endpoint = record.endpoint < traceEndpointNames->size() ?
+                    (*traceEndpointNames)[record.endpoint].c_str() : "?";
+            fprintf(file, "%s %llu %s %s\n", ring->thread, (unsigned long long) record.time,
+                    record.event < REST_TRACE_EVENTS ? eventNames[record.event] : "?",
+                    endpoint);
+        }
+    }
+
+    if (file != stdout)
+        fclose(file);
+    return EXIT_SUCCESS;
+}
+
+static const iocshArg restTraceEnableArg0 = {"enable", iocshArgInt};
+static const iocshArg * const restTraceEnableArgs[] = {&restTraceEnableArg0};
+static const iocshFuncDef restTraceEnableDef = {"restTraceEnable", 1, restTraceEnableArgs};
+
+static void restTraceEnableCall (const iocshArgBuf *args)
+{
+    restTraceEnable(args[0].ival);
+}
+
+static const iocshArg restTraceDumpArg0 = {"file", iocshArgString};
+static const iocshArg * const restTraceDumpArgs[] = {&restTraceDumpArg0};
+static const iocshFuncDef restTraceDumpDef = {"restTraceDump", 1, restTraceDumpArgs};
+
+static void restTraceDumpCall (const iocshArgBuf *args)
+{
+    restTraceDump(args[0].sval);
+}
+
+static void restTraceRegister (void)
+{
+    iocshRegister(&restTraceEnableDef, restTraceEnableCall);
+    iocshRegister(&restTraceDumpDef, restTraceDumpCall);
+}
+
+extern "C" {
+epicsExportRegistrar(restTraceRegister);
+}
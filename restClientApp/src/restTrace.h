@@ -0,0 +1,57 @@
+#ifndef REST_TRACE_H
+#define REST_TRACE_H
+
+#include <string>
+#include <epicsTypes.h>
+#include <epicsAtomic.h>
+
+// Events kept per thread (a power of 2), the oldest overwritten first
+#define REST_TRACE_RING_SIZE 4096
+// Threads with a ring at once, a ring being reused once its thread exits;
+// events of any further thread are dropped, with a warning
+#define REST_TRACE_MAX_RINGS 64
+
+// Points of the request path that are timestamped
+typedef enum
+{
+    REST_TRACE_REQUEST_START,   // RestAPI get or put called
+    REST_TRACE_SOCKET_CHECKOUT, // Socket taken for the request
+    REST_TRACE_SEND,            // Request sent
+    REST_TRACE_FIRST_BYTE,      // First bytes of the response received
+    REST_TRACE_PARSE_END,       // Response tokenized
+    REST_TRACE_SET_PARAM_END,   // Value set in the asyn parameter library
+    REST_TRACE_EVENTS
+} rest_trace_event_t;
+
+typedef struct
+{
+    epicsUInt64 time;           // epicsMonotonicGet(), in ns
+    epicsUInt32 endpoint;       // From restTraceEndpoint, 0 for none
+    epicsUInt32 event;          // rest_trace_event_t
+} rest_trace_record_t;
+
+// Binary event tracing of the request path. Each thread records into a ring
+// of its own, without locking: a timestamp and two integers per event, so
+// that it can be left enabled. Rings are formatted only when dumped, on
+// demand from the restTraceDump iocsh command (restTrace.dbd)
+
+// Read on every event, set by restTraceEnable
+extern int restTraceEnabled;
+
+#define REST_TRACE(event, endpoint) \
+        { \
+            if (epicsAtomicGetIntT(&restTraceEnabled)) \
+                restTraceRecord(event, endpoint); \
+        }
+
+void restTraceRecord (rest_trace_event_t event, epicsUInt32 endpoint);
+void restTraceEnable (int enable);
+
+// Id tagging the events of the endpoint named, the same every time
+epicsUInt32 restTraceEndpoint (std::string const & name);
+
+// Write the events of every ring as text, a thread at a time, oldest first:
+// "<thread> <time ns> <event> <endpoint>". To stdout if path is NULL or empty
+int restTraceDump (const char *path);
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef TYPED_REST_PARAM_H
+#define TYPED_REST_PARAM_H
+
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <frozen.h>
+
+#include "restParam.h"
+#include "jsonNumber.h"
+#include "jsonWriter.h"
+
+// REST type of the parameters a TypedRestParam<T> is for
+template <typename T> struct rest_typed_param_traits;
+
+template <> struct rest_typed_param_traits<bool>
+{
+    static const rest_param_type_t type = REST_P_BOOL;
+};
+
+template <> struct rest_typed_param_traits<int>
+{
+    static const rest_param_type_t type = REST_P_INT;
+};
+
+template <> struct rest_typed_param_traits<double>
+{
+    static const rest_param_type_t type = REST_P_DOUBLE;
+};
+
+template <> struct rest_typed_param_traits<std::string>
+{
+    static const rest_param_type_t type = REST_P_STRING;
+};
+
+// Front end to a scalar RestParam of a type known at compile time: bool, int,
+// double or std::string. Parsing, formatting, clamping and the asyn setter
+// are picked by overloading rather than by switching on the REST and asyn
+// types at each call, and parsing reads the response token in place.
+// Enums, commands and arrays are left to RestParam, which is still the
+// parameter: getParam() returns it for everything else (push, write-behind,
+// metadata...). Like RestParam, call with the port driver locked
+template <typename T>
+class TypedRestParam
+{
+public:
+    TypedRestParam (RestParamSet *set, std::string const & asynName,
+                    std::string const & subSystem = "", std::string const & name = "",
+                    bool strict = false)
+        : mParam(set->create(asynName, rest_typed_param_traits<T>::type,
+                             subSystem, name, 0, strict)),
+          mRawValue()
+    {}
+
+    RestParam *getParam (void)
+    {
+        return mParam;
+    }
+
+    int getIndex (void)
+    {
+        return mParam->getIndex();
+    }
+
+    // Get the underlying asyn parameter value
+    int get (T & value)
+    {
+        return getAsyn(*mParam, value);
+    }
+
+    // Fetch the current value from the device, update the underlying asyn
+    // parameter and its connection status like RestParam::fetch(), and
+    // return the value
+    int fetch (T & value)
+    {
+        if(!mParam->mRemote || mParam->mAccessMode == REST_ACC_WO)
+            return EXIT_SUCCESS;
+        return mParam->fetched(fetchValue(value));
+    }
+
+    int fetch (void)
+    {
+        T value;
+        return fetch(value);
+    }
+
+    // Put the value both to the device (clamped to its limits) and to the
+    // underlying asyn parameter if successful, through the same steps as
+    // RestParam::put (see RestParam::beginPut)
+    int put (T const & value)
+    {
+        return putValue(value);
+    }
+
+private:
+    RestParam *mParam;
+    // Reused to format the values put
+    std::string mRawValue;
+
+    int fetchValue (T & value)
+    {
+        const char *functionName = "fetch<typed>";
+        RestParam & param = *mParam;
+
+        struct json_token *token;
+        if(param.baseFetchToken(token))
+        {
+            param.setError(functionName, "Underlying baseFetch failed");
+            return EXIT_FAILURE;
+        }
+        if(!token)
+            return EXIT_SUCCESS;
+
+        if(parse(token, value))
+        {
+            param.setError(functionName, "Failed to parse value '" +
+                    std::string(token->ptr, token->len) + "'");
+            return EXIT_FAILURE;
+        }
+
+        if(updateAsyn(param, value))
+        {
+            param.setError(functionName, "Failed to set asyn parameter");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // Numeric values may be clamped, so they are taken by value
+    int putValue (int value)
+    {
+        bool done;
+        int status = mParam->beginPut("put<typed>", value, -1,
+                                      REST_P_MASK(REST_P_INT) | REST_P_MASK(REST_P_UINT), done);
+        return status || done ? status : send(value);
+    }
+
+    int putValue (double value)
+    {
+        bool done;
+        int status = mParam->beginPut("put<typed>", value, -1, REST_P_MASK(REST_P_DOUBLE), done);
+        return status || done ? status : send(value);
+    }
+
+    int putValue (bool value)
+    {
+        if(mParam->mRemote && mParam->beginPut("put<typed>", -1, REST_P_MASK(REST_P_BOOL)))
+            return EXIT_FAILURE;
+        return send(value);
+    }
+
+    int putValue (std::string const & value)
+    {
+        if(mParam->mRemote && mParam->beginPut("put<typed>", -1, REST_P_MASK(REST_P_STRING)))
+            return EXIT_FAILURE;
+        return send(value);
+    }
+
+    int send (T const & value)
+    {
+        const char *functionName = "put<typed>";
+        RestParam & param = *mParam;
+        if(param.mRemote)
+        {
+            mRawValue.clear();
+            JsonWriter(mRawValue).value(value);
+            if(param.basePut(mRawValue))
+            {
+                param.setError(functionName, "Underlying basePut failed");
+                return EXIT_FAILURE;
+            }
+        }
+        return publish(value);
+    }
+
+    int publish (T const & value)
+    {
+        const char *functionName = "put<typed>";
+        if(setAsyn(*mParam, value))
+        {
+            mParam->setError(functionName, "Failed to set asyn parameter");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    static int parse (struct json_token const *token, bool & value)
+    {
+        if(token->len == 4 && !memcmp(token->ptr, "true", 4))
+            value = true;
+        else if(token->len == 5 && !memcmp(token->ptr, "false", 5))
+            value = false;
+        else
+            return EXIT_FAILURE;
+        return EXIT_SUCCESS;
+    }
+
+    static int parse (struct json_token const *token, int & value)
+    {
+        return parseJsonNumber(token, value);
+    }
+
+    static int parse (struct json_token const *token, double & value)
+    {
+        return parseJsonNumber(token, value);
+    }
+
+    static int parse (struct json_token const *token, std::string & value)
+    {
+        value.assign(token->ptr, token->len);
+        return EXIT_SUCCESS;
+    }
+
+    // Booleans are asyn integers
+    static int getAsyn (RestParam & param, bool & value)
+    {
+        int intValue;
+        int status = param.getParam(intValue);
+        value = intValue != 0;
+        return status;
+    }
+
+    template <typename V>
+    static int getAsyn (RestParam & param, V & value)
+    {
+        return param.getParam(value);
+    }
+
+    static int setAsyn (RestParam & param, bool value)
+    {
+        return param.setParam((int) value);
+    }
+
+    template <typename V>
+    static int setAsyn (RestParam & param, V const & value)
+    {
+        return param.setParam(value);
+    }
+
+    static int updateAsyn (RestParam & param, bool value)
+    {
+        return param.updateParam((int) value);
+    }
+
+    template <typename V>
+    static int updateAsyn (RestParam & param, V const & value)
+    {
+        return param.updateParam(value);
+    }
+};
+
+#endif